@@ -0,0 +1,44 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "perf.hpp"
+#include "perf_watcher.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <unordered_map>
+
+namespace ddprof {
+
+// Last values read with the samples of counter groups, to attribute the
+// counts between two samples to the second one.
+// Counters are identified by the id of the group leader. Inherited events
+// report the id of the parent event for all the threads, with per-thread
+// values: per-task counters are also keyed by tid (CPU wide counters use 0).
+class CounterGroupValues {
+public:
+  using Deltas = std::array<int64_t, k_nb_counter_group_members>;
+
+  // Counts since the previous sample of the same counters. The first sample
+  // only records the values (returns false).
+  bool deltas(const read_format &read, pid_t tid, Deltas &deltas);
+
+  // Forget the counters of a thread that exited
+  void erase(pid_t tid);
+
+  // Number of threads with counter values
+  [[nodiscard]] size_t size() const { return _values.size(); }
+
+private:
+  using Values = std::array<uint64_t, k_nb_counter_group_members>;
+  // values by tid, then by id of the group leader
+  std::unordered_map<pid_t, std::unordered_map<uint64_t, Values>> _values;
+};
+
+} // namespace ddprof
@@ -17,6 +17,12 @@ struct DDProfContext;
 // Setup perf event open according to watchers
 DDRes ddprof_setup(DDProfContext &ctx);
 
+// Open perf events on the CPUs the target was allowed to run on since setup
+DDRes ddprof_open_new_cpus(DDProfContext &ctx);
+
+// True if the target is allowed to run on CPUs without perf events
+bool ddprof_target_has_new_cpus(const DDProfContext &ctx);
+
 // Free perf event resources
 DDRes ddprof_teardown(DDProfContext &ctx);
 
@@ -27,6 +27,7 @@ struct DDProfContext {
     int nice{-1};
     int num_cpu{};
     pid_t pid{0}; // ! only use for perf attach (can be -1 in global mode)
+    std::string cgroup; // restricts global mode to a cgroup
     uint32_t worker_period{}; // exports between worker refreshes
     int dd_profiling_fd{-1};  // opened file descriptor to our internal lib
     std::string socket_path;
@@ -13,6 +13,9 @@ bool parse_cpu_mask(std::string_view sv, cpu_set_t &cpu_mask);
 
 std::string cpu_mask_to_string(const cpu_set_t &cpu_mask);
 
+/* Parse cpu list (eg. 0-3,8 as in Cpus_allowed_list or cpuset.cpus) */
+bool parse_cpu_list(std::string_view sv, cpu_set_t &cpu_mask);
+
 // Return number of configured processors
 int nprocessors_conf();
 
@@ -24,11 +24,23 @@ inline constexpr size_t kMaxStackDepth{512};
 // Check linux sources for a reference to the sample size check
 inline constexpr uint32_t k_default_perf_stack_sample_size = 32000;
 
+// Depth of the user callchains walked by the kernel (frame pointers).
+// Default value of the kernel.perf_event_max_stack sysctl, the upper bound
+// accepted by perf_event_open.
+inline constexpr uint16_t k_default_callchain_max_stack = 127;
+
+// Stack copied for hybrid unwinding (leaf frames only)
+inline constexpr uint32_t k_default_hybrid_stack_sample_size = 512;
+
 // considering sample size, we adjust the size of ring buffers.
 // Following is considered as a minimum number of samples to be fit in the
 // ring buffer.
 inline constexpr auto k_min_number_samples_per_ring_buffer = 8;
 
+// Allocation events are spread over several ring buffers (one per group of
+// threads) to reduce contention between allocating threads
+inline constexpr unsigned k_max_allocation_ring_buffers = 8;
+
 inline constexpr int k_size_api_key = 32;
 
 // Maximum number of profiled pids
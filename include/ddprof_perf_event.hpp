@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <linux/perf_event.h>
 #include <type_traits>
 
@@ -12,7 +13,11 @@
 // There are <30 different perf events (starting at 1000 seems safe)
 enum : uint32_t {
   PERF_CUSTOM_EVENT_DEALLOCATION = 1000,
-  PERF_CUSTOM_EVENT_CLEAR_LIVE_ALLOCATION
+  PERF_CUSTOM_EVENT_CLEAR_LIVE_ALLOCATION,
+  PERF_CUSTOM_EVENT_EVICT_LIVE_ALLOCATION,
+  PERF_CUSTOM_EVENT_BATCH,
+  PERF_CUSTOM_EVENT_ALLOCATION_CALLCHAIN,
+  PERF_CUSTOM_EVENT_DEALLOCATION_BATCH
 };
 
 static_assert(static_cast<uint32_t>(PERF_CUSTOM_EVENT_DEALLOCATION) >
@@ -28,10 +33,40 @@ struct DeallocationEvent {
   uintptr_t ptr;
 };
 
+// Consecutive deallocations of a thread (sample_id.time is the time of the
+// first one)
+struct DeallocationBatchEvent {
+  perf_event_header hdr;
+  struct sample_id sample_id;
+  uint32_t nb_addrs;
+  uint32_t reserved;
+  uintptr_t addrs[];
+};
+
 // Event to notify we have tracked too many allocations
 struct ClearLiveAllocationEvent {
   perf_event_header hdr;
   struct sample_id sample_id;
 };
 
+// Event to notify that a subset of the tracked addresses is no longer tracked
+// (addresses whose liveallocation::address_hash matches value on mask)
+struct EvictLiveAllocationEvent {
+  perf_event_header hdr;
+  struct sample_id sample_id;
+  uint32_t hash_mask;
+  uint32_t hash_value;
+};
+
+// Records staged by a thread and pushed as a single ring buffer record.
+// data holds nb_records complete events (8 byte aligned, each with its own
+// header).
+struct BatchEvent {
+  perf_event_header hdr;
+  struct sample_id sample_id;
+  uint32_t nb_records;
+  uint32_t reserved;
+  std::byte data[];
+};
+
 } // namespace ddprof
@@ -18,6 +18,7 @@ namespace ddprof {
   X(EVENT_OUT_OF_ORDER, "event.out_of_order", STAT_GAUGE)                      \
   X(SAMPLE_COUNT, "sample.count", STAT_GAUGE)                                  \
   X(UNMATCHED_DEALLOCATION_COUNT, "unmatched_deallocation.count", STAT_GAUGE)  \
+  X(EVICTED_ALLOCATION_COUNT, "evicted_allocation.count", STAT_GAUGE)          \
   X(TARGET_CPU_USAGE, "target_process.cpu_usage.millicores", STAT_GAUGE)       \
   X(UNWIND_AVG_TIME, "unwind.avg_time_ns", STAT_GAUGE)                         \
   X(UNWIND_FRAMES, "unwind.frames", STAT_GAUGE)                                \
@@ -39,7 +40,9 @@ namespace ddprof {
   X(PPROF_SIZE, "pprof.size", STAT_GAUGE)                                      \
   X(PROFILE_DURATION, "profile.duration_ms", STAT_GAUGE)                       \
   X(AGGREGATION_AVG_TIME, "aggregation.avg_time_ns", STAT_GAUGE)               \
-  X(BACKPOPULATE_COUNT, "backpopulate.count", STAT_GAUGE)
+  X(BACKPOPULATE_COUNT, "backpopulate.count", STAT_GAUGE)                      \
+  X(RING_BUFFER_TOTAL_SIZE, "ring_buffer.total_size", STAT_GAUGE)              \
+  X(RING_BUFFER_MAX_SIZE, "ring_buffer.max_size", STAT_GAUGE)
 
 // Expand the enum/index for the individual stats
 enum DDPROF_STATS { STATS_TABLE(X_ENUM) STATS_LEN };
@@ -5,9 +5,13 @@
 
 #pragma once
 
+#include "counter_group_values.hpp"
 #include "live_allocation.hpp"
+#include "pending_stacks.hpp"
+#include "perf_watcher.hpp"
 #include "pevent.hpp"
 #include "proc_status.hpp"
+#include "stack_table.hpp"
 
 #include <array>
 #include <chrono>
@@ -41,7 +45,13 @@ struct DDProfWorkerContext {
       send_time{};          // Last time an export was sent
   uint32_t count_worker{0}; // exports since last cache clear
   std::array<uint64_t, kMaxTypeWatcher> lost_events_per_watcher{};
-  LiveAllocation live_allocation;
+  // unique stacks referenced by live allocations and pre-aggregated samples
+  StackTable stack_table;
+  LiveAllocation live_allocation{stack_table};
+  // stacks of threads switched out, until they run again
+  PendingStacks pending_stacks{stack_table};
+  // last values of the counter groups
+  CounterGroupValues counter_group_values;
   int64_t perfclock_offset;
   PerfClock::time_point last_processed_event_timestamp{};
 };
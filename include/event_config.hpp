@@ -17,6 +17,7 @@ namespace ddprof {
 enum EventAggregationModePos {
   kSumPos = 0,
   kLiveSumPos = 1,
+  kLifetimePos = 2,
   kNbEventAggregationModes
 };
 
@@ -25,7 +26,8 @@ enum class EventAggregationMode : uint32_t {
   kDisabled = 0,
   kSum = 1 << kSumPos,         // Sum of usage (example: overall CPU usage)
   kLiveSum = 1 << kLiveSumPos, // Report live usage (example memory leaks)
-  kAll = kSum | kLiveSum,
+  kLifetime = 1 << kLifetimePos, // Report freed usage per lifetime
+  kAll = kSum | kLiveSum | kLifetime,
 };
 
 constexpr bool Any(EventAggregationMode arg) {
@@ -109,6 +111,7 @@ enum class EventConfField {
    *  output mode:
    *    * 'M' or 'm' -- emit a metric
    *    * 'G' or 'g' -- emit a flamegraph (default)
+   *    * 'T' or 't' -- emit allocation lifetimes
    *    * 'A', 'a', or '*' -- emit all outputs
    */
   kParameter,
@@ -132,6 +135,33 @@ enum class EventConfField {
    * are copied from the user application. This will define how far we can
    * unwind.
    */
+  kUnwind,
+  /*
+   *  How the stack is unwound: 'dwarf' (default) copies the user stack for
+   *  the profiler to unwind it, 'fp' walks the frame pointers (requires
+   *  binaries built with frame pointers). Frame pointers are walked in the
+   *  profiled process for allocations, by the kernel for perf events
+   *  (PERF_SAMPLE_CALLCHAIN). 'hybrid' (perf events) copies a small stack to
+   *  unwind the leaf frames and uses the kernel callchain for the others.
+   */
+  kMaxStack,
+  /*
+   *  Maximum depth of the callchains walked by the kernel ('fp' unwinding of
+   *  perf events). Bounded by the kernel.perf_event_max_stack sysctl.
+   */
+  kFilter,
+  /*
+   *  A tracepoint filter expression, quoted (eg. `filter="count > 65536"`).
+   *  It is installed in the kernel (PERF_EVENT_IOC_SET_FILTER): events that
+   *  do not match are dropped before reaching the ring buffer. The syntax is
+   *  the one of the tracefs `filter` files.
+   */
+  kHugePages,
+  /*
+   *  1 to back the ring buffers of allocation events with 2MB huge pages
+   *  (fewer TLB misses when producers write stacks), if the system has huge
+   *  pages available. Regular pages are used otherwise.
+   */
 };
 
 struct EventConf {
@@ -142,12 +172,17 @@ struct EventConf {
   std::string eventname{};
   std::string groupname{};
   std::string label{};
+  std::string filter{};
 
   EventConfValueSource value_source{};
   uint8_t register_num{};
   uint8_t raw_size{};
   uint64_t raw_offset{};
   uint32_t stack_sample_size{k_default_perf_stack_sample_size};
+  bool frame_pointers{};
+  bool hybrid_unwind{};
+  uint16_t max_stack{k_default_callchain_max_stack};
+  bool huge_pages{};
   double value_scale{};
 
   EventConfCadenceType cad_type{};
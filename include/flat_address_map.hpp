@@ -0,0 +1,172 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ddprof {
+
+// Open-addressing hash map specialized for (non null) address keys.
+// Keys are stored contiguously (a cache line holds 8 probe candidates) and
+// values live in a parallel array. Collisions use linear probing, deletions
+// shift back the following entries so that no tombstone is left behind:
+// lookups never degrade as allocations come and go.
+// Inserting may move values: references are invalidated on insertion.
+template <typename T> class FlatAddressMap {
+public:
+  static constexpr size_t k_min_capacity = 64;
+
+  explicit FlatAddressMap(size_t capacity = 0) {
+    if (capacity) {
+      reserve(capacity);
+    }
+  }
+
+  // Returns the value for addr (nullptr if not found)
+  T *find(uintptr_t addr) {
+    if (_keys.empty() || addr == k_empty) {
+      return nullptr;
+    }
+    for (size_t pos = slot(addr);; pos = next(pos)) {
+      if (_keys[pos] == addr) {
+        return &_values[pos];
+      }
+      if (_keys[pos] == k_empty) {
+        return nullptr;
+      }
+    }
+  }
+
+  // Returns the value for addr, default-constructing it if needed
+  T &operator[](uintptr_t addr) {
+    if ((_size + 1) * k_max_load_den > _keys.size() * k_max_load_num) {
+      rehash(std::max(k_min_capacity, _keys.size() * 2));
+    }
+    size_t pos = slot(addr);
+    for (; _keys[pos] != k_empty; pos = next(pos)) {
+      if (_keys[pos] == addr) {
+        return _values[pos];
+      }
+    }
+    _keys[pos] = addr;
+    _values[pos] = T{};
+    ++_size;
+    return _values[pos];
+  }
+
+  // Returns true if addr was removed
+  bool erase(uintptr_t addr) {
+    T *value = find(addr);
+    if (!value) {
+      return false;
+    }
+    erase(value);
+    return true;
+  }
+
+  // Remove the entry of a value returned by find
+  void erase(T *value) {
+    erase_slot(static_cast<size_t>(value - _values.data()));
+  }
+
+  // Remove the entries for which pred(addr, value) is true (returns the number
+  // of removed entries)
+  template <typename Pred> size_t erase_if(Pred pred) {
+    size_t nb_erased = 0;
+    for (size_t pos = 0; pos < _keys.size();) {
+      if (_keys[pos] != k_empty && pred(_keys[pos], _values[pos])) {
+        // a following entry can shift back into pos: check it again
+        erase_slot(pos);
+        ++nb_erased;
+        continue;
+      }
+      ++pos;
+    }
+    return nb_erased;
+  }
+
+  // Size the table to hold nb_elements without rehashing
+  void reserve(size_t nb_elements) {
+    const size_t capacity =
+        std::bit_ceil(nb_elements * k_max_load_den / k_max_load_num + 1);
+    if (capacity > _keys.size()) {
+      rehash(std::max(k_min_capacity, capacity));
+    }
+  }
+
+  void clear() {
+    _keys.assign(_keys.size(), k_empty);
+    _size = 0;
+  }
+
+  [[nodiscard]] size_t size() const { return _size; }
+  [[nodiscard]] bool empty() const { return _size == 0; }
+  [[nodiscard]] size_t capacity() const { return _keys.size(); }
+
+private:
+  static constexpr uintptr_t k_empty = 0;
+  // Grow above 3/4 occupancy
+  static constexpr size_t k_max_load_num = 3;
+  static constexpr size_t k_max_load_den = 4;
+
+  [[nodiscard]] size_t slot(uintptr_t addr) const {
+    // Fibonacci hashing: the high bits of the product mix all address bits
+    // (low bits are mostly zero because of alignment)
+    // NOLINTNEXTLINE(readability-magic-numbers)
+    return static_cast<size_t>((addr * 0x9E3779B97F4A7C15ULL) >> _shift);
+  }
+  [[nodiscard]] size_t next(size_t pos) const {
+    return (pos + 1) & (_keys.size() - 1);
+  }
+
+  void erase_slot(size_t hole) {
+    // Backward shift: move up the entries that probed past the hole
+    for (size_t pos = next(hole); _keys[pos] != k_empty; pos = next(pos)) {
+      const size_t ideal = slot(_keys[pos]);
+      // Entry can move if its ideal slot is not in (hole, pos]
+      if (((pos - ideal) & (_keys.size() - 1)) >=
+          ((pos - hole) & (_keys.size() - 1))) {
+        _keys[hole] = _keys[pos];
+        _values[hole] = std::move(_values[pos]);
+        hole = pos;
+      }
+    }
+    _keys[hole] = k_empty;
+    _values[hole] = T{};
+    --_size;
+  }
+
+  void rehash(size_t capacity) {
+    std::vector<uintptr_t> keys(capacity, k_empty);
+    std::vector<T> values(capacity);
+    std::swap(keys, _keys);
+    std::swap(values, _values);
+    _shift = 64 - std::countr_zero(capacity);
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (keys[i] == k_empty) {
+        continue;
+      }
+      size_t pos = slot(keys[i]);
+      while (_keys[pos] != k_empty) {
+        pos = next(pos);
+      }
+      _keys[pos] = keys[i];
+      _values[pos] = std::move(values[i]);
+    }
+  }
+
+  std::vector<uintptr_t> _keys;
+  std::vector<T> _values;
+  size_t _size{0};
+  unsigned _shift{64};
+};
+
+} // namespace ddprof
@@ -0,0 +1,104 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "ddprof_defs.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace ddprof {
+
+struct GoFrame {
+  std::string_view function;
+  std::string_view file;
+  uint32_t line;
+};
+
+// Reader for the Go runtime symbol table (.gopclntab).
+// Go binaries always carry this table (even when stripped), it maps every pc
+// to a function name, a file and a line, including inlined calls.
+// All returned strings point inside the mapped table: lookups do not allocate.
+class GoPclntab {
+public:
+  enum class Version : uint8_t {
+    kGo116, // 0xfffffffa
+    kGo118, // 0xfffffff0 (1.18 - 1.19)
+    kGo120, // 0xfffffff1 (1.20+)
+  };
+
+  // Maximum number of frames (inlined frames + outer function) for a pc
+  static constexpr size_t k_max_inline_depth = 16;
+
+  GoPclntab(const GoPclntab &) = delete;
+  GoPclntab &operator=(const GoPclntab &) = delete;
+  ~GoPclntab();
+
+  // Map the ELF file and parse its .gopclntab section.
+  // Returns null if the file is not a Go binary or if the format is not
+  // supported.
+  static std::unique_ptr<GoPclntab> open(const std::string &path);
+
+  // Parse an in-memory table (memory is not owned).
+  // gofunc is the go:func.* region (referenced by funcdata), it is only needed
+  // to report inlined frames (Go >= 1.18).
+  static std::unique_ptr<GoPclntab>
+  parse(std::span<const std::byte> pclntab,
+        std::span<const std::byte> gofunc = {});
+
+  // Write the frames matching the elf address, innermost first.
+  // Returns the number of frames written (0 if address is not covered).
+  size_t symbolize(ElfAddress_t addr, std::span<GoFrame> frames) const;
+
+  [[nodiscard]] Version version() const { return _version; }
+  [[nodiscard]] uint64_t nb_functions() const { return _nfunc; }
+  [[nodiscard]] uint64_t text_start() const { return _text_start; }
+  [[nodiscard]] bool has_inline_info() const { return !_gofunc.empty(); }
+
+private:
+  struct FuncInfo {
+    std::span<const std::byte> func; // _func structure
+    uint64_t entry;
+  };
+
+  GoPclntab() = default;
+
+  bool init(std::span<const std::byte> pclntab,
+            std::span<const std::byte> gofunc);
+
+  [[nodiscard]] std::optional<FuncInfo> find_func(ElfAddress_t addr) const;
+  [[nodiscard]] uint64_t func_entry(size_t idx) const;
+
+  [[nodiscard]] std::optional<int32_t>
+  pcvalue(uint32_t table_off, uint64_t entry, ElfAddress_t target_pc) const;
+
+  [[nodiscard]] std::string_view func_name(int32_t name_off) const;
+  [[nodiscard]] std::string_view file_name(uint32_t cu_offset,
+                                           int32_t file_idx) const;
+
+  std::span<const std::byte> _data;
+  std::span<const std::byte> _funcnametab;
+  std::span<const std::byte> _cutab;
+  std::span<const std::byte> _filetab;
+  std::span<const std::byte> _pctab;
+  std::span<const std::byte> _pclntable;
+  std::span<const std::byte> _gofunc;
+  uint64_t _nfunc{};
+  uint64_t _text_start{};
+  Version _version{Version::kGo120};
+  uint8_t _quantum{1};
+
+  // Owned file mapping (when created through open)
+  void *_map_addr{nullptr};
+  size_t _map_size{0};
+};
+
+} // namespace ddprof
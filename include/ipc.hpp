@@ -6,9 +6,11 @@
 #pragma once
 
 #include "ddprof_buffer.hpp"
+#include "ddprof_defs.hpp"
 #include "ddres.hpp"
 #include "unique_fd.hpp"
 
+#include <array>
 #include <chrono>
 #include <functional>
 #include <latch>
@@ -80,14 +82,15 @@ struct RingBufferInfo {
 };
 
 struct ReplyMessage {
-  enum { kLiveSum = 0x1 };
+  enum { kLiveSum = 0x1, kFramePointers = 0x2 };
   // reply with the request flags from the request
   uint32_t request = 0;
   // profiler pid
   int32_t pid = -1;
   int64_t allocation_profiling_rate = 0;
   // cppcheck-suppress unusedStructMember
-  RingBufferInfo ring_buffer;
+  std::array<RingBufferInfo, k_max_allocation_ring_buffers> ring_buffers;
+  uint32_t nb_ring_buffers = 0;
   uint32_t initial_loaded_libs_check_delay_ms = 0;
   uint32_t loaded_libs_check_interval_ms = 0;
   uint32_t allocation_flags = 0;
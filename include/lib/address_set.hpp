@@ -0,0 +1,82 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+#pragma once
+
+#include "live_allocation-c.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace ddprof {
+// Lock-free set of addresses (open addressing).
+// Full addresses are stored, so that distinct addresses never collide.
+// An address lives in the cache line given by its hash or, if that line is
+// full, in the next one. The last slot of a line counts the addresses that
+// overflowed to the next line: operations usually read a single cache line
+// (two at most) and use a CAS to claim or release a slot. Adding fails if
+// both lines are full (unlikely below half load).
+// An address is not expected to be added or removed concurrently by several
+// threads (the allocator hands it out once).
+class AddressSet {
+public:
+  static constexpr unsigned k_nb_slots_per_line = 8; // 64 byte cache line
+  static constexpr unsigned k_nb_addresses_per_line = k_nb_slots_per_line - 1;
+
+  // capacity is rounded up to a power of two number of cache lines
+  explicit AddressSet(size_t capacity = 0) { init(capacity); }
+  AddressSet(AddressSet &&other) noexcept;
+  AddressSet &operator=(AddressSet &&other) noexcept;
+
+  AddressSet(AddressSet &other) = delete;
+  AddressSet &operator=(AddressSet &other) = delete;
+
+  ~AddressSet() { reset(); }
+
+  // returns true if the element was inserted
+  bool add(uintptr_t addr);
+  // returns true if the element was removed
+  bool remove(uintptr_t addr);
+  void clear();
+  [[nodiscard]] int count() const { return _nb_addresses; }
+  [[nodiscard]] size_t capacity() const {
+    return _nb_lines * k_nb_addresses_per_line;
+  }
+
+  // Lines are split in nb_slices (power of two) contiguous slices.
+  // Returns the addresses that map to a slice.
+  [[nodiscard]] static liveallocation::AddressSlice slice(unsigned index,
+                                                          unsigned nb_slices);
+  // Remove the addresses of a slice (returns the number of removed addresses)
+  int clear_slice(unsigned index, unsigned nb_slices);
+
+private:
+  // Pages are mapped lazily: memory is only touched where addresses land
+  uintptr_t *_slots = nullptr;
+  size_t _nb_lines = 0;
+  unsigned _line_shift = 0;
+  std::atomic<int> _nb_addresses = 0;
+
+  void init(size_t capacity);
+  void reset();
+  void move_from(AddressSet &other) noexcept;
+
+  // The top bits of the hash select the line (slices are contiguous lines)
+  [[nodiscard]] size_t line_index(uintptr_t addr) const {
+    return static_cast<uint64_t>(liveallocation::address_hash(addr)) >>
+        _line_shift;
+  }
+  [[nodiscard]] uintptr_t *line(size_t index) const {
+    return _slots + ((index & (_nb_lines - 1)) * k_nb_slots_per_line);
+  }
+  [[nodiscard]] size_t mapped_size() const {
+    return _nb_lines * k_nb_slots_per_line * sizeof(uintptr_t);
+  }
+  // Store addr in a free slot of a line (returns false if the line is full)
+  static bool claim_slot(uintptr_t *slots, uintptr_t addr);
+  // Remove addr from a line (returns false if not there)
+  static bool remove_from_line(uintptr_t *slots, uintptr_t addr);
+};
+} // namespace ddprof
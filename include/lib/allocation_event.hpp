@@ -30,4 +30,22 @@ inline size_t sizeof_allocation_event(uint32_t stack_size) {
   // (Size of the event) + stack_size + sizeof(dyn_size field)
   return sizeof(AllocationEvent) + stack_size + sizeof(uint64_t);
 }
+
+// AllocationCallchainEvent
+// A sampled allocation for which the stack was unwound in process (frame
+// pointers): only the program counters are sent.
+// As for perf callchains, ips[0] is the sampled pc and the following ones are
+// return addresses.
+struct AllocationCallchainEvent {
+  perf_event_header hdr;
+  struct sample_id sample_id;
+  uint64_t addr;
+  uint64_t period;
+  uint64_t nr;
+  uint64_t ips[];
+};
+
+inline size_t sizeof_allocation_callchain_event(uint64_t nr) {
+  return sizeof(AllocationCallchainEvent) + (nr * sizeof(uint64_t));
+}
 } // namespace ddprof
@@ -5,24 +5,31 @@
 
 #pragma once
 
-#include "address_bitset.hpp"
+#include "address_set.hpp"
 #include "allocation_tracker_tls.hpp"
 #include "ddprof_base.hpp"
+#include "ddprof_buffer.hpp"
+#include "ddprof_defs.hpp"
 #include "ddres_def.hpp"
+#include "live_allocation-c.hpp"
 #include "pevent.hpp"
 #include "reentry_guard.hpp"
+#include "spinlock.hpp"
 #include "unlikely.hpp"
 
+#include <array>
 #include <atomic>
 #include <cstddef>
 #include <functional>
 #include <mutex>
 #include <pthread.h>
+#include <span>
 #include <unordered_set>
 
 namespace ddprof {
 
 class MPSCRingBufferWriter;
+struct DeallocationBatchEvent;
 struct RingBufferInfo;
 
 class AllocationTracker {
@@ -35,7 +42,11 @@ public:
 
   enum AllocationTrackingFlags {
     kTrackDeallocations = 0x1,
-    kDeterministicSampling = 0x2
+    kDeterministicSampling = 0x2,
+    kBatchRecords = 0x4, // stage records in thread local batches
+                         // (allocations are not staged when deallocations
+                         // are tracked)
+    kFramePointers = 0x8 // send the pcs of the frame pointer chain
   };
 
   struct IntervalTimerCheck {
@@ -53,6 +64,12 @@ public:
   static void notify_thread_start();
   static void notify_fork();
 
+  // Each thread pushes its events to one of the ring buffers
+  static DDRes
+  allocation_tracking_init(uint64_t allocation_profiling_rate, uint32_t flags,
+                           uint32_t stack_sample_size,
+                           std::span<const RingBufferInfo> ring_buffers,
+                           const IntervalTimerCheck &timer_check);
   static DDRes allocation_tracking_init(uint64_t allocation_profiling_rate,
                                         uint32_t flags,
                                         uint32_t stack_sample_size,
@@ -73,10 +90,23 @@ public:
 
   static TrackerThreadLocalState *init_tl_state();
   // can return null (does not init)
+#ifdef DDPROF_INITIAL_EXEC_TLS
+  static TrackerThreadLocalState *get_tl_state() { return _tl_state_cache; }
+#else
   static TrackerThreadLocalState *get_tl_state();
+#endif
 
 private:
-  static constexpr unsigned k_ratio_max_elt_to_bitset_size = 16;
+  // Tracked addresses are evicted by slices of the address set
+  static constexpr unsigned k_nb_eviction_slices = 16;
+  // Larger allocation records are never batched (the stack copy dominates)
+  static constexpr size_t k_max_batched_record_size =
+      TrackerThreadLocalState::k_batch_capacity / 4;
+  // Staged records are pushed at the latest after this delay (checked when
+  // any thread records an event)
+  static constexpr std::chrono::milliseconds k_batch_max_delay{10};
+  // Frame pointer walks are bounded (pcs are gathered on the stack)
+  static constexpr size_t k_max_callchain_depth = 256;
 
   // NOLINTBEGIN(misc-non-private-member-variables-in-classes)
   struct TrackerState {
@@ -85,6 +115,8 @@ private:
       track_deallocations = track_dealloc;
       lost_count = 0;
       failure_count = 0;
+      next_eviction_slice = 0;
+      ++generation;
       pid = getpid();
     }
     std::mutex mutex;
@@ -92,25 +124,39 @@ private:
     std::atomic<bool> track_deallocations = false;
     std::atomic<uint64_t> lost_count; // count number of lost events
     std::atomic<uint32_t> failure_count;
+    std::atomic<uint32_t> next_eviction_slice;
+    // incremented on each start, records staged before are dropped
+    std::atomic<uint32_t> generation;
     std::atomic<pid_t> pid; // lazy cache of pid (0 is un-init value)
     std::atomic<PerfClock::time_point> next_check_time;
+    std::atomic<PerfClock::time_point> next_batch_check;
   };
   // NOLINTEND(misc-non-private-member-variables-in-classes)
 
   AllocationTracker();
 
-  uint64_t next_sample_interval(std::minstd_rand &gen) const;
+  uint64_t next_sample_interval(xoshiro256ss &gen) const;
 
   DDRes init(uint64_t mem_profile_interval, bool deterministic_sampling,
-             bool track_deallocations, uint32_t stack_sample_size,
-             const RingBufferInfo &ring_buffer,
+             bool track_deallocations, bool batch_records,
+             bool frame_pointers, uint32_t stack_sample_size,
+             std::span<const RingBufferInfo> ring_buffers,
              const IntervalTimerCheck &timer_check);
   void free();
 
+  // Ring buffer of the thread: sharding by thread keeps the events of a
+  // thread ordered
+  PEvent &pevent_for(const TrackerThreadLocalState &tl_state) {
+    return _pevents[static_cast<uint32_t>(tl_state.tid) % _nb_pevents];
+  }
+
   static AllocationTracker *create_instance();
 
   static void delete_tl_state(void *tl_state);
 
+  static void register_tl_state(TrackerThreadLocalState *tl_state);
+  static void unregister_tl_state(TrackerThreadLocalState *tl_state);
+
   static void make_key();
 
   void track_allocation(uintptr_t addr, size_t size,
@@ -120,6 +166,10 @@ private:
   DDRes push_alloc_sample(uintptr_t addr, uint64_t allocated_size,
                           TrackerThreadLocalState &tl_state);
 
+  // Push the pcs of the stack instead of a copy of the stack
+  DDRes push_alloc_callchain(uintptr_t addr, uint64_t allocated_size,
+                             TrackerThreadLocalState &tl_state);
+
   // If notify_needed is true, consumer should be notified
   DDRes push_lost_sample(MPSCRingBufferWriter &writer,
                          TrackerThreadLocalState &tl_state,
@@ -127,7 +177,28 @@ private:
 
   DDRes push_dealloc_sample(uintptr_t addr, TrackerThreadLocalState &tl_state);
 
-  DDRes push_clear_live_allocation(TrackerThreadLocalState &tl_state);
+  DDRes push_evict_live_allocation(liveallocation::AddressSlice slice,
+                                   TrackerThreadLocalState &tl_state);
+  DDRes push_evict_live_allocation(liveallocation::AddressSlice slice,
+                                   PEvent &pevent,
+                                   TrackerThreadLocalState &tl_state);
+
+  // Reserve size bytes for a record in the thread local batch
+  DDRes stage_record(size_t size, PerfClock::time_point now,
+                     TrackerThreadLocalState &tl_state, Buffer *record);
+  // Last staged record if it holds deallocations (nullptr otherwise)
+  DeallocationBatchEvent *
+  last_staged_deallocations(TrackerThreadLocalState &tl_state);
+  // Push the batch if it is full or old enough
+  DDRes maybe_flush_batch(PerfClock::time_point now,
+                          TrackerThreadLocalState &tl_state);
+  // Push all the staged records as a single ring buffer record (the caller
+  // holds the batch lock)
+  DDRes flush_batch(TrackerThreadLocalState &tl_state);
+  // Push the batches of all the threads staged before max_first_time. Without
+  // wait, batches in use are skipped.
+  void flush_batches(PerfClock::time_point max_first_time, bool wait);
+  DDPROF_NOINLINE void flush_stale_batches(PerfClock::time_point now);
 
   void check_timer(PerfClock::time_point now,
                    TrackerThreadLocalState &tl_state);
@@ -139,16 +210,29 @@ private:
   TrackerState _state;
   uint64_t _sampling_interval;
   uint32_t _stack_sample_size;
-  PEvent _pevent;
+  std::array<PEvent, k_max_allocation_ring_buffers> _pevents;
+  uint32_t _nb_pevents{0};
   bool _deterministic_sampling;
+  bool _batch_records{false};
+  bool _frame_pointers{false};
 
-  AddressBitset _allocated_address_set;
+  AddressSet _allocated_address_set;
   IntervalTimerCheck _interval_timer_check;
 
   // These can not be tied to the internal state of the instance.
   // The creation of the instance depends on this
   static pthread_once_t _key_once; // ensures we call key creation a single time
   static pthread_key_t _tl_state_key;
+  // States of the threads, to push the batches of idle threads
+  static SpinLock _tl_states_lock;
+  static TrackerThreadLocalState *_tl_states;
+#ifdef DDPROF_INITIAL_EXEC_TLS
+  // Only when the library is linked in the executable: static TLS is read
+  // from the thread pointer, without call nor allocation. The pthread key
+  // still owns the state (and deletes it on thread exit).
+  static constinit thread_local TrackerThreadLocalState *_tl_state_cache
+      __attribute__((tls_model("initial-exec")));
+#endif
 
   static AllocationTracker *_instance;
 };
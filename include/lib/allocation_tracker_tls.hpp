@@ -1,5 +1,10 @@
 #pragma once
 
+#include "prng.hpp"
+#include "spinlock.hpp"
+
+#include <array>
+#include <cstddef>
 #include <cstdint>
 #include <random>
 #include <span>
@@ -8,6 +13,9 @@
 namespace ddprof {
 
 struct TrackerThreadLocalState {
+  // Size of the buffer of records staged before a push to the ring buffer
+  static constexpr size_t k_batch_capacity = 8192;
+
   int64_t remaining_bytes{0}; // remaining allocation bytes until next sample
   bool remaining_bytes_initialized{false}; // false if remaining_bytes is not
                                            // initialized
@@ -25,9 +33,25 @@ struct TrackerThreadLocalState {
                                  // should not allocate because we might already
                                  // be inside an allocation)
 
-  // In the choice of random generators, this one is smaller
-  // - smaller than mt19937 (8 vs 5K)
-  std::minstd_rand gen{std::random_device{}()};
+  // Cheaper than minstd_rand (no division) and smaller than mt19937 (32 vs
+  // 5K bytes)
+  xoshiro256ss gen{std::random_device{}()};
+
+  // Registered states (see AllocationTracker::flush_batches)
+  TrackerThreadLocalState *prev{nullptr};
+  TrackerThreadLocalState *next{nullptr};
+
+  // Records staged by this thread (see AllocationTracker::flush_batch).
+  // Another thread can push them: the batch is only accessed under the lock.
+  SpinLock batch_lock;
+  uint32_t batch_size{0};       // bytes used in batch
+  uint32_t batch_nb_records{0}; // number of staged records
+  uint32_t batch_nb_events{0};  // number of staged events (a record can hold
+                                // several deallocations)
+  uint32_t batch_generation{0}; // tracker generation of the staged records
+  uint32_t batch_last_offset{0}; // offset of the last staged record
+  int64_t batch_first_time{0};  // time of the first staged record
+  alignas(uint64_t) std::array<std::byte, k_batch_capacity> batch;
 };
 
 } // namespace ddprof
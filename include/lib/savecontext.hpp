@@ -25,4 +25,11 @@ save_context(std::span<const std::byte> stack_bounds,
              std::span<uint64_t, k_perf_register_count> regs,
              std::span<std::byte> buffer);
 
+/** Walk the frame pointer chain (within stack bounds) for local unwinding.
+ * As for perf callchains, the first pc is the current one (in this function)
+ * and the following ones are return addresses.
+ * Return the number of saved pcs */
+DDPROF_NOIPO size_t save_callchain(std::span<const std::byte> stack_bounds,
+                                   std::span<uint64_t> pcs);
+
 } // namespace ddprof
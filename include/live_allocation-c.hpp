@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include <cstdint>
+
 namespace ddprof::liveallocation {
 #ifdef KMAX_TRACKED_ALLOCATIONS
 // build time override to reduce execution time of test
@@ -12,4 +14,26 @@ static constexpr auto kMaxTracked = KMAX_TRACKED_ALLOCATIONS;
 #else
 static constexpr auto kMaxTracked = 524288; // 2^19
 #endif
+
+// Hash of a tracked address, shared by the library and the profiler so that
+// both sides agree on the addresses to evict.
+// The lower bits are dropped (alignment makes them useless) and the address
+// is mixed (Fibonacci hashing), so that all bits of the hash are spread even
+// for contiguous addresses.
+inline uint32_t address_hash(uintptr_t addr) {
+  constexpr unsigned k_nb_bits_ignored = 4;
+  // NOLINTNEXTLINE(readability-magic-numbers)
+  return static_cast<uint32_t>(
+      ((addr >> k_nb_bits_ignored) * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+// Addresses whose hash matches value on the bits of mask
+struct AddressSlice {
+  uint32_t mask;
+  uint32_t value;
+
+  [[nodiscard]] bool contains(uintptr_t addr) const {
+    return (address_hash(addr) & mask) == value;
+  }
+};
 } // namespace ddprof::liveallocation
@@ -6,15 +6,23 @@
 #pragma once
 
 #include "ddprof_defs.hpp"
+#include "flat_address_map.hpp"
+#include "live_allocation-c.hpp"
+#include "stack_table.hpp"
 #include "unlikely.hpp"
-#include "unwind_output_hash.hpp"
 
+#include <array>
 #include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
 #include <sys/types.h>
 #include <unordered_map>
 
 namespace ddprof {
 
+class SymbolizedStack;
+
 template <typename T>
 T &access_resize(std::vector<T> &v, size_t index,
                  const T &default_value = T()) {
@@ -31,20 +39,48 @@ public:
   struct ValueAndCount {
     int64_t _value = 0;
     int64_t _count = 0;
+    // Locations resolved at a previous export (null until the stack is
+    // symbolized). Stacks are immutable, so this stays valid while the entry
+    // lives.
+    std::shared_ptr<const SymbolizedStack> _symbolized;
   };
 
-  using PprofStacks =
-      std::unordered_map<UnwindOutput, ValueAndCount, UnwindOutputHash>;
+  // Each entry owns a reference on its stack
+  using PprofStacks = std::unordered_map<StackKey, ValueAndCount, StackKeyHash>;
 
   struct ValuePerAddress {
     int64_t _value = 0;
     PprofStacks::value_type *_unique_stack = nullptr;
+    // Time of the allocation (0 if lifetime is not tracked)
+    uint64_t _timestamp = 0;
+  };
+
+  // Lifetimes are bucketed on a log scale (one bucket per decade, starting at
+  // one microsecond)
+  static constexpr unsigned k_nb_lifetime_buckets = 9;
+
+  // Freed value and count per lifetime bucket, for a given stack
+  struct LifetimeHistogram {
+    std::array<int64_t, k_nb_lifetime_buckets> _value = {};
+    std::array<int64_t, k_nb_lifetime_buckets> _count = {};
+    std::shared_ptr<const SymbolizedStack> _symbolized;
   };
 
-  using AddressMap = std::unordered_map<uintptr_t, ValuePerAddress>;
+  // Each entry owns a reference on its stack. Stacks are kept until the
+  // histograms are exported, even when no allocation is live anymore.
+  using LifetimeStacks =
+      std::unordered_map<StackKey, LifetimeHistogram, StackKeyHash>;
+
+  using AddressMap = FlatAddressMap<ValuePerAddress>;
+  // Time of deallocations that matched no allocation
+  using DeallocationMap = FlatAddressMap<uint64_t>;
   struct PidStacks {
     AddressMap _address_map;
     PprofStacks _unique_stacks;
+    LifetimeStacks _lifetime_stacks;
+    // Events of different threads can come from different ring buffers: a
+    // deallocation can be processed before its allocation
+    DeallocationMap _unmatched_deallocations;
   };
 
   using PidMap = std::unordered_map<pid_t, PidStacks>;
@@ -52,55 +88,108 @@ public:
   // NOLINTNEXTLINE(misc-non-private-member-variables-in-classes)
   WatcherVector _watcher_vector;
 
+  explicit LiveAllocation(StackTable &stack_table)
+      : _stack_table(stack_table) {}
+
   // Allocation should be aggregated per stack trace
   // instead of a stack, we would have a total size for this unique stack trace
   // and a count.
-  void register_allocation(const UnwindOutput &uo, uintptr_t addr, size_t size,
-                           int watcher_pos, pid_t pid) {
+  // The timestamp orders the allocation against deallocations processed
+  // first. The lifetime of the allocation is measured if requested.
+  void register_allocation(const StackKey &key, uintptr_t addr, size_t size,
+                           int watcher_pos, pid_t pid, uint64_t timestamp = 0,
+                           bool measure_lifetime = false) {
     PidMap &pid_map = access_resize(_watcher_vector, watcher_pos);
-    PidStacks &pid_stacks = pid_map[pid];
-    register_allocation(uo, addr, size, pid_stacks._unique_stacks,
-                        pid_stacks._address_map);
+    register_allocation(key, addr, size, timestamp, measure_lifetime,
+                        pid_map[pid]);
+  }
+
+  void register_allocation(const UnwindOutput &uo, uintptr_t addr, size_t size,
+                           int watcher_pos, pid_t pid, uint64_t timestamp = 0,
+                           bool measure_lifetime = false) {
+    const StackKey key{_stack_table.intern(uo), uo.pid, uo.tid};
+    register_allocation(key, addr, size, watcher_pos, pid, timestamp,
+                        measure_lifetime);
+    _stack_table.release(key.stack_id);
   }
 
-  void register_deallocation(uintptr_t addr, int watcher_pos, pid_t pid) {
+  void register_deallocation(uintptr_t addr, int watcher_pos, pid_t pid,
+                             uint64_t timestamp = 0) {
     PidMap &pid_map = access_resize(_watcher_vector, watcher_pos);
     PidStacks &pid_stacks = pid_map[pid];
-    if (!register_deallocation(addr, pid_stacks._unique_stacks,
-                               pid_stacks._address_map)) {
+    if (!register_deallocation(addr, timestamp, pid_stacks)) {
       ++_stats._unmatched_deallocations;
     }
   }
 
+  // Drop the lifetime histograms (once they are exported)
+  void clear_lifetimes();
+
+  // Forget the deallocations that matched no allocation
+  void clear_unmatched_deallocations();
+
+  // Stop tracking the addresses of a slice (evicted by the library)
+  void evict_addresses(int watcher_pos, pid_t pid,
+                       liveallocation::AddressSlice slice) {
+    PidMap &pid_map = access_resize(_watcher_vector, watcher_pos);
+    PidStacks &pid_stacks = pid_map[pid];
+    _stats._evicted_addresses += evict_addresses(slice, pid_stacks);
+  }
+
   void clear_pid_for_watcher(int watcher_pos, pid_t pid) {
     PidMap &pid_map = access_resize(_watcher_vector, watcher_pos);
-    pid_map.erase(pid);
+    erase_pid(pid_map, pid);
   }
 
   void clear_pid(pid_t pid) {
     for (auto &pid_map : _watcher_vector) {
-      pid_map.erase(pid);
+      erase_pid(pid_map, pid);
     }
   }
 
+  [[nodiscard]] const StackTable &stack_table() const { return _stack_table; }
+
   [[nodiscard]] [[nodiscard]] unsigned get_nb_unmatched_deallocations() const {
     return _stats._unmatched_deallocations;
   }
 
+  [[nodiscard]] unsigned get_nb_evicted_addresses() const {
+    return _stats._evicted_addresses;
+  }
+
   void cycle() { _stats = {}; }
 
+  static unsigned lifetime_bucket(uint64_t lifetime_ns);
+  // Label of a bucket (upper bound of the lifetimes it holds)
+  static std::string_view lifetime_bucket_name(unsigned bucket);
+
 private:
   // returns true if the deallocation was registered
-  static bool register_deallocation(uintptr_t address, PprofStacks &stacks,
-                                    AddressMap &address_map);
+  bool register_deallocation(uintptr_t address, uint64_t timestamp,
+                             PidStacks &pid_stacks);
 
   // returns true if the allocation was registerd
-  static bool register_allocation(const UnwindOutput &uo, uintptr_t address,
-                                  int64_t value, PprofStacks &stacks,
-                                  AddressMap &address_map);
+  bool register_allocation(const StackKey &key, uintptr_t address,
+                           int64_t value, uint64_t timestamp,
+                           bool measure_lifetime, PidStacks &pid_stacks);
+
+  unsigned evict_addresses(liveallocation::AddressSlice slice,
+                           PidStacks &pid_stacks);
+
+  // Remove the value of an address from its stack
+  void unregister_value(const ValuePerAddress &v, PprofStacks &stacks);
+
+  void register_lifetime(const StackKey &key, int64_t value,
+                         uint64_t lifetime_ns, LifetimeStacks &stacks);
+
+  void erase_stack(PprofStacks &stacks, StackKey key);
+  void erase_pid(PidMap &pid_map, pid_t pid);
+
+  StackTable &_stack_table;
   struct {
     unsigned _unmatched_deallocations = {};
+    unsigned _evicted_addresses = {};
   } _stats;
 };
 
-} // namespace ddprof
\ No newline at end of file
+} // namespace ddprof
@@ -0,0 +1,72 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "stack_table.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <unordered_map>
+
+namespace ddprof {
+
+// Stacks of threads waiting for the end of an interval (eg. a thread that was
+// switched out, until it runs again). The value of the stack is the duration
+// of the interval, only known once it ends. A thread has at most one pending
+// interval per watcher.
+// Events of a thread can come from different ring buffers (one per CPU): the
+// end of an interval can be processed before its start.
+class PendingStacks {
+public:
+  struct Interval {
+    StackKey key{k_stack_id_null, 0, 0};
+    uint64_t start_time{0};
+    int watcher_pos{-1};
+    uint64_t value{0}; // carried to the end of the interval (eg. syscall id)
+  };
+
+  explicit PendingStacks(StackTable &stack_table) : _stack_table(stack_table) {}
+  PendingStacks(const PendingStacks &) = delete;
+  PendingStacks &operator=(const PendingStacks &) = delete;
+
+  // Start an interval for tid (and the watcher of the interval), the
+  // reference on the stack is transferred.
+  // Returns true if the end of the interval was already processed: end_time
+  // is set and the interval is not kept (the caller owns the reference).
+  bool start(pid_t tid, const Interval &interval, uint64_t &end_time);
+
+  // End the interval of tid for a watcher. Returns true if an interval was
+  // pending (the caller owns the reference on its stack).
+  bool finish(pid_t tid, int watcher_pos, uint64_t end_time,
+              Interval &interval);
+
+  // Forget the intervals of a thread that exited
+  void erase(pid_t tid);
+  // Release all pending stacks (not done on destruction: the stack table is
+  // expected to go away with the pending stacks)
+  void clear();
+
+  [[nodiscard]] size_t size() const { return _threads.size(); }
+
+private:
+  struct ThreadState {
+    Interval interval;
+    // end of the last interval that matched no start
+    uint64_t unmatched_end_time{0};
+  };
+
+  static uint64_t state_key(pid_t tid, int watcher_pos) {
+    return (static_cast<uint64_t>(watcher_pos) << 32) |
+        static_cast<uint32_t>(tid);
+  }
+
+  StackTable &_stack_table;
+  // by thread and watcher
+  std::unordered_map<uint64_t, ThreadState> _threads;
+};
+
+} // namespace ddprof
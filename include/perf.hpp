@@ -24,14 +24,29 @@ inline constexpr int k_default_buffer_size_shift{6};
 // this does not count as pinned memory, use a larger size
 inline constexpr int k_mpsc_buffer_size_shift{8};
 
+// MPSC ring buffers can be backed by huge pages of this size
+inline constexpr size_t k_huge_page_size{2UL * 1024 * 1024};
+
+// perf ring buffers that lose events are grown up to this size, as long as
+// all of them fit within k_ring_buffers_budget_factor times their minimum size
+inline constexpr int k_max_buffer_size_shift{10};
+inline constexpr int k_ring_buffers_budget_factor{4};
+
 // sample frequency check
 inline constexpr std::chrono::milliseconds k_sample_default_wakeup{100};
 
+// Counters are only read in groups (the leader first)
+inline constexpr uint64_t k_perf_read_format =
+    PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+
+struct read_value {
+  uint64_t value; // The value of the event
+  uint64_t id;    // if PERF_FORMAT_ID
+};
+
 struct read_format {
-  uint64_t value;        // The value of the event
-  uint64_t time_enabled; // if PERF_FORMAT_TOTAL_TIME_ENABLED
-  uint64_t time_running; // if PERF_FORMAT_TOTAL_TIME_RUNNING
-  //  uint64_t id;            // if PERF_FORMAT_ID
+  uint64_t nr; // if PERF_FORMAT_GROUP
+  struct read_value values[];
 };
 
 struct sample_id {
@@ -100,6 +115,17 @@ struct perf_event_lost {
   struct sample_id sample_id;
 };
 
+struct perf_event_switch {
+  struct perf_event_header header;
+  struct sample_id sample_id; // thread switched in or out
+};
+
+struct perf_event_switch_cpu_wide {
+  struct perf_event_header header;
+  uint32_t next_prev_pid, next_prev_tid;
+  struct sample_id sample_id; // thread switched in or out
+};
+
 // clang-format off
 struct perf_event_sample {
   struct      perf_event_header header;
@@ -141,10 +167,13 @@ struct perf_samplestacku {
 int perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu, int gfd,
                     unsigned long flags);
 size_t perf_mmap_size(int buf_size_shift);
-void *perfown_sz(int fd, size_t size_of_buffer);
-int perfdisown(void *region, size_t size);
 long get_page_size();
-size_t get_mask_from_size(size_t size);
+// meta_size is the size of the metadata preceding the data of the ring
+// buffer: one page, or a huge page when fd is backed by huge pages
+void *perfown_sz(int fd, size_t size_of_buffer,
+                 size_t meta_size = get_page_size());
+int perfdisown(void *region, size_t size, size_t meta_size = get_page_size());
+size_t get_mask_from_size(size_t size, size_t meta_size = get_page_size());
 const char *perf_type_str(int type_id);
 
 std::vector<perf_event_attr>
@@ -158,4 +187,8 @@ perf_event_attr perf_config_from_watcher(const PerfWatcher *watcher,
                                          bool extras,
                                          PerfClockSource perf_clock_source);
 
+// Counting event read with the samples of leader (PERF_FORMAT_GROUP)
+perf_event_attr perf_config_group_member(const perf_event_attr &leader,
+                                         uint64_t config);
+
 } // namespace ddprof
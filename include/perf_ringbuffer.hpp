@@ -11,8 +11,6 @@ namespace ddprof {
 
 enum class RingBufferType : uint8_t { kPerfRingBuffer, kMPSCRingBuffer };
 
-class SpinLock;
-
 struct RingBuffer {
   RingBufferType type;
   uint64_t mask;
@@ -28,7 +26,6 @@ struct RingBuffer {
                                     // to the writer
 
   // only used for MPSCRingBuffer
-  SpinLock *spinlock;
   uint64_t time_zero;
   uint32_t time_mult;
   uint16_t time_shift;
@@ -36,7 +33,8 @@ struct RingBuffer {
   bool tsc_available;
 };
 
-bool rb_init(RingBuffer *rb, void *base, size_t size, RingBufferType type);
+bool rb_init(RingBuffer *rb, void *base, size_t size, RingBufferType type,
+             size_t meta_size = get_page_size());
 void rb_free(RingBuffer *rb);
 
 bool samp2hdr(perf_event_header *hdr, const perf_event_sample *sample,
@@ -7,6 +7,8 @@
 
 #include "ddprof_defs.hpp"
 #include "event_config.hpp"
+
+#include <array>
 #include <string>
 
 #include <linux/perf_event.h>
@@ -28,8 +30,21 @@ struct PerfWatcherOptions {
                              // frames belonging to libdd_profiling.so)
   uint32_t stack_sample_size{
       k_default_perf_stack_sample_size}; // size of the user stack to capture
+  bool frame_pointers{false}; // stack is walked in the profiled process
+                              // (allocations) or by the kernel
+  uint16_t max_stack{k_default_callchain_max_stack}; // kernel callchain depth
+  bool hybrid_unwind{false}; // leaf frames unwound from a small stack copy,
+                             // the others from the kernel callchain
+  bool off_cpu{false}; // value is the time until the thread runs again
+                       // (measured with context switch records)
+  bool counter_group{false}; // samples read k_counter_group_members
+  bool syscall_time{false};  // value is the time until the syscall returns
+  bool huge_pages{false}; // ring buffers backed by huge pages (custom events)
 };
 
+// Number of counters read with the samples of counter group watchers
+inline constexpr int k_nb_counter_group_members = 2;
+
 struct PProfIndices {
   int pprof_index = -1;
   int pprof_count_index = -1;
@@ -45,6 +60,7 @@ struct PerfWatcher {
   std::string tracepoint_event;
   std::string tracepoint_group;
   std::string tracepoint_label;
+  std::string tracepoint_filter; // in-kernel filter expression (optional)
 
   int ddprof_event_type; // ddprof event type from DDPROF_EVENT_NAMES enum
 
@@ -63,7 +79,9 @@ struct PerfWatcher {
   // perf_event_open configs
   struct PerfWatcherOptions options;
 
-  PProfIndices pprof_indices[kNbEventAggregationModes]; // std and live
+  PProfIndices pprof_indices[kNbEventAggregationModes]; // std, live, lifetime
+  // pprof values of the counters of the group (if options.counter_group)
+  int counter_pprof_indices[k_nb_counter_group_members];
 
   uint8_t regno;
   uint8_t raw_off;
@@ -78,20 +96,27 @@ struct PerfWatcher {
 
 // The Datadog backend only understands pre-configured event types.  Those
 // types are defined here, and then referenced in the watcher
-// The last column is a dependent type which is always aggregated as a count
-// whenever the main type is aggregated.
-//  type,    pprof,     unit, live-pprof,  sample_type,
-//     a,        b,        c,          d,            e,
+// The dependent type column is always aggregated as a count whenever the main
+// type is aggregated.
+//  type,    pprof,     unit, live-pprof,  sample_type, lifetime-pprof
+//     a,        b,        c,          d,            e,              f
 #define PROFILE_TYPE_TABLE(X)                                                  \
-  X(NOCOUNT, "nocount", nocount, "undef", NOCOUNT)                             \
-  X(TRACEPOINT, "tracepoint", events, "undef", NOCOUNT)                        \
-  X(CPU_NANOS, "cpu-time", nanoseconds, "undef", CPU_SAMPLE)                   \
-  X(CPU_SAMPLE, "cpu-samples", count, "undef", NOCOUNT)                        \
-  X(ALLOC_SAMPLE, "alloc-samples", count, "inuse-objects", NOCOUNT)            \
-  X(ALLOC_SPACE, "alloc-space", bytes, "inuse-space", ALLOC_SAMPLE)
+  X(NOCOUNT, "nocount", nocount, "undef", NOCOUNT, "undef")                    \
+  X(TRACEPOINT, "tracepoint", events, "undef", NOCOUNT, "undef")               \
+  X(CPU_NANOS, "cpu-time", nanoseconds, "undef", CPU_SAMPLE, "undef")          \
+  X(CPU_SAMPLE, "cpu-samples", count, "undef", NOCOUNT, "undef")               \
+  X(ALLOC_SAMPLE, "alloc-samples", count, "inuse-objects", NOCOUNT,            \
+    "freed-objects")                                                           \
+  X(ALLOC_SPACE, "alloc-space", bytes, "inuse-space", ALLOC_SAMPLE,            \
+    "freed-space")                                                             \
+  X(OFFCPU, "off-cpu-time", nanoseconds, "undef", NOCOUNT, "undef")            \
+  X(CPU_CYCLES, "cpu-cycles", count, "undef", NOCOUNT, "undef")                \
+  X(INSTRUCTIONS, "instructions", count, "undef", NOCOUNT, "undef")            \
+  X(CACHE_MISSES, "cache-misses", count, "undef", NOCOUNT, "undef")            \
+  X(SYSCALL, "syscall-time", nanoseconds, "undef", NOCOUNT, "undef")
 
 // defines enum of profile types
-#define X_ENUM(a, b, c, d, e) DDPROF_PWT_##a,
+#define X_ENUM(a, b, c, d, e, f) DDPROF_PWT_##a,
 enum DDPROF_SAMPLE_TYPES {
   PROFILE_TYPE_TABLE(X_ENUM) DDPROF_PWT_LENGTH,
 };
@@ -116,6 +141,18 @@ enum DDProfCustomCountId {
 #define USE_KERNEL                                                             \
   { .use_kernel = PerfWatcherUseKernel::kRequired }
 
+// Samples read the instructions and cache misses since the previous sample
+#define COUNTER_GROUP                                                          \
+  { .is_freq = true, .counter_group = true }
+
+// Stacks are sampled when threads are switched out (sched_switch tracepoint)
+#define OFF_CPU                                                                \
+  { .use_kernel = PerfWatcherUseKernel::kRequired, .off_cpu = true }
+
+// Stacks are sampled when syscalls are entered (raw_syscalls tracepoints)
+#define SYSCALL_TIME                                                           \
+  { .use_kernel = PerfWatcherUseKernel::kRequired, .syscall_time = true }
+
 #ifdef DDPROF_OPTIM
 #  define NB_FRAMES_TO_SKIP 4
 #else
@@ -144,6 +181,7 @@ enum DDProfCustomCountId {
   X(hBUS,       "Bus Cycles",         PERF_TYPE_HARDWARE,   PERF_COUNT_HW_BUS_CYCLES,              1000,         DDPROF_PWT_TRACEPOINT,  IS_FREQ)                 \
   X(hBSTF,      "Bus Stalls(F)",      PERF_TYPE_HARDWARE,   PERF_COUNT_HW_STALLED_CYCLES_FRONTEND, 1000,         DDPROF_PWT_TRACEPOINT,  IS_FREQ)                 \
   X(hBSTB,      "Bus Stalls(B)",      PERF_TYPE_HARDWARE,   PERF_COUNT_HW_STALLED_CYCLES_BACKEND,  1000,         DDPROF_PWT_TRACEPOINT,  IS_FREQ)                 \
+  X(hIPC,       "CPU Counters",       PERF_TYPE_HARDWARE,   PERF_COUNT_HW_CPU_CYCLES,              99,           DDPROF_PWT_CPU_CYCLES,  COUNTER_GROUP)           \
   X(sCPU,       "CPU Time",           PERF_TYPE_SOFTWARE,   PERF_COUNT_SW_TASK_CLOCK,              99,           DDPROF_PWT_CPU_NANOS,   IS_FREQ_TRY_KERNEL)      \
   X(sPF,        "Page Faults",        PERF_TYPE_SOFTWARE,   PERF_COUNT_SW_PAGE_FAULTS,             1,            DDPROF_PWT_TRACEPOINT,  USE_KERNEL)              \
   X(sCS,        "Con. Switch",        PERF_TYPE_SOFTWARE,   PERF_COUNT_SW_CONTEXT_SWITCHES,        1,            DDPROF_PWT_TRACEPOINT,  USE_KERNEL)              \
@@ -153,6 +191,8 @@ enum DDProfCustomCountId {
   X(sALGN,      "Align. Faults",      PERF_TYPE_SOFTWARE,   PERF_COUNT_SW_ALIGNMENT_FAULTS,        99,           DDPROF_PWT_TRACEPOINT,  IS_FREQ)                 \
   X(sEMU,       "Emu. Faults",        PERF_TYPE_SOFTWARE,   PERF_COUNT_SW_EMULATION_FAULTS,        99,           DDPROF_PWT_TRACEPOINT,  IS_FREQ)                 \
   X(sDUM,       "Dummy",              PERF_TYPE_SOFTWARE,   PERF_COUNT_SW_DUMMY,                   1,            DDPROF_PWT_NOCOUNT,     {})                      \
+  X(sOFFCPU,    "Off-CPU Time",       PERF_TYPE_TRACEPOINT, 0,                                     1,            DDPROF_PWT_OFFCPU,      OFF_CPU)                 \
+  X(sSYSCALL,   "Syscall Time",       PERF_TYPE_TRACEPOINT, 0,                                     1,            DDPROF_PWT_SYSCALL,     SYSCALL_TIME)            \
   X(sALLOC,     "Allocations",        kDDPROF_TYPE_CUSTOM,  kDDPROF_COUNT_ALLOCATIONS,             524288,       DDPROF_PWT_ALLOC_SPACE, SKIP_FRAMES)
 
 // clang-format on
@@ -164,6 +204,19 @@ enum DDPROF_EVENT_NAMES {
 };
 #undef X_ENUM
 
+// Counters of a group, read with the samples of its leader (the watcher's
+// event) and accounted to the sampled stacks
+struct CounterGroupMember {
+  uint64_t config; // PERF_TYPE_HARDWARE event
+  int sample_type_id;
+};
+
+inline constexpr std::array<CounterGroupMember, k_nb_counter_group_members>
+    k_counter_group_members{{
+        {PERF_COUNT_HW_INSTRUCTIONS, DDPROF_PWT_INSTRUCTIONS},
+        {PERF_COUNT_HW_CACHE_MISSES, DDPROF_PWT_CACHE_MISSES},
+    }};
+
 // Helper functions for event-type watcher lookups
 const PerfWatcher *ewatcher_from_idx(int idx);
 const PerfWatcher *ewatcher_from_str(const char *str);
@@ -5,7 +5,18 @@
 
 #pragma once
 
+#include "pevent.hpp"
+
+#include <cstdint>
+
 namespace ddprof {
+
+// Usage of a ring buffer by a worker, used to size it for the next worker
+struct RingBufferUsage {
+  uint64_t lost;          // events the kernel dropped (ring buffer full)
+  uint64_t max_used_size; // highest number of bytes waiting to be read
+};
+
 // Workers are reset by creating new forks. This structure is shared accross
 // processes
 struct PersistentWorkerState {
@@ -15,6 +26,8 @@ struct PersistentWorkerState {
   // Why not volatile ? Although several threads can update the number of
   // cycles, by design Only a single thread reads and writes to this variable.
   uint32_t profile_seq;
+  // Written by the worker, read by the parent once the worker exited
+  RingBufferUsage ring_buffer_usage[k_max_nb_perf_event_open];
 };
 
 } // namespace ddprof
@@ -8,6 +8,7 @@
 #include "ddprof_defs.hpp"
 #include "perf_ringbuffer.hpp"
 
+#include <sched.h>
 #include <sys/types.h>
 
 namespace ddprof {
@@ -29,6 +30,7 @@ struct PEvent {
   std::vector<int>
       sub_fds; // perf FDs of other events outputting to the same ring buffer
                // (eg. perf events for other process threads in PID mode)
+  std::vector<int> group_fds; // counters read with the samples of the events
 };
 
 struct PEventHdr {
@@ -38,6 +40,7 @@ struct PEventHdr {
   size_t max_size;
   perf_event_attr attrs[kMaxTypeWatcher];
   size_t nb_attrs;
+  cpu_set_t cpus; // CPUs with open perf events
 };
 
 } // namespace ddprof
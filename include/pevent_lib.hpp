@@ -7,8 +7,10 @@
 
 #include "ddprof_context.hpp"
 #include "ddres_def.hpp"
+#include "persistent_worker_state.hpp"
 #include "pevent.hpp"
 
+#include <sched.h>
 #include <span>
 
 namespace ddprof {
@@ -20,8 +22,18 @@ void pevent_init(PEventHdr *pevent_hdr);
 DDRes pevent_open(DDProfContext *ctx, std::span<pid_t> pids, int num_cpu,
                   PEventHdr *pevent_hdr);
 
-/// Setup mmap buffers according to content of peventhdr
-DDRes pevent_mmap(PEventHdr *pevent_hdr, bool use_override);
+/// CPUs the target can run on (all configured CPUs in global mode or if
+/// the affinity is unknown)
+void pevent_target_cpus(const DDProfContext &ctx, std::span<const pid_t> pids,
+                        int num_cpu, cpu_set_t &cpus);
+
+/// Open, map and enable the perf events of the CPUs the target was allowed to
+/// run on since the events were opened
+DDRes pevent_open_new_cpus(DDProfContext &ctx, std::span<pid_t> pids,
+                           int num_cpu, PEventHdr *pevent_hdr);
+
+/// Setup mmap buffers according to content of peventhdr (from event first)
+DDRes pevent_mmap(PEventHdr *pevent_hdr, bool use_override, size_t first = 0);
 
 /// Compute minimum size for a given ring buffer
 /// This is adjusted using the number of samples we can fit in a buffer
@@ -29,6 +41,20 @@ int pevent_compute_min_mmap_order(int min_buffer_size_order,
                                   uint32_t stack_sample_size,
                                   unsigned min_number_samples);
 
+/// New size orders of ring buffers from their usage by the previous worker:
+/// buffers that lost events grow (the ones that lost the most first), buffers
+/// that stayed mostly empty shrink back towards their minimum order. Growth
+/// stops once the total size would exceed budget.
+void pevent_adapt_mmap_orders(std::span<const RingBufferUsage> usages,
+                              std::span<const int> min_orders,
+                              std::span<int> orders, size_t budget);
+
+/// Resize the perf ring buffers (mapped by the caller) from their usage by
+/// the previous worker. Usage counters are reset.
+DDRes pevent_adapt_ring_buffers(const DDProfContext &ctx,
+                                PEventHdr *pevent_hdr,
+                                std::span<RingBufferUsage> usages);
+
 /// Setup watchers = setup mmap + setup perfevent
 DDRes pevent_setup(DDProfContext &ctx, std::span<pid_t> pids, int num_cpu,
                    PEventHdr *pevent_hdr);
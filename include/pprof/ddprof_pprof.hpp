@@ -10,17 +10,56 @@
 #include "ddprof_defs.hpp"
 #include "ddprof_file_info.hpp"
 #include "ddres_def.hpp"
+#include "hash_helper.hpp"
 #include "perf_watcher.hpp"
+#include "stack_table.hpp"
 #include "tags.hpp"
 #include "unwind_output.hpp"
 
+#include <array>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 namespace ddprof {
 
 class Symbolizer;
 struct SymbolHdr;
 
+// Samples summed on the worker side before being handed to libdatadog.
+// Identical stacks (same watcher, value type, locations and labels) only cost
+// hash lookups. Symbolization and the FFI call happen once per unique stack
+// when the table is flushed. Entries own a reference on their stack.
+struct PreAggregatedStacks {
+  struct ValueAndCount {
+    int64_t _value = 0;
+    uint64_t _count = 0;
+    std::array<int64_t, k_nb_counter_group_members> _counter_values{};
+  };
+  using StackMap = std::unordered_map<StackKey, ValueAndCount, StackKeyHash>;
+
+  struct Key {
+    const PerfWatcher *_watcher;
+    EventAggregationModePos _value_pos;
+    // label of syscall time samples (static storage)
+    std::string_view _syscall;
+    bool operator==(const Key &) const = default;
+  };
+  struct KeyHash {
+    size_t operator()(const Key &key) const {
+      size_t seed = std::hash<const PerfWatcher *>{}(key._watcher);
+      hash_combine(seed, key._value_pos);
+      hash_combine(seed, key._syscall);
+      return seed;
+    }
+  };
+  // stacks of a process, by watcher, value type and label
+  using Map = std::unordered_map<Key, StackMap, KeyHash>;
+};
+
 struct DDProfPProf {
   /* single profile gathering several value types */
   ddog_prof_Profile _profile{};
@@ -29,12 +68,35 @@ struct DDProfPProf {
   bool use_process_adresses{true};
   // avoid re-creating strings for all pid numbers
   std::unordered_map<pid_t, std::string> _pid_str;
+  // pre-aggregated stacks by pid (a pid is flushed before it is freed)
+  std::unordered_map<pid_t, PreAggregatedStacks::Map> _pre_aggregated;
+  // table holding a reference on each pre-aggregated stack
+  StackTable *_stack_table = nullptr;
+};
+
+// Locations of a stack symbolized once and reused across exports.
+// Strings are owned: locations remain valid after the symbolization session.
+class SymbolizedStack {
+public:
+  explicit SymbolizedStack(std::span<const ddog_prof_Location> locations);
+  SymbolizedStack(const SymbolizedStack &) = delete;
+  SymbolizedStack &operator=(const SymbolizedStack &) = delete;
+
+  [[nodiscard]] std::span<const ddog_prof_Location> locations() const {
+    return _locations;
+  }
+
+private:
+  std::vector<ddog_prof_Location> _locations;
+  std::string _strings;
 };
 
 struct DDProfValuePack {
   int64_t value;
   uint64_t count;
   uint64_t timestamp;
+  // counters of the group (watchers with options.counter_group)
+  std::span<const int64_t> counter_values{};
 };
 
 DDRes pprof_create_profile(DDProfPProf *pprof, DDProfContext &ctx);
@@ -53,6 +115,70 @@ DDRes pprof_aggregate(const UnwindOutput *uw_output,
                       EventAggregationModePos value_pos, Symbolizer *symbolizer,
                       DDProfPProf *pprof);
 
+// Same as above for an interned stack
+DDRes pprof_aggregate(const StackKey &key, const StackTable &stack_table,
+                      const SymbolHdr &symbol_hdr, const DDProfValuePack &pack,
+                      const PerfWatcher *watcher,
+                      const FileInfoVector &file_infos, bool show_samples,
+                      EventAggregationModePos value_pos, Symbolizer *symbolizer,
+                      DDProfPProf *pprof);
+
+/**
+ * Aggregate an interned stack, reusing the symbolized locations of cache.
+ * A null cache means the stack was never resolved: it is symbolized and the
+ * cache is filled.
+ */
+DDRes pprof_aggregate_cached(
+    const StackKey &key, const StackTable &stack_table,
+    const SymbolHdr &symbol_hdr, const DDProfValuePack &pack,
+    const PerfWatcher *watcher, const FileInfoVector &file_infos,
+    bool show_samples, EventAggregationModePos value_pos,
+    Symbolizer *symbolizer, std::shared_ptr<const SymbolizedStack> &cache,
+    DDProfPProf *pprof);
+
+/**
+ * Aggregate the allocations of an interned stack that were freed after a
+ * lifetime within the given bucket. The bucket is added as a label.
+ */
+DDRes pprof_aggregate_lifetime(
+    const StackKey &key, const StackTable &stack_table,
+    const SymbolHdr &symbol_hdr, const DDProfValuePack &pack,
+    const PerfWatcher *watcher, const FileInfoVector &file_infos,
+    bool show_samples, std::string_view lifetime, Symbolizer *symbolizer,
+    std::shared_ptr<const SymbolizedStack> &cache, DDProfPProf *pprof);
+
+/**
+ * Sum the sample in the pre-aggregation table of the profile.
+ * Timestamps are dropped: only use this when timeline is disabled.
+ * Samples are added to the profile by pprof_flush_pre_aggregated.
+ * A non-empty syscall is added as a label (the view should outlive the flush).
+ */
+DDRes pprof_pre_aggregate(const StackKey &key, const DDProfValuePack &pack,
+                          const PerfWatcher *watcher,
+                          EventAggregationModePos value_pos,
+                          StackTable &stack_table, DDProfPProf *pprof,
+                          std::string_view syscall = {});
+
+/**
+ * Symbolize and add to the profile every unique stack of the pre-aggregation
+ * table, then clear the table (releasing the stacks).
+ */
+DDRes pprof_flush_pre_aggregated(StackTable &stack_table,
+                                 const SymbolHdr &symbol_hdr,
+                                 const FileInfoVector &file_infos,
+                                 bool show_samples, Symbolizer *symbolizer,
+                                 DDProfPProf *pprof);
+
+/**
+ * Same as above for the stacks of a single process: its files are only
+ * symbolized while it is known (eg. before it is freed).
+ */
+DDRes pprof_flush_pre_aggregated_pid(pid_t pid, StackTable &stack_table,
+                                     const SymbolHdr &symbol_hdr,
+                                     const FileInfoVector &file_infos,
+                                     bool show_samples, Symbolizer *symbolizer,
+                                     DDProfPProf *pprof);
+
 DDRes pprof_reset(DDProfPProf *pprof);
 
 DDRes pprof_write_profile(const DDProfPProf *pprof, int fd);
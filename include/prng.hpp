@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include <bit>
 #include <cstdint>
 #include <random>
 #include <string>
@@ -57,6 +58,30 @@ public:
     return result;
   }
 };
+
+// Sample of the exponential distribution of mean 1 from 64 random bits,
+// through the inverse CDF (-log(u)) with a polynomial logarithm.
+// The absolute error (~1e-7) does not matter for sampling, and this is much
+// cheaper than std::exponential_distribution.
+constexpr double exponential_sample(uint64_t random) {
+  // u is uniform in (0, 1]
+  const double u = static_cast<double>((random >> 11) + 1) * 0x1p-53;
+  // u = m * 2^e with m in [1, 2)
+  const auto bits = std::bit_cast<uint64_t>(u);
+  const auto e = static_cast<int64_t>(bits >> 52) - 1023;
+  const auto m =
+      std::bit_cast<double>((bits & 0xfffffffffffffUL) | 0x3ff0000000000000UL);
+  // log(m) = 2 * atanh(t) with t = (m - 1) / (m + 1) in [0, 1/3)
+  const double t = (m - 1) / (m + 1);
+  const double t2 = t * t;
+  const double log_m =
+      2 * t *
+      (1 +
+       t2 * (1. / 3 +
+             t2 * (1. / 5 + t2 * (1. / 7 + t2 * (1. / 9 + t2 * (1. / 11))))));
+  constexpr double k_ln2 = 0.6931471805599453;
+  return -(static_cast<double>(e) * k_ln2 + log_m);
+}
 // NOLINTEND(readability-magic-numbers)
 
 inline constexpr char charset[] = "0123456789"
@@ -15,10 +15,12 @@ class RingBufferHolder {
 public:
   explicit RingBufferHolder(size_t buffer_size_order,
                             RingBufferType ring_buffer_type,
-                            bool custom_event = true)
+                            bool custom_event = true, bool huge_pages = false)
       : _pevent{} {
-    DDRES_CHECK_THROW_EXCEPTION(ring_buffer_setup(
-        buffer_size_order, ring_buffer_type, custom_event, &_pevent));
+    DDRES_CHECK_THROW_EXCEPTION(ring_buffer_setup(buffer_size_order,
+                                                  ring_buffer_type,
+                                                  custom_event, &_pevent,
+                                                  huge_pages));
   }
 
   ~RingBufferHolder() { ring_buffer_cleanup(_pevent); }
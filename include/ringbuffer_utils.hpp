@@ -11,7 +11,6 @@
 
 #include <cassert>
 #include <cstring>
-#include <mutex>
 
 namespace ddprof {
 
@@ -183,10 +182,20 @@ struct MPSCRingBufferHeader {
   [[nodiscard]] bool is_discarded() const { return size & k_discard_bit; }
 };
 
+// Reader side: release [reader_pos, new_tail) to the writers.
+// Released bytes are zeroed: the header of a record that is reserved but not
+// written yet reads as 0, which readers treat as a busy record.
+inline void mpsc_rb_release(RingBuffer &rb, uint64_t new_tail) {
+  uint64_t const tail = *rb.reader_pos;
+  if (new_tail > tail) {
+    // data is mapped twice in a row, no need to split at the wrap around
+    memset(rb.data + (tail & rb.mask), 0, new_tail - tail);
+  }
+  __atomic_store_n(rb.reader_pos, new_tail, __ATOMIC_RELEASE);
+}
+
 class MPSCRingBufferWriter {
 public:
-  static inline constexpr std::chrono::milliseconds k_lock_timeout{100};
-
   explicit MPSCRingBufferWriter(RingBuffer *rb) : _rb(rb) {
     assert(_rb->type == RingBufferType::kMPSCRingBuffer);
     update_tail();
@@ -196,41 +205,37 @@ public:
     _tail = __atomic_load_n(_rb->reader_pos, __ATOMIC_ACQUIRE);
   }
 
-  Buffer reserve(size_t n, bool *timeout = nullptr) const {
+  // Reservation is lock-free: producers claim space by moving the writer
+  // position with a CAS. The record stays busy until commit / discard.
+  // An empty buffer means the ring buffer is full (reservation never waits).
+  Buffer reserve(size_t n) const {
     size_t const n2 =
         align_up(n + sizeof(MPSCRingBufferHeader), kRingBufferAlignment);
-    if (n2 == 0) {
+    // Empty records are not supported: a 0 header means "not written yet"
+    if (n == 0 || n2 == 0) {
       return {};
     }
 
-    // \fixme{nsavoire} Not sure if spinlock is the best option here
-    std::unique_lock const lock{*_rb->spinlock, k_lock_timeout};
-    if (!lock.owns_lock()) {
-      // timeout on lock
-      if (timeout) {
-        *timeout = true;
+    uint64_t writer_pos = __atomic_load_n(_rb->writer_pos, __ATOMIC_RELAXED);
+    uint64_t new_writer_pos;
+    do {
+      new_writer_pos = writer_pos + n2;
+      // Check that there is enough free space
+      if (_rb->mask < new_writer_pos - _tail) {
+        return {};
       }
-      return {};
-    }
-
-    // No need for atomic operation, since we hold the lock
-    uint64_t const writer_pos = *_rb->writer_pos;
-
-    uint64_t const new_writer_pos = writer_pos + n2;
-    // Check that there is enough free space
-    if (_rb->mask < new_writer_pos - _tail) {
-      return {};
-    }
+    } while (!__atomic_compare_exchange_n(_rb->writer_pos, &writer_pos,
+                                          new_writer_pos, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
 
     uint64_t const head_linear = writer_pos & _rb->mask;
     auto *hdr =
         reinterpret_cast<MPSCRingBufferHeader *>(_rb->data + head_linear);
 
-    // Mark the sample as busy
-    hdr->size = n | MPSCRingBufferHeader::k_busy_bit;
-
-    // Atomic operation required to synchronize with reader load_acquire
-    __atomic_store_n(_rb->writer_pos, new_writer_pos, __ATOMIC_RELEASE);
+    // Mark the sample as busy (readers might already see the new writer
+    // position, until then they read a 0 header)
+    __atomic_store_n(&hdr->size, n | MPSCRingBufferHeader::k_busy_bit,
+                     __ATOMIC_RELAXED);
 
     return {reinterpret_cast<std::byte *>(hdr + 1), n};
   }
@@ -279,8 +284,8 @@ inline ConstBuffer mpsc_rb_read_sample(RingBuffer &rb, uint64_t head) {
     auto *hdr = reinterpret_cast<MPSCRingBufferHeader *>(start);
     uint64_t const sz = __atomic_load_n(&hdr->size, __ATOMIC_ACQUIRE);
 
-    // Sample not committed yet, bail out
-    if (MPSCRingBufferHeader::is_busy(sz)) {
+    // Sample not written or not committed yet, bail out
+    if (sz == 0 || MPSCRingBufferHeader::is_busy(sz)) {
       return {};
     }
 
@@ -332,7 +337,7 @@ inline void mpsc_rb_advance_if_possible(RingBuffer &rb, const void *event) {
   }
 
   // update tail
-  __atomic_store_n(rb.reader_pos, new_tail, __ATOMIC_RELEASE);
+  mpsc_rb_release(rb, new_tail);
 }
 
 inline bool perf_rb_has_inflight_events(const RingBuffer &rb) {
@@ -361,6 +366,12 @@ inline void perf_rb_advance(RingBuffer &rb) {
   __atomic_store_n(rb.reader_pos, rb.intermediate_reader_pos, __ATOMIC_RELEASE);
 }
 
+// Number of bytes written and not released by the reader yet
+inline uint64_t perf_rb_used_size(const RingBuffer &rb) {
+  return __atomic_load_n(rb.writer_pos, __ATOMIC_ACQUIRE) -
+      __atomic_load_n(rb.reader_pos, __ATOMIC_RELAXED);
+}
+
 class MPSCRingBufferReader {
 public:
   explicit MPSCRingBufferReader(RingBuffer *rb) : _rb(rb) {
@@ -386,10 +397,8 @@ public:
   ConstBuffer read_sample() { return mpsc_rb_read_sample(*_rb, _head); }
 
   // Update ring buffer initial reader pos (usually done by destructor)
-  void advance() {
-    __atomic_store_n(_rb->reader_pos, _rb->intermediate_reader_pos,
-                     __ATOMIC_RELEASE);
-  }
+  // Samples read so far must not be accessed after advance
+  void advance() { mpsc_rb_release(*_rb, _rb->intermediate_reader_pos); }
 
   size_t update_available() {
     _head = __atomic_load_n(_rb->writer_pos, __ATOMIC_ACQUIRE);
@@ -413,9 +422,11 @@ DDRes ring_buffer_detach(PEvent &event);
 // Create ring buffer (create memfd and eventfd)
 // Ring buffer is not mapped upon return from this function, ring_buffer_attach
 // needs to be called to map it
+// MPSC ring buffers can be backed by huge pages (regular pages are used if
+// none are available)
 DDRes ring_buffer_create(size_t buffer_size_page_order,
                          RingBufferType ring_buffer_type, bool custom_event,
-                         PEvent *event);
+                         PEvent *event, bool huge_pages = false);
 
 // Destroy ring buffer: close memfd / eventfd
 DDRes ring_buffer_close(PEvent &event);
@@ -423,7 +434,7 @@ DDRes ring_buffer_close(PEvent &event);
 // Create and attach ring buffer
 DDRes ring_buffer_setup(size_t buffer_size_page_order,
                         RingBufferType ring_buffer_type, bool custom_event,
-                        PEvent *event);
+                        PEvent *event, bool huge_pages = false);
 
 // Unmap and close ring buffer
 DDRes ring_buffer_cleanup(PEvent &event);
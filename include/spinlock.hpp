@@ -0,0 +1,76 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+#pragma once
+
+#include "ddprof_base.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace ddprof {
+
+// Lock for short critical sections. Unlike std::mutex, it never allocates and
+// can be reset (unlocked) in a child process after fork.
+class SpinLock {
+public:
+  void lock() {
+    if (!lock_fast()) {
+      lock_slow();
+    }
+  }
+
+  bool try_lock() { return !_flag.exchange(true, std::memory_order_acquire); }
+
+  void unlock() { _flag.store(false, std::memory_order_release); }
+
+private:
+  static inline constexpr uint32_t k_max_active_spin = 4000;
+  static inline constexpr std::chrono::nanoseconds k_yield_sleep =
+      std::chrono::microseconds(50);
+
+  bool lock_fast() {
+    // Taken from
+    // https://probablydance.com/2019/12/30/measuring-mutexes-spinlocks-and-how-bad-the-linux-scheduler-really-is/
+    uint32_t spincount = 0;
+
+    for (;;) {
+      if (!_flag.exchange(true, std::memory_order_acquire)) {
+        break;
+      }
+      do {
+        if (spincount < k_max_active_spin) {
+          ++spincount;
+#ifdef __x86_64__
+          asm volatile("pause");
+#else
+          asm volatile("yield");
+#endif
+        } else {
+          return false;
+        }
+        // Wait for lock to be released without generating cache misses
+      } while (_flag.load(std::memory_order_relaxed));
+    }
+    return true;
+  }
+
+  DDPROF_NOINLINE void lock_slow() {
+    for (;;) {
+      if (!_flag.exchange(true, std::memory_order_acquire)) {
+        break;
+      }
+      do {
+        // If active spin fails, yield
+        std::this_thread::sleep_for(k_yield_sleep);
+      } while (_flag.load(std::memory_order_relaxed));
+    }
+  }
+
+  std::atomic_bool _flag{};
+};
+
+} // namespace ddprof
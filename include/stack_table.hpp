@@ -0,0 +1,125 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include "hash_helper.hpp"
+#include "unwind_output.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace ddprof {
+
+using StackId = uint32_t;
+inline constexpr StackId k_stack_id_null = std::numeric_limits<StackId>::max();
+
+// A sample is an interned stack and the thread it was captured on
+struct StackKey {
+  StackId stack_id;
+  int pid;
+  int tid;
+  friend bool operator==(const StackKey &, const StackKey &) = default;
+};
+
+struct StackKeyHash {
+  std::size_t operator()(const StackKey &key) const noexcept {
+    std::size_t seed = 0;
+    hash_combine(seed, key.stack_id);
+    hash_combine(seed, key.pid);
+    hash_combine(seed, key.tid);
+    return seed;
+  }
+};
+
+// Worker-wide table of unique stacks (frames and container id).
+// Frames of a stack are stored once in a contiguous arena and referenced
+// through a 32 bit id, so that maps keyed by stacks do not copy nor re-hash
+// full frame sequences.
+// Ids are reference counted: every holder of an id owns a reference and
+// releases it when it drops the id. Released ids are reused.
+class StackTable {
+public:
+  StackTable() : _index(0, IndexHash{this}, IndexEqual{this}) {}
+  StackTable(const StackTable &) = delete;
+  StackTable &operator=(const StackTable &) = delete;
+
+  // Returns the id of the stack (creating it if needed) with a reference
+  // owned by the caller
+  StackId intern(const UnwindOutput &uo) {
+    return intern(uo.locs, uo.container_id);
+  }
+  StackId intern(std::span<const FunLoc> locs, std::string_view container_id);
+
+  void add_ref(StackId id) { ++_entries[id].ref_count; }
+  void release(StackId id);
+
+  [[nodiscard]] std::span<const FunLoc> locs(StackId id) const {
+    const Entry &entry = _entries[id];
+    return {_arena.data() + entry.offset, entry.nb_locs};
+  }
+  [[nodiscard]] std::string_view container_id(StackId id) const {
+    return _entries[id].container_id;
+  }
+
+  // Number of live stacks
+  [[nodiscard]] size_t size() const { return _index.size(); }
+  // Number of frames held in the arena (including released ones)
+  [[nodiscard]] size_t arena_size() const { return _arena.size(); }
+
+private:
+  struct Entry {
+    uint32_t offset;
+    uint32_t nb_locs;
+    uint32_t ref_count;
+    std::size_t hash;
+    std::string container_id;
+  };
+
+  struct StackView {
+    std::span<const FunLoc> locs;
+    std::string_view container_id;
+    std::size_t hash;
+  };
+
+  // Hashing and comparison of ids go through the table entries
+  struct IndexHash {
+    using is_transparent = void;
+    std::size_t operator()(StackId id) const {
+      return table->_entries[id].hash;
+    }
+    std::size_t operator()(const StackView &view) const { return view.hash; }
+    const StackTable *table;
+  };
+
+  struct IndexEqual {
+    using is_transparent = void;
+    bool operator()(StackId lhs, StackId rhs) const { return lhs == rhs; }
+    bool operator()(const StackView &view, StackId id) const;
+    bool operator()(StackId id, const StackView &view) const {
+      return (*this)(view, id);
+    }
+    const StackTable *table;
+  };
+
+  static std::size_t hash_locs(std::span<const FunLoc> locs);
+
+  // Drop frames of released stacks once they are the majority of the arena
+  void maybe_compact();
+
+  std::vector<FunLoc> _arena;
+  std::vector<Entry> _entries;
+  std::vector<StackId> _free_ids;
+  size_t _nb_released_locs{0};
+  std::unordered_set<StackId, IndexHash, IndexEqual> _index;
+};
+
+} // namespace ddprof
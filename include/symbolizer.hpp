@@ -8,6 +8,7 @@
 #include "ddprof_defs.hpp"
 #include "ddprof_file_info-i.hpp"
 #include "ddres_def.hpp"
+#include "go_pclntab.hpp"
 #include "map_utils.hpp"
 #include "mapinfo_table.hpp"
 
@@ -112,6 +113,8 @@ private:
 
     blaze_symbolizer_opts opts;
     std::unique_ptr<blaze_symbolizer, BlazeSymbolizerDeleter> symbolizer;
+    // Go binaries are resolved through their runtime symbol table
+    std::unique_ptr<GoPclntab> go_pclntab;
     ddprof::HeterogeneousLookupStringMap<std::string> demangled_names;
     std::string elf_src;
     bool visited{true};
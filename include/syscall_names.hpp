@@ -0,0 +1,16 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace ddprof {
+// Name of a syscall of the native ABI (eg. "read"), or "sys_<number>" for
+// syscalls without a known name. Views remain valid for the process lifetime.
+// Not thread safe.
+std::string_view syscall_name(uint64_t nr);
+} // namespace ddprof
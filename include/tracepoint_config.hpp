@@ -9,6 +9,11 @@
 #include <string_view>
 
 namespace ddprof {
+// Raw data of tracepoint samples starts with the id of the tracepoint (u16)
+inline constexpr size_t k_tracepoint_common_type_offset = 0;
+// Syscall id (long) in the raw data of raw_syscalls:sys_enter and sys_exit
+inline constexpr size_t k_raw_syscalls_id_offset = 8;
+
 // Returns the ID of the given Linux tracepoint, or -1 if an error occurs.
 int64_t tracepoint_get_id(std::string_view global_name,
                           std::string_view tracepoint_name);
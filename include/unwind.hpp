@@ -7,6 +7,8 @@
 
 #include "ddres_def.hpp"
 
+#include <cstdint>
+#include <span>
 #include <sys/types.h>
 
 namespace ddprof {
@@ -20,6 +22,17 @@ void unwind_init_sample(UnwindState *us, const uint64_t *sample_regs,
                         pid_t sample_pid, uint64_t sample_size_stack,
                         const char *sample_data_stack);
 
+// Fill sample info for a stack that was already unwound into pcs
+void unwind_init_sample_callchain(UnwindState *us, pid_t sample_pid,
+                                  std::span<const uint64_t> callchain);
+
+// Fill sample info with both a (small) stack copy and a callchain: the leaf
+// frames are unwound from the stack, the others come from the callchain
+void unwind_init_sample_hybrid(UnwindState *us, const uint64_t *sample_regs,
+                               pid_t sample_pid, uint64_t sample_size_stack,
+                               const char *sample_data_stack,
+                               std::span<const uint64_t> callchain);
+
 // Main unwind API
 DDRes unwindstate_unwind(UnwindState *us);
 
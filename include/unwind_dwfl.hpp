@@ -16,4 +16,13 @@ DDRes unwind_init_dwfl(Process &process, UnwindState *us);
 
 DDRes unwind_dwfl(Process &process, bool avoid_new_attach, UnwindState *us);
 
+// Add the frames of the callchain of the unwind state
+DDRes unwind_dwfl_callchain(Process &process, bool avoid_new_attach,
+                            UnwindState *us);
+
+// Unwind the leaf frames from the stack, until a return address matches the
+// callchain, then add the frames of the callchain from there
+DDRes unwind_dwfl_hybrid(Process &process, bool avoid_new_attach,
+                         UnwindState *us);
+
 } // namespace ddprof
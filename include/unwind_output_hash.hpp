@@ -3,6 +3,8 @@
 // developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
 // Datadog, Inc.
 
+#pragma once
+
 #include "unwind_output.hpp"
 
 #include "hash_helper.hpp"
@@ -18,6 +18,7 @@
 #include "unwind_output.hpp"
 
 #include <optional>
+#include <span>
 #include <sys/types.h>
 
 using Dwfl = struct Dwfl;
@@ -59,6 +60,10 @@ struct UnwindState {
 
   UnwindRegisters initial_regs;
   ProcessAddress_t current_ip{0};
+  // pcs unwound by the profiled process or the kernel. Without a stack, the
+  // callchain is the whole unwinding. With a stack (hybrid unwinding), the
+  // stack is only used for the leaf frames.
+  std::optional<std::span<const uint64_t>> callchain;
 
   UnwindOutput output;
   UniqueElf ref_elf; // reference elf object used to initialize dwfl
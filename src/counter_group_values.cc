@@ -0,0 +1,30 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "counter_group_values.hpp"
+
+namespace ddprof {
+
+bool CounterGroupValues::deltas(const read_format &read, pid_t tid,
+                                Deltas &deltas) {
+  if (read.nr != 1 + k_nb_counter_group_members) {
+    return false;
+  }
+  auto [it, inserted] = _values[tid].try_emplace(read.values[0].id);
+  for (int i = 0; i < k_nb_counter_group_members; ++i) {
+    uint64_t const value = read.values[i + 1].value;
+    deltas[i] = static_cast<int64_t>(value - it->second[i]);
+    it->second[i] = value;
+  }
+  return !inserted;
+}
+
+void CounterGroupValues::erase(pid_t tid) {
+  if (tid != 0) {
+    _values.erase(tid);
+  }
+}
+
+} // namespace ddprof
@@ -92,6 +92,15 @@ DDRes get_process_threads(pid_t pid, std::vector<pid_t> &threads) {
   return {};
 }
 
+// Threads of the target (-1 in global mode)
+DDRes target_threads(const DDProfContext &ctx, std::vector<pid_t> &threads) {
+  if (ctx.params.pid != -1) {
+    return get_process_threads(ctx.params.pid, threads);
+  }
+  threads.assign(1, -1);
+  return {};
+}
+
 } // namespace
 
 DDRes ddprof_setup(DDProfContext &ctx) {
@@ -102,11 +111,7 @@ DDRes ddprof_setup(DDProfContext &ctx) {
     display_system_info();
 
     std::vector<pid_t> threads;
-    if (ctx.params.pid != -1) {
-      DDRES_CHECK_FWD(get_process_threads(ctx.params.pid, threads));
-    } else {
-      threads.push_back(-1);
-    }
+    DDRES_CHECK_FWD(target_threads(ctx, threads));
 
     // Open perf events and mmap events right now to start receiving events
     // mmaps from perf fds will be lost after fork, that why we mmap them again
@@ -139,6 +144,38 @@ DDRes ddprof_setup(DDProfContext &ctx) {
   return {};
 }
 
+DDRes ddprof_open_new_cpus(DDProfContext &ctx) {
+  try {
+    std::vector<pid_t> threads;
+    DDRES_CHECK_FWD(target_threads(ctx, threads));
+    DDRES_CHECK_FWD(pevent_open_new_cpus(ctx, threads, ctx.params.num_cpu,
+                                         &ctx.worker_ctx.pevent_hdr));
+  }
+  CatchExcept2DDRes();
+  return {};
+}
+
+bool ddprof_target_has_new_cpus(const DDProfContext &ctx) {
+  if (ctx.params.pid <= 0 && ctx.params.cgroup.empty()) {
+    // global mode instruments all CPUs
+    return false;
+  }
+  // any thread of the target can widen the affinity
+  std::vector<pid_t> threads;
+  if (IsDDResNotOK(target_threads(ctx, threads))) {
+    return false;
+  }
+  cpu_set_t cpus;
+  pevent_target_cpus(ctx, threads, ctx.params.num_cpu, cpus);
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &cpus) &&
+        !CPU_ISSET(cpu, &ctx.worker_ctx.pevent_hdr.cpus)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 DDRes ddprof_teardown(DDProfContext &ctx) {
   PEventHdr *pevent_hdr = &ctx.worker_ctx.pevent_hdr;
 
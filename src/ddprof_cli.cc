@@ -172,12 +172,22 @@ int DDProfCLI::parse(int argc, const char *argv[]) {
              "Instrument the given PID rather than launching a new process.")
           ->group("Profiling settings")
           ->excludes(exec_option);
-  app.add_flag("--global,-g", global,
-               "Instrument all processes.\n"
-               "Requires specific capabilities or a perf_event_paranoid "
-               "value of less than 1.")
+  CLI::Option *global_opt =
+      app.add_flag("--global,-g", global,
+                   "Instrument all processes.\n"
+                   "Requires specific capabilities or a perf_event_paranoid "
+                   "value of less than 1.")
+          ->group("Profiling settings")
+          ->excludes(pid_opt)
+          ->excludes(exec_option);
+  app.add_option("--cgroup", cgroup,
+                 "Instrument the processes of a cgroup (eg. a container).\n"
+                 "Path of the cgroup, absolute or relative to /sys/fs/cgroup.\n"
+                 "One event per CPU is opened, whatever the number of "
+                 "threads.")
       ->group("Profiling settings")
       ->excludes(pid_opt)
+      ->excludes(global_opt)
       ->excludes(exec_option);
   app.add_option("--inlined_functions,--inlined-functions,-I",
                  inlined_functions,
@@ -216,7 +226,8 @@ int DDProfCLI::parse(int argc, const char *argv[]) {
                  "     (profile only CPU when targeting a given PID)\n"
                  "  - cpu_only: profile CPU\n"
                  "  - alloc_only: profile memory allocations\n"
-                 "  - cpu_live_heap: profile live allocations and CPU\n")
+                 "  - cpu_live_heap: profile live allocations and CPU\n"
+                 "  - cpu_wall: profile CPU and off-CPU time\n")
       ->group("Profiling settings")
       ->envname("DD_PROFILING_NATIVE_PRESET");
 
@@ -429,7 +440,7 @@ int DDProfCLI::parse(int argc, const char *argv[]) {
   }
 
   // Are we setup to do something ?
-  if (command_line.empty() && pid == 0 && !global) {
+  if (command_line.empty() && pid == 0 && !global && cgroup.empty()) {
     (void)fprintf(stderr, "Please specify a target to profile \n");
     return static_cast<int>(CLI::ExitCodes::RequiredError);
   }
@@ -484,6 +495,9 @@ void DDProfCLI::print() const {
   if (global) {
     PRINT_NFO("  - global: %s", global ? "true" : "false");
   }
+  if (!cgroup.empty()) {
+    PRINT_NFO("  - cgroup: %s", cgroup.c_str());
+  }
   if (!command_line.empty()) {
     std::string command_line_str = "[" + command_line[0];
     std::for_each(std::next(command_line.begin()), command_line.end(),
@@ -61,6 +61,34 @@ bool watcher_from_config(EventConf *conf, PerfWatcher *watcher) {
     watcher->config = tracepoint_id;
   }
 
+  if (watcher->options.off_cpu) {
+    // Stacks are sampled when threads are switched out
+    int64_t const tracepoint_id = tracepoint_get_id("sched", "sched_switch");
+    if (tracepoint_id == kIgnoredWatcherID) {
+      return false;
+    }
+    watcher->config = tracepoint_id;
+  }
+
+  if (watcher->options.syscall_time) {
+    // Stacks are sampled when syscalls are entered, with the syscall id
+    int64_t const tracepoint_id =
+        tracepoint_get_id("raw_syscalls", "sys_enter");
+    if (tracepoint_id == kIgnoredWatcherID) {
+      return false;
+    }
+    watcher->config = tracepoint_id;
+    watcher->value_source = EventConfValueSource::kRaw;
+    watcher->sample_type |= PERF_SAMPLE_RAW;
+    watcher->raw_off = k_raw_syscalls_id_offset;
+    watcher->raw_sz = sizeof(uint64_t);
+  }
+
+  if (watcher->options.counter_group) {
+    // Samples carry the values of the counters of the group
+    watcher->sample_type |= PERF_SAMPLE_READ;
+  }
+
   // Configure the sampling strategy.  If no valid conf, use template default
   if (conf->cadence != 0) {
     if (conf->cad_type == EventConfCadenceType::kPeriod) {
@@ -93,7 +121,42 @@ bool watcher_from_config(EventConf *conf, PerfWatcher *watcher) {
   watcher->tracepoint_event = conf->eventname;
   watcher->tracepoint_group = conf->groupname;
   watcher->tracepoint_label = conf->label;
+  if (!conf->filter.empty()) {
+    // Filters are evaluated by the kernel on the fields of tracepoints
+    if (watcher->type != PERF_TYPE_TRACEPOINT) {
+      return false;
+    }
+    watcher->tracepoint_filter = conf->filter;
+  }
   watcher->options.stack_sample_size = conf->stack_sample_size;
+  watcher->options.frame_pointers = conf->frame_pointers;
+  watcher->options.max_stack = conf->max_stack;
+  if (watcher->options.frame_pointers &&
+      watcher->type != kDDPROF_TYPE_CUSTOM) {
+    // The kernel walks the user stack: a few hundred bytes per sample
+    // instead of a copy of the stack
+    watcher->sample_type &= ~(PERF_SAMPLE_STACK_USER | PERF_SAMPLE_REGS_USER);
+    watcher->sample_type |= PERF_SAMPLE_CALLCHAIN;
+  }
+  if (conf->hybrid_unwind) {
+    // Allocations are not perf events
+    if (watcher->type == kDDPROF_TYPE_CUSTOM) {
+      return false;
+    }
+    // Both the kernel callchain and a stack copy for the leaf frames
+    watcher->options.hybrid_unwind = true;
+    watcher->sample_type |= PERF_SAMPLE_CALLCHAIN;
+    if (conf->stack_sample_size == k_default_perf_stack_sample_size) {
+      watcher->options.stack_sample_size = k_default_hybrid_stack_sample_size;
+    }
+  }
+  if (conf->huge_pages) {
+    // Only the ring buffers of custom events are created by the profiler
+    if (watcher->type != kDDPROF_TYPE_CUSTOM) {
+      return false;
+    }
+    watcher->options.huge_pages = true;
+  }
   // Allocation watcher, has an extra field to ensure we capture address
 
   if (watcher->config == kDDPROF_COUNT_ALLOCATIONS) {
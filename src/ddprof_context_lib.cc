@@ -65,9 +65,10 @@ void copy_cli_values(const DDProfCLI &ddprof_cli, DDProfContext &ctx) {
   // todo avoid manual copies
   ctx.params.tags = ddprof_cli.tags;
   // Profiling settings
-  if (ddprof_cli.global) {
-    // global mode is flagged as pid == -1
+  if (ddprof_cli.global || !ddprof_cli.cgroup.empty()) {
+    // global mode is flagged as pid == -1 (cgroup mode only filters it)
     ctx.params.pid = -1;
+    ctx.params.cgroup = ddprof_cli.cgroup;
   } else {
     ctx.params.pid = ddprof_cli.pid;
   }
@@ -121,7 +122,8 @@ DDRes context_add_watchers(const DDProfCLI &ddprof_cli, DDProfContext &ctx) {
 
   if (!preset.empty()) {
     const bool pid_or_global_mode =
-        (ddprof_cli.global || ddprof_cli.pid) && !ctx.params.pipefd_to_library;
+        (ddprof_cli.global || ddprof_cli.pid || !ddprof_cli.cgroup.empty()) &&
+        !ctx.params.pipefd_to_library;
     DDRES_CHECK_FWD(add_preset(preset, pid_or_global_mode,
                                ddprof_cli.default_stack_sample_size, watchers));
   }
@@ -5,6 +5,8 @@
 
 #include "ddprof_cpumask.hpp"
 
+#include <algorithm>
+#include <charconv>
 #include <climits>
 #include <cstdint>
 #include <dirent.h>
@@ -86,6 +88,44 @@ std::string cpu_mask_to_string(const cpu_set_t &cpu_mask) {
   return s;
 }
 
+bool parse_cpu_list(std::string_view sv, cpu_set_t &cpu_mask) {
+  CPU_ZERO(&cpu_mask);
+  // trailing newline of sysfs / cgroup files
+  while (!sv.empty() && (sv.back() == '\n' || sv.back() == ' ')) {
+    sv.remove_suffix(1);
+  }
+  while (!sv.empty()) {
+    std::string_view const range = sv.substr(0, sv.find(','));
+    sv.remove_prefix(std::min(range.size() + 1, sv.size()));
+
+    unsigned first;
+    unsigned last;
+    auto res = std::from_chars(range.data(), range.data() + range.size(),
+                               first);
+    if (res.ec != std::errc{}) {
+      return false;
+    }
+    last = first;
+    if (res.ptr != range.data() + range.size()) {
+      if (*res.ptr != '-') {
+        return false;
+      }
+      res = std::from_chars(res.ptr + 1, range.data() + range.size(), last);
+      if (res.ec != std::errc{} || res.ptr != range.data() + range.size() ||
+          last < first) {
+        return false;
+      }
+    }
+    if (last >= CPU_SETSIZE) {
+      return false;
+    }
+    for (unsigned cpu = first; cpu <= last; ++cpu) {
+      CPU_SET(cpu, &cpu_mask);
+    }
+  }
+  return true;
+}
+
 int nprocessors_conf() {
   // Rationale: we cannot rely on get_nprocs / sysconf(_SC_NPROCESSORS_CONF)
   // because they are implemented on top of sched_getaffinity in musl libc.
@@ -5,24 +5,32 @@
 
 #include "ddprof_worker.hpp"
 
+#include "ddprof.hpp"
 #include "ddprof_context.hpp"
 #include "ddprof_perf_event.hpp"
 #include "ddprof_stats.hpp"
+#include "defer.hpp"
 #include "dso_hdr.hpp"
 #include "exporter/ddprof_exporter.hpp"
+#include "lib/allocation_event.hpp"
 #include "logger.hpp"
 #include "perf.hpp"
 #include "pevent_lib.hpp"
 #include "pprof/ddprof_pprof.hpp"
 #include "procutils.hpp"
 #include "symbolizer.hpp"
+#include "syscall_names.hpp"
 #include "tags.hpp"
+#include "tracepoint_config.hpp"
 #include "tsc_clock.hpp"
 #include "unwind.hpp"
 #include "unwind_helper.hpp"
 #include "unwind_state.hpp"
 
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cstring>
 #include <ctime>
 #include <sys/time.h>
 #include <unistd.h>
@@ -109,6 +117,22 @@ DDRes symbols_update_stats(const SymbolHdr &symbol_hdr) {
   return {};
 }
 
+// Sizes of the perf ring buffers (they adapt to the load across workers)
+void ring_buffers_update_stats(const PEventHdr &pevent_hdr) {
+  size_t total_size = 0;
+  size_t max_size = 0;
+  for (size_t i = 0; i < pevent_hdr.size; ++i) {
+    const PEvent &pevent = pevent_hdr.pes[i];
+    if (pevent.custom_event || pevent.mapfd == -1) {
+      continue;
+    }
+    total_size += pevent.ring_buffer_size;
+    max_size = std::max(max_size, pevent.ring_buffer_size);
+  }
+  ddprof_stats_set(STATS_RING_BUFFER_TOTAL_SIZE, total_size);
+  ddprof_stats_set(STATS_RING_BUFFER_MAX_SIZE, max_size);
+}
+
 /// Retrieve cpu / memory info
 DDRes worker_update_stats(DDProfWorkerContext &worker_context,
                           std::chrono::nanoseconds cycle_duration,
@@ -135,10 +159,13 @@ DDRes worker_update_stats(DDProfWorkerContext &worker_context,
   ddprof_stats_set(
       STATS_UNMATCHED_DEALLOCATION_COUNT,
       worker_context.live_allocation.get_nb_unmatched_deallocations());
+  ddprof_stats_set(STATS_EVICTED_ALLOCATION_COUNT,
+                   worker_context.live_allocation.get_nb_evicted_addresses());
   // Symbol stats
   ddprof_stats_set(STATS_UNUSED_SYMBOLS_BINARIES_COUNT,
                    count_symbolizer_cleared);
   DDRES_CHECK_FWD(symbols_update_stats(us.symbol_hdr));
+  ring_buffers_update_stats(worker_context.pevent_hdr);
 
   long target_cpu_nsec;
   ddprof_stats_get(STATS_TARGET_CPU_USAGE, &target_cpu_nsec);
@@ -186,9 +213,19 @@ DDRes ddprof_unwind_sample(DDProfContext &ctx, perf_event_sample *sample,
   ddprof_stats_add(STATS_SAMPLE_COUNT, 1, nullptr);
   ddprof_stats_add(STATS_UNWIND_AVG_STACK_SIZE, sample->size_stack, nullptr);
 
-  // copy the sample context into the unwind structure
-  unwind_init_sample(us, sample->regs, sample->pid, sample->size_stack,
-                     sample->data_stack);
+  if (sample->regs && watcher->options.hybrid_unwind) {
+    // leaf frames from the stack, the others from the kernel callchain
+    unwind_init_sample_hybrid(us, sample->regs, sample->pid,
+                              sample->size_stack, sample->data_stack,
+                              {sample->ips, sample->nr});
+  } else if (sample->regs) {
+    // copy the sample context into the unwind structure
+    unwind_init_sample(us, sample->regs, sample->pid, sample->size_stack,
+                       sample->data_stack);
+  } else {
+    // stack was unwound by the profiled process
+    unwind_init_sample_callchain(us, sample->pid, {sample->ips, sample->nr});
+  }
 
   // If a sample has a PID, it has a TID.  Include it for downstream labels
   us->output.pid = sample->pid;
@@ -221,8 +258,9 @@ DDRes ddprof_unwind_sample(DDProfContext &ctx, perf_event_sample *sample,
    * That's why we consider the stack as truncated in input only if it is also
    * detected as incomplete during unwinding.
    */
-  if (sample->size_stack ==
-      ctx.watchers[watcher_pos].options.stack_sample_size) {
+  // Hybrid unwinding only copies the top of the stack on purpose
+  if (!watcher->options.hybrid_unwind &&
+      sample->size_stack == watcher->options.stack_sample_size) {
     ddprof_stats_add(STATS_UNWIND_TRUNCATED_INPUT, 1, nullptr);
   }
 
@@ -241,17 +279,59 @@ void ddprof_reset_worker_stats() {
 }
 
 DDRes aggregate_livealloc_stack(
-    const LiveAllocation::PprofStacks::value_type &alloc_info,
-    DDProfContext &ctx, const PerfWatcher *watcher, DDProfPProf *pprof,
+    LiveAllocation::PprofStacks::value_type &alloc_info, DDProfContext &ctx,
+    const PerfWatcher *watcher, DDProfPProf *pprof,
     const SymbolHdr &symbol_hdr) {
   const DDProfValuePack pack{
       alloc_info.second._value,
       static_cast<uint64_t>(std::max<int64_t>(0, alloc_info.second._count)), 0};
 
-  DDRES_CHECK_FWD(pprof_aggregate(
-      &alloc_info.first, symbol_hdr, pack, watcher,
+  // Only stacks that were never exported go through symbolization
+  DDRES_CHECK_FWD(pprof_aggregate_cached(
+      alloc_info.first, ctx.worker_ctx.stack_table, symbol_hdr, pack, watcher,
       ctx.worker_ctx.us->dso_hdr.get_file_info_vector(),
-      ctx.params.show_samples, kLiveSumPos, ctx.worker_ctx.symbolizer, pprof));
+      ctx.params.show_samples, kLiveSumPos, ctx.worker_ctx.symbolizer,
+      alloc_info.second._symbolized, pprof));
+  return {};
+}
+
+DDRes aggregate_lifetime_stacks(LiveAllocation::PidStacks &pid_stacks,
+                                DDProfContext &ctx, const PerfWatcher *watcher,
+                                DDProfPProf *pprof,
+                                const SymbolHdr &symbol_hdr) {
+  for (auto &[key, histogram] : pid_stacks._lifetime_stacks) {
+    for (unsigned bucket = 0; bucket < LiveAllocation::k_nb_lifetime_buckets;
+         ++bucket) {
+      if (!histogram._count[bucket]) {
+        continue;
+      }
+      const DDProfValuePack pack{
+          histogram._value[bucket],
+          static_cast<uint64_t>(histogram._count[bucket]), 0};
+      // Buckets of a stack share the symbolized locations
+      DDRES_CHECK_FWD(pprof_aggregate_lifetime(
+          key, ctx.worker_ctx.stack_table, symbol_hdr, pack, watcher,
+          ctx.worker_ctx.us->dso_hdr.get_file_info_vector(),
+          ctx.params.show_samples, LiveAllocation::lifetime_bucket_name(bucket),
+          ctx.worker_ctx.symbolizer, histogram._symbolized, pprof));
+    }
+  }
+  return {};
+}
+
+DDRes aggregate_pid_stacks(LiveAllocation::PidStacks &pid_stacks,
+                           DDProfContext &ctx, const PerfWatcher *watcher,
+                           DDProfPProf *pprof, const SymbolHdr &symbol_hdr) {
+  if (Any(EventAggregationMode::kLiveSum & watcher->aggregation_mode)) {
+    for (auto &alloc_info : pid_stacks._unique_stacks) {
+      DDRES_CHECK_FWD(aggregate_livealloc_stack(alloc_info, ctx, watcher, pprof,
+                                                symbol_hdr));
+    }
+  }
+  if (Any(EventAggregationMode::kLifetime & watcher->aggregation_mode)) {
+    DDRES_CHECK_FWD(
+        aggregate_lifetime_stacks(pid_stacks, ctx, watcher, pprof, symbol_hdr));
+  }
   return {};
 }
 
@@ -266,42 +346,53 @@ DDRes aggregate_live_allocations_for_pid(DDProfContext &ctx, pid_t pid) {
     auto &pid_map = live_allocations._watcher_vector[watcher_pos];
     const PerfWatcher *watcher = &ctx.watchers[watcher_pos];
     auto &pid_stacks = pid_map[pid];
-    for (const auto &alloc_info : pid_stacks._unique_stacks) {
-      DDRES_CHECK_FWD(aggregate_livealloc_stack(alloc_info, ctx, watcher, pprof,
-                                                symbol_hdr));
-    }
+    DDRES_CHECK_FWD(
+        aggregate_pid_stacks(pid_stacks, ctx, watcher, pprof, symbol_hdr));
   }
   return {};
 }
 
 DDRes aggregate_live_allocations(DDProfContext &ctx) {
-  // this would be more efficient if we could reuse the same stacks in
-  // libdatadog
+  // Symbolized locations are cached per stack: the cost of a cycle depends on
+  // the new stacks, not on the size of the live heap
   UnwindState *us = ctx.worker_ctx.us;
   int const i_export = ctx.worker_ctx.i_current_pprof;
   DDProfPProf *pprof = ctx.worker_ctx.pprof[i_export];
   const SymbolHdr &symbol_hdr = us->symbol_hdr;
-  const LiveAllocation &live_allocations = ctx.worker_ctx.live_allocation;
+  LiveAllocation &live_allocations = ctx.worker_ctx.live_allocation;
+  // Lifetimes are reported over the export period
+  defer {
+    live_allocations.clear_lifetimes();
+    live_allocations.clear_unmatched_deallocations();
+  };
   for (unsigned watcher_pos = 0;
        watcher_pos < live_allocations._watcher_vector.size(); ++watcher_pos) {
-    const auto &pid_map = live_allocations._watcher_vector[watcher_pos];
+    auto &pid_map = live_allocations._watcher_vector[watcher_pos];
     const PerfWatcher *watcher = &ctx.watchers[watcher_pos];
-    for (const auto &pid_vt : pid_map) {
-      for (const auto &alloc_info : pid_vt.second._unique_stacks) {
-        DDRES_CHECK_FWD(aggregate_livealloc_stack(alloc_info, ctx, watcher,
-                                                  pprof, symbol_hdr));
-      }
+    for (auto &pid_vt : pid_map) {
+      DDRES_CHECK_FWD(
+          aggregate_pid_stacks(pid_vt.second, ctx, watcher, pprof, symbol_hdr));
       LG_NTC("<%u> Number of Live allocations for PID%d=%lu, Unique stacks=%lu",
              watcher_pos, pid_vt.first, pid_vt.second._address_map.size(),
              pid_vt.second._unique_stacks.size());
     }
   }
+  LG_NTC("Unique stacks in stack table=%lu (arena frames=%lu)",
+         ctx.worker_ctx.stack_table.size(),
+         ctx.worker_ctx.stack_table.arena_size());
   return {};
 }
 
 DDRes worker_pid_free(DDProfContext &ctx, pid_t el) {
   DDRES_CHECK_FWD(aggregate_live_allocations_for_pid(ctx, el));
   UnwindState *us = ctx.worker_ctx.us;
+  // Symbolize the pre-aggregated samples while the files of the process are
+  // known
+  DDRES_CHECK_FWD(pprof_flush_pre_aggregated_pid(
+      el, ctx.worker_ctx.stack_table, us->symbol_hdr,
+      us->dso_hdr.get_file_info_vector(), ctx.params.show_samples,
+      ctx.worker_ctx.symbolizer,
+      ctx.worker_ctx.pprof[ctx.worker_ctx.i_current_pprof]));
   unwind_pid_free(us, el);
   ctx.worker_ctx.live_allocation.clear_pid(el);
   return {};
@@ -329,6 +420,65 @@ DDRes clear_unvisited_pids(DDProfContext &ctx) {
   return {};
 }
 
+// Account the duration of an interval (off-CPU time, syscall) to the stack
+// captured when it started
+DDRes aggregate_interval(DDProfContext &ctx,
+                         const PendingStacks::Interval &interval,
+                         uint64_t end_time) {
+  const PerfWatcher *watcher = &ctx.watchers[interval.watcher_pos];
+  auto value = static_cast<int64_t>(end_time - interval.start_time);
+  if (!watcher->options.is_freq) {
+    // one sample every sample_period events
+    value *= watcher->sample_period;
+  }
+  std::string_view syscall;
+  if (watcher->options.syscall_time) {
+    syscall = syscall_name(interval.value);
+  }
+  const DDProfValuePack pack{value, 1, 0};
+  DDProfPProf *pprof = ctx.worker_ctx.pprof[ctx.worker_ctx.i_current_pprof];
+  return pprof_pre_aggregate(interval.key, pack, watcher, kSumPos,
+                             ctx.worker_ctx.stack_table, pprof, syscall);
+}
+
+// Keep the stack of a thread until the end of the interval (the thread runs
+// again, the syscall returns)
+DDRes register_interval(DDProfContext &ctx, StackKey &key, uint64_t time,
+                        int watcher_pos, uint64_t value) {
+  const PendingStacks::Interval interval{key, time, watcher_pos, value};
+  uint64_t end_time = 0;
+  if (!ctx.worker_ctx.pending_stacks.start(key.tid, interval, end_time)) {
+    // the reference is now held by the pending stacks
+    key.stack_id = k_stack_id_null;
+    return {};
+  }
+  return aggregate_interval(ctx, interval, end_time);
+}
+
+// Syscall time watchers read the entries and exits of syscalls
+bool is_syscall_exit(const PerfWatcher &watcher,
+                     const perf_event_sample &sample) {
+  if (sample.size_raw < k_tracepoint_common_type_offset + sizeof(uint16_t)) {
+    return false;
+  }
+  uint16_t tracepoint_id;
+  memcpy(&tracepoint_id, sample.data_raw + k_tracepoint_common_type_offset,
+         sizeof(tracepoint_id));
+  return tracepoint_id != watcher.config;
+}
+
+// A syscall returned: account the time since it was entered
+DDRes aggregate_syscall_exit(DDProfContext &ctx,
+                             const perf_event_sample *sample,
+                             int watcher_pos) {
+  PendingStacks::Interval interval;
+  if (!ctx.worker_ctx.pending_stacks.finish(sample->tid, watcher_pos,
+                                            sample->time, interval)) {
+    return {};
+  }
+  defer { ctx.worker_ctx.stack_table.release(interval.key.stack_id); };
+  return aggregate_interval(ctx, interval, sample->time);
+}
 } // namespace
 
 DDRes worker_library_init(DDProfContext &ctx,
@@ -406,6 +556,13 @@ DDRes ddprof_pr_sample(DDProfContext &ctx, perf_event_sample *sample,
     return ddres_warn(DD_WHAT_PERFSAMP);
   }
 
+  // The exit of a syscall closes the interval opened by its entry: no stack
+  // is captured
+  if (ctx.watchers[watcher_pos].options.syscall_time &&
+      is_syscall_exit(ctx.watchers[watcher_pos], *sample)) {
+    return aggregate_syscall_exit(ctx, sample, watcher_pos);
+  }
+
   // If this is a SW_TASK_CLOCK-type event, then aggregate the time
   if (ctx.watchers[watcher_pos].config == PERF_COUNT_SW_TASK_CLOCK) {
     ddprof_stats_add(STATS_TARGET_CPU_USAGE, sample->period, nullptr);
@@ -423,13 +580,42 @@ DDRes ddprof_pr_sample(DDProfContext &ctx, perf_event_sample *sample,
   // Aggregate if unwinding went well (todo : fatal error propagation)
   if (!IsDDResFatal(res)) {
     struct UnwindState *us = ctx.worker_ctx.us;
-    if (Any(EventAggregationMode::kLiveSum & watcher->aggregation_mode) &&
-        sample->addr) {
-      // null address means we should not account it
+    // null address means we should not account it
+    const bool live_alloc = Any((EventAggregationMode::kLiveSum |
+                                 EventAggregationMode::kLifetime) &
+                                watcher->aggregation_mode) &&
+        sample->addr;
+    const bool pre_aggregate =
+        Any(EventAggregationMode::kSum & watcher->aggregation_mode) &&
+        !ctx.params.timeline;
+    // Intern the stack once for the consumers that keep it
+    StackTable &stack_table = ctx.worker_ctx.stack_table;
+    StackKey key{k_stack_id_null, us->output.pid, us->output.tid};
+    const bool interval =
+        watcher->options.off_cpu || watcher->options.syscall_time;
+    if (live_alloc || pre_aggregate || interval) {
+      key.stack_id = stack_table.intern(us->output);
+    }
+    defer {
+      if (key.stack_id != k_stack_id_null) {
+        stack_table.release(key.stack_id);
+      }
+    };
+    if (live_alloc) {
       ctx.worker_ctx.live_allocation.register_allocation(
-          us->output, sample->addr, sample->period, watcher_pos, sample->pid);
+          key, sample->addr, sample->period, watcher_pos, sample->pid,
+          sample->time,
+          Any(EventAggregationMode::kLifetime & watcher->aggregation_mode));
     }
-    if (Any(EventAggregationMode::kSum & watcher->aggregation_mode)) {
+    if (interval) {
+      // the value is only known once the thread runs again (or the syscall
+      // returns)
+      const uint64_t value = watcher->options.syscall_time
+          ? perf_value_from_sample(watcher, sample)
+          : 0;
+      DDRES_CHECK_FWD(
+          register_interval(ctx, key, sample->time, watcher_pos, value));
+    } else if (Any(EventAggregationMode::kSum & watcher->aggregation_mode)) {
       // Depending on the type of watcher, compute a value for sample
       uint64_t const sample_val = perf_value_from_sample(watcher, sample);
 
@@ -444,13 +630,33 @@ DDRes ddprof_pr_sample(DDProfContext &ctx, perf_event_sample *sample,
       if (ctx.params.timeline && sample->time != 0) {
         timestamp = sample->time + ctx.worker_ctx.perfclock_offset;
       }
+      CounterGroupValues::Deltas deltas{};
+      std::span<const int64_t> counter_values;
+      // Events of a target are per task (possibly inherited), otherwise
+      // they count all the threads of a CPU
+      pid_t const counter_tid =
+          ctx.params.pid != -1 && ctx.params.cgroup.empty()
+          ? static_cast<pid_t>(sample->tid)
+          : 0;
+      if (watcher->options.counter_group && sample->v &&
+          ctx.worker_ctx.counter_group_values.deltas(*sample->v, counter_tid,
+                                                     deltas)) {
+        counter_values = deltas;
+      }
       const DDProfValuePack pack{static_cast<int64_t>(sample_val), 1,
-                                 timestamp};
-
-      DDRES_CHECK_FWD(pprof_aggregate(
-          &us->output, us->symbol_hdr, pack, watcher,
-          us->dso_hdr.get_file_info_vector(), ctx.params.show_samples, kSumPos,
-          ctx.worker_ctx.symbolizer, pprof));
+                                 timestamp, counter_values};
+
+      if (pre_aggregate) {
+        // Without timestamps, identical samples are summed before reaching
+        // libdatadog (flushed at export)
+        DDRES_CHECK_FWD(pprof_pre_aggregate(key, pack, watcher, kSumPos,
+                                            stack_table, pprof));
+      } else {
+        DDRES_CHECK_FWD(pprof_aggregate(
+            &us->output, us->symbol_hdr, pack, watcher,
+            us->dso_hdr.get_file_info_vector(), ctx.params.show_samples,
+            kSumPos, ctx.worker_ctx.symbolizer, pprof));
+      }
     }
   }
 
@@ -484,6 +690,12 @@ DDRes ddprof_worker_cycle(DDProfContext &ctx,
                           std::chrono::steady_clock::time_point now,
                           [[maybe_unused]] bool synchronous_export) {
 
+  // Add the pre-aggregated samples before clearing any state they rely on
+  DDRES_CHECK_FWD(pprof_flush_pre_aggregated(
+      ctx.worker_ctx.stack_table, ctx.worker_ctx.us->symbol_hdr,
+      ctx.worker_ctx.us->dso_hdr.get_file_info_vector(),
+      ctx.params.show_samples, ctx.worker_ctx.symbolizer,
+      ctx.worker_ctx.pprof[ctx.worker_ctx.i_current_pprof]));
   // Clearing unused PIDs will ensure we don't report them at next cycle
   DDRES_CHECK_FWD(clear_unvisited_pids(ctx));
   DDRES_CHECK_FWD(aggregate_live_allocations(ctx));
@@ -636,7 +848,8 @@ void ddprof_pr_exit(DDProfContext &ctx, const perf_event_exit *ext,
   // overwhelming convention that this thread is closed after the other threads
   // (upheld by both pthreads and runtimes).
   // We do not clear the PID at this time because we currently cleanup anyway.
-  (void)ctx;
+  ctx.worker_ctx.pending_stacks.erase(ext->tid);
+  ctx.worker_ctx.counter_group_values.erase(ext->tid);
   if (ext->pid == ext->tid) {
     LG_DBG("<%d>(EXIT)%d", watcher_pos, ext->pid);
   } else {
@@ -644,6 +857,21 @@ void ddprof_pr_exit(DDProfContext &ctx, const perf_event_exit *ext,
   }
 }
 
+// A thread switched in: account the time since it was switched out
+DDRes ddprof_pr_switch(DDProfContext &ctx, const perf_event_header *hdr,
+                       const sample_id &id, int watcher_pos) {
+  if (hdr->misc & PERF_RECORD_MISC_SWITCH_OUT) {
+    return {};
+  }
+  PendingStacks::Interval interval;
+  if (!ctx.worker_ctx.pending_stacks.finish(id.tid, watcher_pos, id.time,
+                                            interval)) {
+    return {};
+  }
+  defer { ctx.worker_ctx.stack_table.release(interval.key.stack_id); };
+  return aggregate_interval(ctx, interval, id.time);
+}
+
 void ddprof_pr_clear_live_allocation(DDProfContext &ctx,
                                      const ClearLiveAllocationEvent *event,
                                      int watcher_pos) {
@@ -652,10 +880,77 @@ void ddprof_pr_clear_live_allocation(DDProfContext &ctx,
                                                        event->sample_id.pid);
 }
 
+void ddprof_pr_evict_live_allocation(DDProfContext &ctx,
+                                     const EvictLiveAllocationEvent *event,
+                                     int watcher_pos) {
+  // Other live allocations of the process remain accounted for
+  ctx.worker_ctx.live_allocation.evict_addresses(
+      watcher_pos, event->sample_id.pid,
+      {.mask = event->hash_mask, .value = event->hash_value});
+}
+
 void ddprof_pr_deallocation(DDProfContext &ctx, const DeallocationEvent *event,
                             int watcher_pos) {
-  ctx.worker_ctx.live_allocation.register_deallocation(event->ptr, watcher_pos,
-                                                       event->sample_id.pid);
+  ctx.worker_ctx.live_allocation.register_deallocation(
+      event->ptr, watcher_pos, event->sample_id.pid, event->sample_id.time);
+}
+
+void ddprof_pr_deallocation_batch(DDProfContext &ctx,
+                                  const DeallocationBatchEvent *event,
+                                  int watcher_pos) {
+  if (event->hdr.size < sizeof(DeallocationBatchEvent) ||
+      (event->hdr.size - sizeof(DeallocationBatchEvent)) / sizeof(uintptr_t) <
+          event->nb_addrs) {
+    LG_WRN("<%d>(DEALLOC) Truncated deallocation batch", watcher_pos);
+    return;
+  }
+  for (uint32_t i = 0; i < event->nb_addrs; ++i) {
+    ctx.worker_ctx.live_allocation.register_deallocation(
+        event->addrs[i], watcher_pos, event->sample_id.pid,
+        event->sample_id.time);
+  }
+}
+
+DDRes ddprof_pr_allocation_callchain(DDProfContext &ctx,
+                                    const AllocationCallchainEvent *event,
+                                    int watcher_pos) {
+  if (event->hdr.size < sizeof(AllocationCallchainEvent) ||
+      (event->hdr.size - sizeof(AllocationCallchainEvent)) / sizeof(uint64_t) <
+          event->nr) {
+    LG_WRN("<%d>(ALLOC) Truncated callchain", watcher_pos);
+    return {};
+  }
+  // Same processing as samples, without stack to unwind
+  perf_event_sample sample{};
+  sample.header = event->hdr;
+  sample.pid = event->sample_id.pid;
+  sample.tid = event->sample_id.tid;
+  sample.time = event->sample_id.time;
+  sample.addr = event->addr;
+  sample.period = event->period;
+  sample.nr = event->nr;
+  sample.ips = event->ips;
+  return ddprof_pr_sample(ctx, &sample, watcher_pos);
+}
+
+DDRes ddprof_pr_batch(DDProfContext &ctx, const BatchEvent *event,
+                      int watcher_pos) {
+  // Staged records are complete events, processed in the order of the batch
+  const std::byte *pos = event->data;
+  const std::byte *end = reinterpret_cast<const std::byte *>(event) +
+      event->hdr.size;
+  for (uint32_t i = 0; i < event->nb_records; ++i) {
+    const auto *hdr = reinterpret_cast<const perf_event_header *>(pos);
+    if (end - pos < static_cast<ptrdiff_t>(sizeof(perf_event_header)) ||
+        hdr->size < sizeof(perf_event_header) || hdr->size > end - pos) {
+      LG_WRN("<%d>(BATCH) Truncated batch (%u/%u records)", watcher_pos, i,
+             event->nb_records);
+      break;
+    }
+    DDRES_CHECK_FWD(ddprof_worker_process_event(hdr, watcher_pos, ctx));
+    pos += hdr->size;
+  }
+  return {};
 }
 
 /********************************** callbacks *********************************/
@@ -665,7 +960,8 @@ DDRes ddprof_worker_maybe_export(DDProfContext &ctx,
     if (now > ctx.worker_ctx.send_time) {
       // restart worker if number of uploads is reached
       ctx.worker_ctx.persistent_worker_state->restart_worker =
-          (ctx.worker_ctx.count_worker + 1 >= ctx.params.worker_period);
+          (ctx.worker_ctx.count_worker + 1 >= ctx.params.worker_period) ||
+          ddprof_target_has_new_cpus(ctx);
       // when restarting worker, do a synchronous export
       DDRES_CHECK_FWD(ddprof_worker_cycle(
           ctx, now, ctx.worker_ctx.persistent_worker_state->restart_worker));
@@ -796,6 +1092,17 @@ DDRes ddprof_worker_process_event(const perf_event_header *hdr, int watcher_pos,
       break;
 
     /* Cases where the target type might not have a PID */
+    case PERF_RECORD_SWITCH:
+      DDRES_CHECK_FWD(ddprof_pr_switch(
+          ctx, hdr, reinterpret_cast<const perf_event_switch *>(hdr)->sample_id,
+          watcher_pos));
+      break;
+    case PERF_RECORD_SWITCH_CPU_WIDE:
+      DDRES_CHECK_FWD(ddprof_pr_switch(
+          ctx, hdr,
+          reinterpret_cast<const perf_event_switch_cpu_wide *>(hdr)->sample_id,
+          watcher_pos));
+      break;
     case PERF_RECORD_LOST:
       ddprof_pr_lost(ctx, reinterpret_cast<const perf_event_lost *>(hdr),
                      watcher_pos);
@@ -804,6 +1111,11 @@ DDRes ddprof_worker_process_event(const perf_event_header *hdr, int watcher_pos,
       ddprof_pr_deallocation(
           ctx, reinterpret_cast<const DeallocationEvent *>(hdr), watcher_pos);
       break;
+    case PERF_CUSTOM_EVENT_DEALLOCATION_BATCH:
+      ddprof_pr_deallocation_batch(
+          ctx, reinterpret_cast<const DeallocationBatchEvent *>(hdr),
+          watcher_pos);
+      break;
     case PERF_CUSTOM_EVENT_CLEAR_LIVE_ALLOCATION: {
       const auto *event =
           reinterpret_cast<const ClearLiveAllocationEvent *>(hdr);
@@ -811,6 +1123,22 @@ DDRes ddprof_worker_process_event(const perf_event_header *hdr, int watcher_pos,
           aggregate_live_allocations_for_pid(ctx, event->sample_id.pid));
       ddprof_pr_clear_live_allocation(ctx, event, watcher_pos);
     } break;
+    case PERF_CUSTOM_EVENT_EVICT_LIVE_ALLOCATION:
+      ddprof_pr_evict_live_allocation(
+          ctx, reinterpret_cast<const EvictLiveAllocationEvent *>(hdr),
+          watcher_pos);
+      break;
+    case PERF_CUSTOM_EVENT_ALLOCATION_CALLCHAIN:
+      if (wpid->pid) {
+        DDRES_CHECK_FWD(ddprof_pr_allocation_callchain(
+            ctx, reinterpret_cast<const AllocationCallchainEvent *>(hdr),
+            watcher_pos));
+      }
+      break;
+    case PERF_CUSTOM_EVENT_BATCH:
+      DDRES_CHECK_FWD(ddprof_pr_batch(
+          ctx, reinterpret_cast<const BatchEvent *>(hdr), watcher_pos));
+      break;
     default:
       break;
     }
@@ -46,12 +46,15 @@ std::optional<EventAggregationMode> mode_from_str(const std::string &str) {
   const std::string a_str{"Aa*"};
   const std::string l_str{"Ll"}; // live sum
   const std::string s_str{"Ss"}; // sum
+  const std::string t_str{"Tt"}; // lifetime
   EventAggregationMode mode = EventAggregationMode::kDisabled;
   for (const char &c : str) {
     if (s_str.find(c) != std::string::npos) {
       mode |= EventAggregationMode::kSum;
     } else if (l_str.find(c) != std::string::npos) {
         mode |= EventAggregationMode::kLiveSum;
+    } else if (t_str.find(c) != std::string::npos) {
+      mode |= EventAggregationMode::kLifetime;
     } else if (a_str.find(c) != std::string::npos) {
       mode |= EventAggregationMode::kAll;
     } else {
@@ -111,8 +114,16 @@ void conf_print(const EventConf *tp) {
   else if (tp->value_source == EventConfValueSource::kRaw)
     printf("  location: raw event (%lu with size %d bytes)\n", tp->raw_offset, tp->raw_size);
   printf("  stack_sample_size: %u\n", tp->stack_sample_size);
+  if (tp->frame_pointers)
+    printf("  unwind: frame pointers (max stack %u)\n", tp->max_stack);
+  if (tp->hybrid_unwind)
+    printf("  unwind: hybrid (max stack %u)\n", tp->max_stack);
   if (tp->value_scale != 0)
     printf("  scaling factor: %f\n", tp->value_scale);
+  if (!tp->filter.empty())
+    printf("  filter: %s\n", tp->filter.c_str());
+  if (tp->huge_pages)
+    printf("  huge pages\n");
 
   printf("\n");
 
@@ -180,14 +191,14 @@ int main(int c, char **v) {
 %token EQ OPTSEP CONFSEP
 %token <fpnum> FLOAT
 %token <num> NUMBER HEXNUMBER
-%token <str> WORD
+%token <str> WORD STRING
 %token <str> KEY
 
 %type <num> integer
 %type <field> conf
 %type <field> opt
 
-%destructor { delete $$; } WORD
+%destructor { delete $$; } WORD STRING
 
 %%
 
@@ -230,6 +241,21 @@ opt:
              g_accum_event_conf.mode = *mode;
              break;
            }
+         case EventConfField::kUnwind:
+           if (*$3 == "fp") {
+             g_accum_event_conf.frame_pointers = true;
+             g_accum_event_conf.hybrid_unwind = false;
+           } else if (*$3 == "dwarf") {
+             g_accum_event_conf.frame_pointers = false;
+             g_accum_event_conf.hybrid_unwind = false;
+           } else if (*$3 == "hybrid") {
+             g_accum_event_conf.frame_pointers = false;
+             g_accum_event_conf.hybrid_unwind = true;
+           } else {
+             delete $3;
+             VAL_ERROR();
+           }
+           break;
          default:
            delete $3;
            VAL_ERROR();
@@ -237,6 +263,15 @@ opt:
        }
        delete $3;
      }
+     | KEY EQ STRING {
+       // only filters are quoted (they hold spaces and separators)
+       if ($$ != EventConfField::kFilter || $3->empty()) {
+         delete $3;
+         VAL_ERROR();
+       }
+       g_accum_event_conf.filter = *$3;
+       delete $3;
+     }
      | KEY EQ WORD ':' WORD {
        if ($$ == EventConfField::kEvent || $$ == EventConfField::kGroup) {
          g_accum_event_conf.eventname = *$3;
@@ -305,6 +340,20 @@ opt:
          case EventConfField::kStackSampleSize:
             g_accum_event_conf.stack_sample_size = $3;
             break;
+         case EventConfField::kMaxStack:
+           if ($3 == 0 || $3 > UINT16_MAX) {
+             VAL_ERROR();
+             break;
+           }
+           g_accum_event_conf.max_stack = $3;
+           break;
+         case EventConfField::kHugePages:
+           if ($3 > 1) {
+             VAL_ERROR();
+             break;
+           }
+           g_accum_event_conf.huge_pages = $3;
+           break;
          case EventConfField::kPeriod:
          case EventConfField::kFrequency:
            // If the cadence has already been set, it's an error
@@ -0,0 +1,508 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "go_pclntab.hpp"
+
+#include "logger.hpp"
+#include "unique_fd.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace ddprof {
+
+namespace {
+// Table layout is described in the Go sources (runtime/symtab.go and
+// cmd/link/internal/ld/pcln.go)
+constexpr uint32_t k_go116_magic = 0xfffffffa;
+constexpr uint32_t k_go118_magic = 0xfffffff0;
+constexpr uint32_t k_go120_magic = 0xfffffff1;
+
+constexpr size_t k_header_words_offset = 8;
+constexpr uint8_t k_supported_ptr_size = 8;
+
+// runtime/symtab.go: _PCDATA_InlTreeIndex / _FUNCDATA_InlTree
+constexpr uint32_t k_pcdata_inl_tree_index = 2;
+constexpr uint32_t k_funcdata_inl_tree = 3;
+constexpr uint32_t k_invalid_offset = 0xffffffff;
+
+// Offsets of the fields we need in the runtime _func structure
+struct FuncLayout {
+  size_t name_off;
+  size_t pcfile;
+  size_t pcln;
+  size_t npcdata;
+  size_t cu_offset;
+  size_t nfuncdata;
+  size_t pcdata;
+};
+
+// NOLINTBEGIN(readability-magic-numbers)
+constexpr FuncLayout k_go116_layout{8, 24, 28, 32, 36, 43, 44};
+constexpr FuncLayout k_go118_layout{4, 20, 24, 28, 32, 39, 40};
+// 1.20 inserts startLine after cuOffset
+constexpr FuncLayout k_go120_layout{4, 20, 24, 28, 32, 43, 44};
+
+// Offsets within the runtime inlinedCall structure
+struct InlinedCallLayout {
+  size_t size;
+  size_t name_off;
+  size_t parent_pc;
+};
+constexpr InlinedCallLayout k_go118_inlined_call{20, 12, 16};
+constexpr InlinedCallLayout k_go120_inlined_call{16, 4, 8};
+
+// Index (in pointer sized words) of fields within runtime.moduledata
+constexpr size_t k_moduledata_text_idx = 22;
+constexpr size_t k_go118_moduledata_gofunc_idx = 37;
+// 1.20 adds covctrs, ecovctrs and rodata before gofunc
+constexpr size_t k_go120_moduledata_gofunc_idx = 40;
+// NOLINTEND(readability-magic-numbers)
+
+const FuncLayout &func_layout(GoPclntab::Version version) {
+  switch (version) {
+  case GoPclntab::Version::kGo116:
+    return k_go116_layout;
+  case GoPclntab::Version::kGo118:
+    return k_go118_layout;
+  default:
+    break;
+  }
+  return k_go120_layout;
+}
+
+// Bound checked unaligned load, returns 0 when reading out of bounds
+template <typename T> T load(std::span<const std::byte> data, size_t off) {
+  T val{};
+  if (off <= data.size() && data.size() - off >= sizeof(T)) {
+    memcpy(&val, data.data() + off, sizeof(T));
+  }
+  return val;
+}
+
+std::span<const std::byte> tail(std::span<const std::byte> data,
+                                uint64_t off) {
+  if (off > data.size()) {
+    return {};
+  }
+  return data.subspan(off);
+}
+
+std::string_view cstring_at(std::span<const std::byte> data, uint64_t off) {
+  data = tail(data, off);
+  const void *end = memchr(data.data(), '\0', data.size());
+  if (!end) {
+    return {};
+  }
+  return {reinterpret_cast<const char *>(data.data()),
+          static_cast<size_t>(static_cast<const std::byte *>(end) -
+                              data.data())};
+}
+
+// Read unsigned LEB128 value, returns false on truncated input
+bool read_varint(std::span<const std::byte> &data, uint32_t &val) {
+  uint32_t res = 0;
+  // NOLINTNEXTLINE(readability-magic-numbers)
+  for (unsigned shift = 0; shift < 35 && !data.empty(); shift += 7) {
+    const auto byte = static_cast<uint8_t>(data.front());
+    data = data.subspan(1);
+    // NOLINTNEXTLINE(readability-magic-numbers)
+    res |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    // NOLINTNEXTLINE(readability-magic-numbers)
+    if ((byte & 0x80) == 0) {
+      val = res;
+      return true;
+    }
+  }
+  return false;
+}
+
+struct ElfSection {
+  std::string_view name;
+  uint64_t addr;
+  std::span<const std::byte> data; // empty for NOBITS sections
+};
+
+std::vector<ElfSection> read_elf_sections(std::span<const std::byte> file) {
+  std::vector<ElfSection> sections;
+  const auto ehdr = load<Elf64_Ehdr>(file, 0);
+  if (memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0 ||
+      ehdr.e_ident[EI_CLASS] != ELFCLASS64 ||
+      ehdr.e_shentsize != sizeof(Elf64_Shdr) ||
+      ehdr.e_shstrndx >= ehdr.e_shnum) {
+    return sections;
+  }
+  const auto shdr_at = [&](size_t idx) {
+    return load<Elf64_Shdr>(file, ehdr.e_shoff + (idx * sizeof(Elf64_Shdr)));
+  };
+  const auto strtab_hdr = shdr_at(ehdr.e_shstrndx);
+  const auto strtab =
+      tail(file, strtab_hdr.sh_offset).first(std::min<uint64_t>(
+          strtab_hdr.sh_size, tail(file, strtab_hdr.sh_offset).size()));
+  sections.reserve(ehdr.e_shnum);
+  for (size_t i = 0; i < ehdr.e_shnum; ++i) {
+    const auto shdr = shdr_at(i);
+    std::span<const std::byte> data;
+    if (shdr.sh_type != SHT_NOBITS && shdr.sh_offset <= file.size() &&
+        file.size() - shdr.sh_offset >= shdr.sh_size) {
+      data = file.subspan(shdr.sh_offset, shdr.sh_size);
+    }
+    sections.push_back({.name = cstring_at(strtab, shdr.sh_name),
+                        .addr = shdr.sh_addr,
+                        .data = data});
+  }
+  return sections;
+}
+
+const ElfSection *find_section(const std::vector<ElfSection> &sections,
+                               std::string_view name) {
+  auto it = std::find_if(sections.begin(), sections.end(),
+                         [&](const ElfSection &s) { return s.name == name; });
+  return it != sections.end() ? &*it : nullptr;
+}
+
+std::span<const std::byte>
+translate_vaddr(const std::vector<ElfSection> &sections, uint64_t vaddr) {
+  for (const auto &section : sections) {
+    if (section.addr != 0 && vaddr >= section.addr &&
+        vaddr - section.addr < section.data.size()) {
+      return section.data.subspan(vaddr - section.addr);
+    }
+  }
+  return {};
+}
+
+// The go:func.* region (base of funcdata offsets) is only referenced from
+// runtime.firstmoduledata. Look for the moduledata through its first field
+// (pointer to the pclntab header) and check the text field for consistency.
+std::span<const std::byte>
+find_gofunc(const std::vector<ElfSection> &sections, uint64_t pclntab_addr,
+            uint64_t text_start, GoPclntab::Version version) {
+  const size_t gofunc_idx = version == GoPclntab::Version::kGo118
+      ? k_go118_moduledata_gofunc_idx
+      : k_go120_moduledata_gofunc_idx;
+  for (const char *name : {".noptrdata", ".data.rel.ro"}) {
+    const ElfSection *section = find_section(sections, name);
+    if (!section) {
+      continue;
+    }
+    const auto data = section->data;
+    for (size_t off = 0; off + ((gofunc_idx + 1) * sizeof(uint64_t)) <=
+         data.size();
+         off += sizeof(uint64_t)) {
+      if (load<uint64_t>(data, off) != pclntab_addr ||
+          load<uint64_t>(data, off + (k_moduledata_text_idx *
+                                      sizeof(uint64_t))) != text_start) {
+        continue;
+      }
+      const auto gofunc = load<uint64_t>(data, off + (gofunc_idx *
+                                                      sizeof(uint64_t)));
+      return translate_vaddr(sections, gofunc);
+    }
+  }
+  return {};
+}
+
+// Bound on the section name table read while probing a file
+constexpr uint64_t k_max_section_names_size = 64 * 1024;
+
+// Cheap check on the section names (read without mapping the file), so that
+// only Go binaries get mapped and parsed
+bool has_pclntab_section(int fd) {
+  Elf64_Ehdr ehdr;
+  if (pread(fd, &ehdr, sizeof(ehdr), 0) != sizeof(ehdr) ||
+      memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0 ||
+      ehdr.e_ident[EI_CLASS] != ELFCLASS64 ||
+      ehdr.e_shentsize != sizeof(Elf64_Shdr) ||
+      ehdr.e_shstrndx >= ehdr.e_shnum) {
+    return false;
+  }
+  Elf64_Shdr strtab_hdr;
+  if (pread(fd, &strtab_hdr, sizeof(strtab_hdr),
+            ehdr.e_shoff + (ehdr.e_shstrndx * sizeof(Elf64_Shdr))) !=
+          sizeof(strtab_hdr) ||
+      strtab_hdr.sh_size > k_max_section_names_size) {
+    return false;
+  }
+  std::string names(strtab_hdr.sh_size, '\0');
+  if (pread(fd, names.data(), names.size(), strtab_hdr.sh_offset) !=
+      static_cast<ssize_t>(names.size())) {
+    return false;
+  }
+  // matches both .gopclntab and .data.rel.ro.gopclntab
+  constexpr std::string_view k_pclntab_suffix{".gopclntab\0", 11};
+  return names.find(k_pclntab_suffix) != std::string::npos;
+}
+} // namespace
+
+GoPclntab::~GoPclntab() {
+  if (_map_addr) {
+    munmap(_map_addr, _map_size);
+  }
+}
+
+std::unique_ptr<GoPclntab> GoPclntab::open(const std::string &path) {
+  const UniqueFd fd{::open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (!fd) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd.get(), &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(Elf64_Ehdr) ||
+      !has_pclntab_section(fd.get())) {
+    return nullptr;
+  }
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+  if (addr == MAP_FAILED) {
+    return nullptr;
+  }
+  // the object owns the mapping from now on
+  std::unique_ptr<GoPclntab> pclntab{new GoPclntab()};
+  pclntab->_map_addr = addr;
+  pclntab->_map_size = st.st_size;
+
+  const std::span file{static_cast<const std::byte *>(addr),
+                       static_cast<size_t>(st.st_size)};
+  const auto sections = read_elf_sections(file);
+  // PIE binaries keep the table in a relocated read-only section
+  const ElfSection *section = find_section(sections, ".gopclntab");
+  if (!section) {
+    section = find_section(sections, ".data.rel.ro.gopclntab");
+  }
+  if (!section || section->data.empty()) {
+    return nullptr;
+  }
+  if (!pclntab->init(section->data, {})) {
+    LG_DBG("Unsupported Go symbol table in %s", path.c_str());
+    return nullptr;
+  }
+  if (pclntab->_version != Version::kGo116) {
+    if (pclntab->_text_start == 0) {
+      // header field is relocated at load time for PIE binaries
+      if (const ElfSection *text = find_section(sections, ".text"); text) {
+        pclntab->_text_start = text->addr;
+      }
+    }
+    pclntab->_gofunc = find_gofunc(sections, section->addr,
+                                   pclntab->_text_start, pclntab->_version);
+  }
+  LG_DBG("Go symbol table found in %s (%lu functions, inline info: %s)",
+         path.c_str(), pclntab->_nfunc,
+         pclntab->has_inline_info() ? "yes" : "no");
+  return pclntab;
+}
+
+std::unique_ptr<GoPclntab>
+GoPclntab::parse(std::span<const std::byte> pclntab,
+                 std::span<const std::byte> gofunc) {
+  std::unique_ptr<GoPclntab> res{new GoPclntab()};
+  if (!res->init(pclntab, gofunc)) {
+    return nullptr;
+  }
+  return res;
+}
+
+bool GoPclntab::init(std::span<const std::byte> pclntab,
+                     std::span<const std::byte> gofunc) {
+  _data = pclntab;
+  const auto magic = load<uint32_t>(_data, 0);
+  switch (magic) {
+  case k_go116_magic:
+    _version = Version::kGo116;
+    break;
+  case k_go118_magic:
+    _version = Version::kGo118;
+    break;
+  case k_go120_magic:
+    _version = Version::kGo120;
+    break;
+  default:
+    return false;
+  }
+  // NOLINTBEGIN(readability-magic-numbers)
+  _quantum = load<uint8_t>(_data, 6);
+  const auto ptr_size = load<uint8_t>(_data, 7);
+  // NOLINTEND(readability-magic-numbers)
+  if (ptr_size != k_supported_ptr_size || _quantum == 0) {
+    return false;
+  }
+  const auto word = [&](size_t idx) {
+    return load<uint64_t>(_data,
+                          k_header_words_offset + (idx * sizeof(uint64_t)));
+  };
+  // 1.18 added textStart after nfiles
+  const size_t first_offset_idx = _version == Version::kGo116 ? 2 : 3;
+  _nfunc = word(0);
+  _text_start = _version == Version::kGo116 ? 0 : word(2);
+  _funcnametab = tail(_data, word(first_offset_idx));
+  _cutab = tail(_data, word(first_offset_idx + 1));
+  _filetab = tail(_data, word(first_offset_idx + 2));
+  _pctab = tail(_data, word(first_offset_idx + 3));
+  _pclntable = tail(_data, word(first_offset_idx + 4));
+  const size_t functab_entry_size =
+      _version == Version::kGo116 ? 2 * sizeof(uint64_t) : 2 * sizeof(uint32_t);
+  if (_nfunc == 0 || _funcnametab.empty() || _pctab.empty() ||
+      _pclntable.size() / functab_entry_size < _nfunc + 1) {
+    return false;
+  }
+  _gofunc = gofunc;
+  return true;
+}
+
+uint64_t GoPclntab::func_entry(size_t idx) const {
+  if (_version == Version::kGo116) {
+    return load<uint64_t>(_pclntable, idx * 2 * sizeof(uint64_t));
+  }
+  return _text_start + load<uint32_t>(_pclntable, idx * 2 * sizeof(uint32_t));
+}
+
+std::optional<GoPclntab::FuncInfo>
+GoPclntab::find_func(ElfAddress_t addr) const {
+  // last entry is the end of the text
+  if (addr < func_entry(0) || addr >= func_entry(_nfunc)) {
+    return std::nullopt;
+  }
+  // find last function whose entry is <= addr
+  size_t low = 0;
+  size_t high = _nfunc;
+  while (high - low > 1) {
+    const size_t mid = low + ((high - low) / 2);
+    if (func_entry(mid) <= addr) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+  const uint64_t func_off = _version == Version::kGo116
+      ? load<uint64_t>(_pclntable, (low * 2 + 1) * sizeof(uint64_t))
+      : load<uint32_t>(_pclntable, (low * 2 + 1) * sizeof(uint32_t));
+  auto func = tail(_pclntable, func_off);
+  if (func.size() < func_layout(_version).pcdata) {
+    return std::nullopt;
+  }
+  return FuncInfo{.func = func, .entry = func_entry(low)};
+}
+
+std::optional<int32_t> GoPclntab::pcvalue(uint32_t table_off, uint64_t entry,
+                                          ElfAddress_t target_pc) const {
+  if (table_off == 0) {
+    return std::nullopt;
+  }
+  auto data = tail(_pctab, table_off);
+  uint64_t pc = entry;
+  int32_t val = -1;
+  bool first = true;
+  while (true) {
+    uint32_t uvdelta;
+    if (!read_varint(data, uvdelta) || (uvdelta == 0 && !first)) {
+      return std::nullopt;
+    }
+    // zig-zag encoded value delta
+    const auto vdelta = (uvdelta & 1) != 0 ? ~(uvdelta >> 1) : (uvdelta >> 1);
+    val += static_cast<int32_t>(vdelta);
+    uint32_t pcdelta;
+    if (!read_varint(data, pcdelta)) {
+      return std::nullopt;
+    }
+    pc += static_cast<uint64_t>(pcdelta) * _quantum;
+    first = false;
+    if (target_pc < pc) {
+      return val;
+    }
+  }
+}
+
+std::string_view GoPclntab::func_name(int32_t name_off) const {
+  if (name_off < 0) {
+    return {};
+  }
+  return cstring_at(_funcnametab, name_off);
+}
+
+std::string_view GoPclntab::file_name(uint32_t cu_offset,
+                                      int32_t file_idx) const {
+  if (file_idx < 0) {
+    return {};
+  }
+  const auto file_off = load<uint32_t>(
+      _cutab, (static_cast<uint64_t>(cu_offset) + file_idx) * sizeof(uint32_t));
+  if (file_off == k_invalid_offset) {
+    return {};
+  }
+  return cstring_at(_filetab, file_off);
+}
+
+size_t GoPclntab::symbolize(ElfAddress_t addr,
+                            std::span<GoFrame> frames) const {
+  if (frames.empty()) {
+    return 0;
+  }
+  const auto func_info = find_func(addr);
+  if (!func_info) {
+    return 0;
+  }
+  const FuncLayout &layout = func_layout(_version);
+  const auto func = func_info->func;
+  const uint64_t entry = func_info->entry;
+  const auto pcfile = load<uint32_t>(func, layout.pcfile);
+  const auto pcln = load<uint32_t>(func, layout.pcln);
+  const auto cu_offset = load<uint32_t>(func, layout.cu_offset);
+  const auto npcdata = load<uint32_t>(func, layout.npcdata);
+
+  // Inline tree is only resolved when go:func.* was located
+  std::span<const std::byte> inl_tree;
+  uint32_t inl_index_table = 0;
+  if (has_inline_info() && _version != Version::kGo116 &&
+      npcdata > k_pcdata_inl_tree_index &&
+      load<uint8_t>(func, layout.nfuncdata) > k_funcdata_inl_tree) {
+    inl_index_table = load<uint32_t>(
+        func, layout.pcdata + (k_pcdata_inl_tree_index * sizeof(uint32_t)));
+    const auto inl_tree_off = load<uint32_t>(
+        func, layout.pcdata + (npcdata * sizeof(uint32_t)) +
+            (k_funcdata_inl_tree * sizeof(uint32_t)));
+    if (inl_tree_off != k_invalid_offset) {
+      inl_tree = tail(_gofunc, inl_tree_off);
+    }
+  }
+  const InlinedCallLayout &call_layout = _version == Version::kGo118
+      ? k_go118_inlined_call
+      : k_go120_inlined_call;
+
+  // pcfile / pcln describe the innermost position at a given pc. Inlined
+  // calls are walked up through the parentPc of each inline tree entry.
+  ElfAddress_t pc = addr;
+  size_t nb_frames = 0;
+  int32_t inl_idx = inl_tree.empty()
+      ? -1
+      : pcvalue(inl_index_table, entry, pc).value_or(-1);
+  while (inl_idx >= 0 && nb_frames + 1 < frames.size()) {
+    const size_t call_off = static_cast<size_t>(inl_idx) * call_layout.size;
+    if (inl_tree.size() < call_off + call_layout.size) {
+      break;
+    }
+    frames[nb_frames++] = GoFrame{
+        .function =
+            func_name(load<int32_t>(inl_tree, call_off + call_layout.name_off)),
+        .file = file_name(cu_offset, pcvalue(pcfile, entry, pc).value_or(-1)),
+        .line = static_cast<uint32_t>(
+            std::max(pcvalue(pcln, entry, pc).value_or(0), 0))};
+    pc = entry + load<int32_t>(inl_tree, call_off + call_layout.parent_pc);
+    inl_idx = pcvalue(inl_index_table, entry, pc).value_or(-1);
+  }
+  frames[nb_frames++] = GoFrame{
+      .function = func_name(load<int32_t>(func, layout.name_off)),
+      .file = file_name(cu_offset, pcvalue(pcfile, entry, pc).value_or(-1)),
+      .line = static_cast<uint32_t>(
+          std::max(pcvalue(pcln, entry, pc).value_or(0), 0))};
+  return nb_frames;
+}
+
+} // namespace ddprof
@@ -6,6 +6,7 @@
 #include "ipc.hpp"
 
 #include "chrono_utils.hpp"
+#include "defer.hpp"
 
 #include <cerrno>
 #include <csignal>
@@ -224,8 +225,16 @@ UnixSocket::receive_partial(std::span<std::byte> buffer, std::span<int> fds,
   }
 
   /* Check the validity of the 'cmsghdr' */
-  if (static_cast<size_t>(nfds) > fds.size() ||
-      cmsgp->cmsg_level != SOL_SOCKET || cmsgp->cmsg_type != SCM_RIGHTS) {
+  if (cmsgp->cmsg_level != SOL_SOCKET || cmsgp->cmsg_type != SCM_RIGHTS) {
+    return {nr, 0};
+  }
+  if (static_cast<size_t>(nfds) > fds.size()) {
+    // received descriptors are installed in this process: do not leak them
+    for (int i = 0; i < nfds; ++i) {
+      int fd;
+      ::memcpy(&fd, CMSG_DATA(cmsgp) + (i * sizeof(int)), sizeof(int));
+      ::close(fd);
+    }
     return {nr, 0};
   }
 
@@ -241,9 +250,16 @@ DDRes send(const UnixSocket &socket, const RequestMessage &msg) {
 }
 
 DDRes send(const UnixSocket &socket, const ReplyMessage &msg) {
-  int fds[2] = {msg.ring_buffer.ring_fd, msg.ring_buffer.event_fd};
-  std::span<int> const fd_span{fds,
-                               (msg.ring_buffer.mem_size != -1) ? 2UL : 0UL};
+  if (msg.nb_ring_buffers > msg.ring_buffers.size()) {
+    DDRES_RETURN_ERROR_LOG(DD_WHAT_SOCKET, "Too many ring buffers to send");
+  }
+  // each ring buffer is transferred as a (ring_fd, event_fd) pair
+  std::array<int, 2 * k_max_allocation_ring_buffers> fds;
+  for (uint32_t i = 0; i < msg.nb_ring_buffers; ++i) {
+    fds[2 * i] = msg.ring_buffers[i].ring_fd;
+    fds[(2 * i) + 1] = msg.ring_buffers[i].event_fd;
+  }
+  std::span<int> const fd_span{fds.data(), 2UL * msg.nb_ring_buffers};
   std::error_code ec;
   socket.send(to_byte_span(&msg), fd_span, ec);
   DDRES_CHECK_ERRORCODE(ec, DD_WHAT_SOCKET, "Unable to send response message");
@@ -260,18 +276,31 @@ DDRes receive(const UnixSocket &socket, RequestMessage &msg) {
 }
 
 DDRes receive(const UnixSocket &socket, ReplyMessage &msg) {
-  int fds[2] = {-1, -1};
+  std::array<int, 2 * k_max_allocation_ring_buffers> fds;
+  fds.fill(-1);
   std::error_code ec;
   auto res = socket.receive(to_byte_span(&msg), fds, ec);
+  // close the received descriptors unless they are handed over to the caller
+  auto close_fds = make_defer([&fds] {
+    for (int const fd : fds) {
+      if (fd != -1) {
+        ::close(fd);
+      }
+    }
+  });
 
   DDRES_CHECK_ERRORCODE(ec, DD_WHAT_SOCKET,
                         "Unable to receive response message");
-  if ((msg.ring_buffer.mem_size != -1) ^ (res.second == 2)) {
+  if (msg.nb_ring_buffers > msg.ring_buffers.size() ||
+      res.second != 2UL * msg.nb_ring_buffers) {
     DDRES_RETURN_ERROR_LOG(DD_WHAT_SOCKET,
                            "Unable to receive response message");
   }
-  msg.ring_buffer.ring_fd = fds[0];
-  msg.ring_buffer.event_fd = fds[1];
+  for (uint32_t i = 0; i < msg.nb_ring_buffers; ++i) {
+    msg.ring_buffers[i].ring_fd = fds[2 * i];
+    msg.ring_buffers[i].event_fd = fds[(2 * i) + 1];
+  }
+  close_fds.release();
   return {};
 }
 
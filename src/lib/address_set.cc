@@ -0,0 +1,210 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+#include "address_set.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <sys/mman.h>
+
+namespace ddprof {
+
+namespace {
+using SlotRef = std::atomic_ref<uintptr_t>;
+constexpr uintptr_t k_empty = 0;
+constexpr unsigned k_hash_bits = 32;
+// counter of the addresses of the line stored in the next line
+constexpr unsigned k_overflow_slot = AddressSet::k_nb_addresses_per_line;
+} // namespace
+
+AddressSet::AddressSet(AddressSet &&other) noexcept { move_from(other); }
+
+AddressSet &AddressSet::operator=(AddressSet &&other) noexcept {
+  if (this != &other) {
+    reset();
+    move_from(other);
+  }
+  return *this;
+}
+
+void AddressSet::move_from(AddressSet &other) noexcept {
+  _slots = other._slots;
+  _nb_lines = other._nb_lines;
+  _line_shift = other._line_shift;
+  _nb_addresses.store(other._nb_addresses.load());
+
+  // Reset the state of 'other'
+  other._slots = nullptr;
+  other._nb_lines = 0;
+  other._line_shift = 0;
+  other._nb_addresses = 0;
+}
+
+void AddressSet::init(size_t capacity) {
+  reset();
+  if (!capacity) {
+    return;
+  }
+  // line index comes from the 32 bits of the address hash
+  const size_t nb_lines = std::min(
+      std::bit_ceil((capacity + k_nb_addresses_per_line - 1) /
+                    k_nb_addresses_per_line),
+      size_t{1} << k_hash_bits);
+  // Anonymous mappings are zero filled (k_empty) without touching the pages
+  void *addr =
+      mmap(nullptr, nb_lines * k_nb_slots_per_line * sizeof(uintptr_t),
+           PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED) {
+    return;
+  }
+  // Lookups hit random lines: huge pages avoid a TLB miss on most of them
+  // (best effort, transparent huge pages can be disabled)
+  madvise(addr, nb_lines * k_nb_slots_per_line * sizeof(uintptr_t),
+          MADV_HUGEPAGE);
+  _slots = static_cast<uintptr_t *>(addr);
+  _nb_lines = nb_lines;
+  _line_shift = k_hash_bits - std::countr_zero(nb_lines);
+}
+
+void AddressSet::reset() {
+  if (_slots) {
+    munmap(_slots, mapped_size());
+  }
+  _slots = nullptr;
+  _nb_lines = 0;
+  _line_shift = 0;
+  _nb_addresses = 0;
+}
+
+bool AddressSet::add(uintptr_t addr) {
+  if (addr == k_empty || !_slots) {
+    return false;
+  }
+  const size_t home = line_index(addr);
+  uintptr_t *home_slots = line(home);
+  uintptr_t *next_slots = line(home + 1);
+  const bool overflowed =
+      SlotRef{home_slots[k_overflow_slot]}.load(std::memory_order_relaxed);
+  // check the address is not already there before claiming a slot
+  for (unsigned i = 0; i < k_nb_addresses_per_line; ++i) {
+    if (SlotRef{home_slots[i]}.load(std::memory_order_relaxed) == addr ||
+        (overflowed &&
+         SlotRef{next_slots[i]}.load(std::memory_order_relaxed) == addr)) {
+      return false;
+    }
+  }
+  if (claim_slot(home_slots, addr)) {
+    ++_nb_addresses;
+    return true;
+  }
+  if (claim_slot(next_slots, addr)) {
+    SlotRef{home_slots[k_overflow_slot]}.fetch_add(1);
+    ++_nb_addresses;
+    return true;
+  }
+  // Both lines are full
+  return false;
+}
+
+bool AddressSet::remove(uintptr_t addr) {
+  if (addr == k_empty || !_slots) {
+    return false;
+  }
+  const size_t home = line_index(addr);
+  uintptr_t *home_slots = line(home);
+  if (remove_from_line(home_slots, addr)) {
+    _nb_addresses.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+  if (SlotRef{home_slots[k_overflow_slot]}.load(std::memory_order_relaxed) &&
+      remove_from_line(line(home + 1), addr)) {
+    SlotRef{home_slots[k_overflow_slot]}.fetch_sub(1);
+    _nb_addresses.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+bool AddressSet::claim_slot(uintptr_t *slots, uintptr_t addr) {
+  for (unsigned i = 0; i < k_nb_addresses_per_line; ++i) {
+    uintptr_t expected = k_empty;
+    // a failed CAS means another thread claimed the slot: try the next one
+    if (SlotRef{slots[i]}.load(std::memory_order_relaxed) == k_empty &&
+        SlotRef{slots[i]}.compare_exchange_strong(expected, addr)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool AddressSet::remove_from_line(uintptr_t *slots, uintptr_t addr) {
+  for (unsigned i = 0; i < k_nb_addresses_per_line; ++i) {
+    uintptr_t expected = addr;
+    if (SlotRef{slots[i]}.load(std::memory_order_relaxed) == addr &&
+        SlotRef{slots[i]}.compare_exchange_strong(expected, k_empty)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void AddressSet::clear() {
+  int nb_removed = 0;
+  for (size_t i = 0; i < _nb_lines; ++i) {
+    uintptr_t *slots = line(i);
+    for (unsigned j = 0; j < k_nb_addresses_per_line; ++j) {
+      if (SlotRef{slots[j]}.exchange(k_empty) != k_empty) {
+        ++nb_removed;
+      }
+    }
+    SlotRef{slots[k_overflow_slot]}.store(0);
+  }
+  if (nb_removed > 0) {
+    _nb_addresses.fetch_sub(nb_removed, std::memory_order_relaxed);
+  }
+}
+
+liveallocation::AddressSlice AddressSet::slice(unsigned index,
+                                               unsigned nb_slices) {
+  // slices are identified by the top bits of the hash (as lines are)
+  const unsigned shift = k_hash_bits - std::countr_zero(nb_slices);
+  return {.mask = static_cast<uint32_t>(uint64_t{nb_slices - 1} << shift),
+          .value = static_cast<uint32_t>(uint64_t{index} << shift)};
+}
+
+int AddressSet::clear_slice(unsigned index, unsigned nb_slices) {
+  if (!_slots) {
+    return 0;
+  }
+  const liveallocation::AddressSlice address_slice = slice(index, nb_slices);
+  // the addresses of the last line of the slice can overflow in the next line
+  const size_t nb_lines_per_slice = _nb_lines / nb_slices;
+  const size_t first_line = index * nb_lines_per_slice;
+  const size_t nb_lines =
+      nb_lines_per_slice ? std::min(nb_lines_per_slice + 1, _nb_lines)
+                         : _nb_lines;
+  int nb_removed = 0;
+  for (size_t i = 0; i < nb_lines; ++i) {
+    uintptr_t *slots = line(first_line + i);
+    for (unsigned j = 0; j < k_nb_addresses_per_line; ++j) {
+      uintptr_t value = SlotRef{slots[j]}.load(std::memory_order_relaxed);
+      if (value == k_empty || !address_slice.contains(value) ||
+          !SlotRef{slots[j]}.compare_exchange_strong(value, k_empty)) {
+        continue;
+      }
+      const size_t home = line_index(value);
+      if ((home & (_nb_lines - 1)) != ((first_line + i) & (_nb_lines - 1))) {
+        // overflowed from the previous line
+        SlotRef{line(home)[k_overflow_slot]}.fetch_sub(1);
+      }
+      ++nb_removed;
+    }
+  }
+  if (nb_removed > 0) {
+    _nb_addresses.fetch_sub(nb_removed, std::memory_order_relaxed);
+  }
+  return nb_removed;
+}
+
+} // namespace ddprof
@@ -21,6 +21,7 @@
 #include <atomic>
 #include <cassert>
 #include <cstdlib>
+#include <cstring>
 #include <unistd.h>
 
 namespace ddprof {
@@ -30,8 +31,14 @@ pthread_once_t AllocationTracker::_key_once = PTHREAD_ONCE_INIT;
 
 pthread_key_t AllocationTracker::_tl_state_key;
 
-AllocationTracker *AllocationTracker::_instance;
+SpinLock AllocationTracker::_tl_states_lock;
+
+TrackerThreadLocalState *AllocationTracker::_tl_states = nullptr;
 
+#ifdef DDPROF_INITIAL_EXEC_TLS
+constinit thread_local TrackerThreadLocalState
+    *AllocationTracker::_tl_state_cache = nullptr;
+#else
 TrackerThreadLocalState *AllocationTracker::get_tl_state() {
   // In shared libraries, TLS access requires a call to tls_get_addr,
   // tls_get_addr can call into malloc, which can create a recursive loop
@@ -41,11 +48,15 @@ TrackerThreadLocalState *AllocationTracker::get_tl_state() {
       pthread_getspecific(_tl_state_key));
   return tl_state;
 }
+#endif
+
+AllocationTracker *AllocationTracker::_instance;
 
 TrackerThreadLocalState *AllocationTracker::init_tl_state() {
   // Since init_tl_state is only called in allocation_tracking_init and
   // notify_thread_start, there is no danger of reentering it when doing an
   // allocation.
+  pthread_once(&_key_once, make_key);
   auto tl_state = std::make_unique<TrackerThreadLocalState>();
   tl_state->tid = ddprof::gettid();
   tl_state->stack_bounds = retrieve_stack_bounds();
@@ -55,7 +66,12 @@ TrackerThreadLocalState *AllocationTracker::init_tl_state() {
     // should return 0
     LG_ERR("Unable to store tl_state. Error %d: %s\n", res, strerror(res));
     tl_state.reset();
+  } else {
+    register_tl_state(tl_state.get());
   }
+#ifdef DDPROF_INITIAL_EXEC_TLS
+  _tl_state_cache = tl_state.get();
+#endif
 
   return tl_state.release();
 }
@@ -68,7 +84,46 @@ AllocationTracker *AllocationTracker::create_instance() {
 }
 
 void AllocationTracker::delete_tl_state(void *tl_state) {
-  delete static_cast<TrackerThreadLocalState *>(tl_state);
+  auto *state = static_cast<TrackerThreadLocalState *>(tl_state);
+#ifdef DDPROF_INITIAL_EXEC_TLS
+  // called by the exiting thread
+  _tl_state_cache = nullptr;
+#endif
+  unregister_tl_state(state);
+  // Push the records staged by the exiting thread
+  AllocationTracker *instance = _instance;
+  if (instance && instance->_state.track_allocations) {
+    ReentryGuard const guard(&state->reentry_guard);
+    if (guard) {
+      std::lock_guard const lock{state->batch_lock};
+      instance->flush_batch(*state);
+    }
+  }
+  delete state;
+}
+
+void AllocationTracker::register_tl_state(TrackerThreadLocalState *tl_state) {
+  std::lock_guard const lock{_tl_states_lock};
+  tl_state->prev = nullptr;
+  tl_state->next = _tl_states;
+  if (_tl_states) {
+    _tl_states->prev = tl_state;
+  }
+  _tl_states = tl_state;
+}
+
+void AllocationTracker::unregister_tl_state(TrackerThreadLocalState *tl_state) {
+  std::lock_guard const lock{_tl_states_lock};
+  if (tl_state->prev) {
+    tl_state->prev->next = tl_state->next;
+  } else if (_tl_states == tl_state) {
+    _tl_states = tl_state->next;
+  }
+  if (tl_state->next) {
+    tl_state->next->prev = tl_state->prev;
+  }
+  tl_state->prev = nullptr;
+  tl_state->next = nullptr;
 }
 
 void AllocationTracker::make_key() {
@@ -80,6 +135,15 @@ DDRes AllocationTracker::allocation_tracking_init(
     uint64_t allocation_profiling_rate, uint32_t flags,
     uint32_t stack_sample_size, const RingBufferInfo &ring_buffer,
     const IntervalTimerCheck &timer_check) {
+  return allocation_tracking_init(allocation_profiling_rate, flags,
+                                  stack_sample_size, std::span{&ring_buffer, 1},
+                                  timer_check);
+}
+
+DDRes AllocationTracker::allocation_tracking_init(
+    uint64_t allocation_profiling_rate, uint32_t flags,
+    uint32_t stack_sample_size, std::span<const RingBufferInfo> ring_buffers,
+    const IntervalTimerCheck &timer_check) {
   TrackerThreadLocalState *tl_state = get_tl_state();
   if (!tl_state) {
     // This is the time at which the init_tl_state should not fail
@@ -102,8 +166,10 @@ DDRes AllocationTracker::allocation_tracking_init(
 
   DDRES_CHECK_FWD(instance->init(allocation_profiling_rate,
                                  flags & kDeterministicSampling,
-                                 flags & kTrackDeallocations, stack_sample_size,
-                                 ring_buffer, timer_check));
+                                 flags & kTrackDeallocations,
+                                 flags & kBatchRecords, flags & kFramePointers,
+                                 stack_sample_size, ring_buffers,
+                                 timer_check));
   _instance = instance;
 
   state.init(true, flags & kTrackDeallocations);
@@ -114,24 +180,43 @@ DDRes AllocationTracker::allocation_tracking_init(
 DDRes AllocationTracker::init(uint64_t mem_profile_interval,
                               bool deterministic_sampling,
                               bool track_deallocations,
+                              bool batch_records, bool frame_pointers,
                               uint32_t stack_sample_size,
-                              const RingBufferInfo &ring_buffer,
+                              std::span<const RingBufferInfo> ring_buffers,
                               const IntervalTimerCheck &timer_check) {
   _sampling_interval = mem_profile_interval;
   _deterministic_sampling = deterministic_sampling;
+  _batch_records = batch_records;
+  _frame_pointers = frame_pointers;
   _stack_sample_size = stack_sample_size;
-  if (ring_buffer.ring_buffer_type !=
-      static_cast<int>(RingBufferType::kMPSCRingBuffer)) {
+  if (ring_buffers.empty() || ring_buffers.size() > _pevents.size()) {
     return ddres_error(DD_WHAT_PERFRB);
   }
+  for (const RingBufferInfo &ring_buffer : ring_buffers) {
+    if (ring_buffer.ring_buffer_type !=
+        static_cast<int>(RingBufferType::kMPSCRingBuffer)) {
+      return ddres_error(DD_WHAT_PERFRB);
+    }
+  }
   if (track_deallocations) {
-    // 16 times as we want to probability of collision to be low enough
-    _allocated_address_set = AddressBitset(liveallocation::kMaxTracked *
-                                           k_ratio_max_elt_to_bitset_size);
+    // Room for 1.5x the tracked addresses (rounded up) keeps the set below
+    // 60% load, where full lines are rare
+    _allocated_address_set =
+        AddressSet(size_t{liveallocation::kMaxTracked} * 3 / 2);
+  }
+  for (size_t i = 0; i < ring_buffers.size(); ++i) {
+    DDRes const res = ddprof::ring_buffer_attach(ring_buffers[i], &_pevents[i]);
+    if (IsDDResNotOK(res)) {
+      for (size_t j = 0; j < i; ++j) {
+        pevent_munmap_event(&_pevents[j]);
+      }
+      return res;
+    }
   }
-  DDRES_CHECK_FWD(ddprof::ring_buffer_attach(ring_buffer, &_pevent));
+  _nb_pevents = ring_buffers.size();
 
-  const auto &rb = _pevent.rb;
+  // Clock parameters are the same for all ring buffers
+  const auto &rb = _pevents[0].rb;
   if (rb.tsc_available) {
     TscClock::init(TscClock::CalibrationParams{
         .offset = TscClock::time_point{TscClock::duration{rb.time_zero}},
@@ -140,6 +225,8 @@ DDRes AllocationTracker::init(uint64_t mem_profile_interval,
   }
   PerfClock::init(static_cast<PerfClockSource>(rb.perf_clock_source));
 
+  _state.next_batch_check.store(PerfClock::now() + k_batch_max_delay,
+                                std::memory_order_relaxed);
   _interval_timer_check = timer_check;
   if (_interval_timer_check.is_set()) {
     _state.next_check_time.store(
@@ -159,7 +246,10 @@ void AllocationTracker::free() {
   _state.track_allocations = false;
   _state.track_deallocations = false;
 
-  pevent_munmap_event(&_pevent);
+  // _nb_pevents is kept: racing threads still pick a (disabled) ring buffer
+  for (uint32_t i = 0; i < _nb_pevents; ++i) {
+    pevent_munmap_event(&_pevents[i]);
+  }
 
   // Do not destroy the object:
   // there is an inherent race condition between checking
@@ -183,6 +273,10 @@ void AllocationTracker::allocation_tracking_free() {
   }
   ReentryGuard const guard(&tl_state->reentry_guard);
   std::lock_guard const lock{instance->_state.mutex};
+  if (instance->_state.track_allocations) {
+    // push the records staged by all the threads
+    instance->flush_batches(PerfClock::time_point::max(), true);
+  }
   instance->free();
 }
 
@@ -227,10 +321,17 @@ void AllocationTracker::track_allocation(uintptr_t addr, size_t /*size*/,
   size_t nsamples = remaining_bytes / sampling_interval;
   remaining_bytes = remaining_bytes % sampling_interval;
 
-  do {
-    remaining_bytes -= next_sample_interval(tl_state.gen);
+  if (_deterministic_sampling || sampling_interval == 1) {
+    // constant intervals: the next one is crossed after the remainder
+    remaining_bytes -= sampling_interval;
     ++nsamples;
-  } while (remaining_bytes >= 0);
+  } else {
+    // less than an interval is left (~1.6 draws on average)
+    do {
+      remaining_bytes -= next_sample_interval(tl_state.gen);
+      ++nsamples;
+    } while (remaining_bytes >= 0);
+  }
 
   tl_state.remaining_bytes = remaining_bytes;
   uint64_t const total_size = nsamples * sampling_interval;
@@ -239,27 +340,36 @@ void AllocationTracker::track_allocation(uintptr_t addr, size_t /*size*/,
     if (_allocated_address_set.add(addr)) {
       if (unlikely(_allocated_address_set.count() >
                    ddprof::liveallocation::kMaxTracked)) {
-        // Check if we reached max number of elements
-        // Clear elements if we reach too many
-        // todo: should we just stop new live tracking (like java) ?
-        if (IsDDResOK(push_clear_live_allocation(tl_state))) {
-          _allocated_address_set.clear();
+        // Too many tracked elements: stop tracking a slice of the addresses
+        // (slices rotate so that evictions spread over the address set).
+        // The profiler drops the same addresses, other addresses remain
+        // accounted for.
+        const unsigned index =
+            _state.next_eviction_slice.fetch_add(1, std::memory_order_relaxed) %
+            k_nb_eviction_slices;
+        const liveallocation::AddressSlice slice =
+            _allocated_address_set.slice(index, k_nb_eviction_slices);
+        if (IsDDResOK(push_evict_live_allocation(slice, tl_state))) {
+          _allocated_address_set.clear_slice(index, k_nb_eviction_slices);
           // still set this as we are pushing the allocation to ddprof
           _allocated_address_set.add(addr);
         } else {
-          LG_ERR("Stopping allocation profiling. Unable to clear live "
-                 "allocation\n");
+          LG_ERR("Stopping allocation profiling. Unable to evict live "
+                 "allocations\n");
           free();
         }
       }
     } else {
-      // null the address to avoid using this for live heap profiling
+      // Address already tracked (missed free) or no free slot around its
+      // hash: null the address to avoid using this for live heap profiling
       // pushing a sample is still good to have a good representation
       // of the allocations.
       addr = 0;
     }
   }
-  bool const success = IsDDResOK(push_alloc_sample(addr, total_size, tl_state));
+  bool const success = IsDDResOK(
+      _frame_pointers ? push_alloc_callchain(addr, total_size, tl_state)
+                      : push_alloc_sample(addr, total_size, tl_state));
   free_on_consecutive_failures(success);
   if (unlikely(!success) && _state.track_deallocations && addr) {
     _allocated_address_set.remove(addr);
@@ -286,14 +396,10 @@ DDRes AllocationTracker::push_lost_sample(MPSCRingBufferWriter &writer,
   if (lost_count == 0) {
     return {};
   }
-  bool timeout = false;
-  auto buffer = writer.reserve(sizeof(perf_event_lost), &timeout);
+  auto buffer = writer.reserve(sizeof(perf_event_lost));
   if (buffer.empty()) {
     // buffer is full, put back lost samples
     _state.lost_count.fetch_add(lost_count, std::memory_order_acq_rel);
-    if (timeout) {
-      return ddres_error(DD_WHAT_PERFRB);
-    }
     return {};
   }
 
@@ -319,24 +425,33 @@ DDRes AllocationTracker::push_lost_sample(MPSCRingBufferWriter &writer,
   return {};
 }
 
-// Return true if consumer should be notified
-DDRes AllocationTracker::push_clear_live_allocation(
-    TrackerThreadLocalState &tl_state) {
-  MPSCRingBufferWriter writer{&_pevent.rb};
-  bool timeout = false;
+DDRes AllocationTracker::push_evict_live_allocation(
+    liveallocation::AddressSlice slice, TrackerThreadLocalState &tl_state) {
+  // The eviction is pushed to all ring buffers: the profiler evicts the
+  // addresses only after the allocations pushed before to any ring buffer
+  for (uint32_t i = 0; i < _nb_pevents; ++i) {
+    DDRES_CHECK_FWD(push_evict_live_allocation(slice, _pevents[i], tl_state));
+  }
+  check_timer(PerfClock::now(), tl_state);
+  return {};
+}
 
-  auto buffer = writer.reserve(sizeof(ClearLiveAllocationEvent), &timeout);
+DDRes AllocationTracker::push_evict_live_allocation(
+    liveallocation::AddressSlice slice, PEvent &pevent,
+    TrackerThreadLocalState &tl_state) {
+  MPSCRingBufferWriter writer{&pevent.rb};
+  auto buffer = writer.reserve(sizeof(EvictLiveAllocationEvent));
   if (buffer.empty()) {
-    // unable to push a clear is an error (we don't want to grow too much)
+    // unable to push an eviction is an error (we don't want to grow too much)
     // No use pushing a lost event. As this is a sync mechanism.
     DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFRB,
-                           "Unable to get write lock on ring buffer");
+                           "Ring buffer is full, unable to push eviction");
   }
 
-  auto *event = reinterpret_cast<ClearLiveAllocationEvent *>(buffer.data());
+  auto *event = reinterpret_cast<EvictLiveAllocationEvent *>(buffer.data());
   event->hdr.misc = 0;
-  event->hdr.size = sizeof(ClearLiveAllocationEvent);
-  event->hdr.type = PERF_CUSTOM_EVENT_CLEAR_LIVE_ALLOCATION;
+  event->hdr.size = sizeof(EvictLiveAllocationEvent);
+  event->hdr.type = PERF_CUSTOM_EVENT_EVICT_LIVE_ALLOCATION;
   auto now = PerfClock::now();
   event->sample_id.time = now.time_since_epoch().count();
 
@@ -344,40 +459,67 @@ DDRes AllocationTracker::push_clear_live_allocation(
                       "pid or tid is not set");
   event->sample_id.pid = _state.pid;
   event->sample_id.tid = tl_state.tid;
+  event->hash_mask = slice.mask;
+  event->hash_value = slice.value;
 
   if (writer.commit(buffer)) {
     uint64_t count = 1;
-    if (write(_pevent.fd, &count, sizeof(count)) != sizeof(count)) {
+    if (write(pevent.fd, &count, sizeof(count)) != sizeof(count)) {
       DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFRB,
                              "Error writing to memory allocation eventfd (%s)",
                              strerror(errno));
     }
   }
-
-  check_timer(now, tl_state);
-
   return {};
 }
 
 DDRes AllocationTracker::push_dealloc_sample(
     uintptr_t addr, TrackerThreadLocalState &tl_state) {
-  MPSCRingBufferWriter writer{&_pevent.rb};
+  if (_batch_records) {
+    auto now = PerfClock::now();
+    std::unique_lock batch_lock{tl_state.batch_lock};
+    DeallocationBatchEvent *event = last_staged_deallocations(tl_state);
+    if (event &&
+        tl_state.batch_size + sizeof(uintptr_t) <= tl_state.batch.size()) {
+      // extend the record of the previous deallocations
+      event->addrs[event->nb_addrs++] = addr;
+      event->hdr.size += sizeof(uintptr_t);
+      tl_state.batch_size += sizeof(uintptr_t);
+      ++tl_state.batch_nb_events;
+    } else {
+      const size_t event_size =
+          sizeof(DeallocationBatchEvent) + sizeof(uintptr_t);
+      Buffer record;
+      DDRES_CHECK_FWD(stage_record(event_size, now, tl_state, &record));
+      event = reinterpret_cast<DeallocationBatchEvent *>(record.data());
+      event->hdr.misc = 0;
+      event->hdr.size = event_size;
+      event->hdr.type = PERF_CUSTOM_EVENT_DEALLOCATION_BATCH;
+      event->sample_id.time = now.time_since_epoch().count();
+      event->sample_id.pid = _state.pid;
+      event->sample_id.tid = tl_state.tid;
+      event->nb_addrs = 1;
+      event->reserved = 0;
+      event->addrs[0] = addr;
+    }
+    DDRES_CHECK_FWD(maybe_flush_batch(now, tl_state));
+    batch_lock.unlock();
+    check_timer(now, tl_state);
+    return {};
+  }
+
+  PEvent &pevent = pevent_for(tl_state);
+  MPSCRingBufferWriter writer{&pevent.rb};
   bool notify_consumer{false};
 
-  bool timeout = false;
   if (unlikely(_state.lost_count.load(std::memory_order_relaxed))) {
     (push_lost_sample(writer, tl_state, notify_consumer));
   }
 
-  auto buffer = writer.reserve(sizeof(DeallocationEvent), &timeout);
+  auto buffer = writer.reserve(sizeof(DeallocationEvent));
   if (buffer.empty()) {
     // ring buffer is full, increase lost count
     _state.lost_count.fetch_add(1, std::memory_order_acq_rel);
-
-    if (timeout) {
-      DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFRB,
-                             "Unable to get write lock on ring buffer");
-    }
     // not an error
     return {};
   }
@@ -399,7 +541,7 @@ DDRes AllocationTracker::push_dealloc_sample(
 
   if (writer.commit(buffer) || notify_consumer) {
     uint64_t count = 1;
-    if (write(_pevent.fd, &count, sizeof(count)) != sizeof(count)) {
+    if (write(pevent.fd, &count, sizeof(count)) != sizeof(count)) {
       DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFRB,
                              "Error writing to memory allocation eventfd (%s)",
                              strerror(errno));
@@ -414,10 +556,10 @@ DDRes AllocationTracker::push_dealloc_sample(
 DDRes AllocationTracker::push_alloc_sample(uintptr_t addr,
                                            uint64_t allocated_size,
                                            TrackerThreadLocalState &tl_state) {
-  MPSCRingBufferWriter writer{&_pevent.rb};
+  PEvent &pevent = pevent_for(tl_state);
+  MPSCRingBufferWriter writer{&pevent.rb};
   bool notify_consumer{false};
 
-  bool timeout = false;
   if (unlikely(_state.lost_count.load(std::memory_order_relaxed))) {
     push_lost_sample(writer, tl_state, notify_consumer);
   }
@@ -440,17 +582,28 @@ DDRes AllocationTracker::push_alloc_sample(uintptr_t addr,
                sizeof(uint64_t));
 
   auto event_size = sizeof_allocation_event(sample_stack_size);
-  auto buffer = writer.reserve(event_size, &timeout);
+  // With live heap tracking, allocations are not delayed: a free of the
+  // address from another thread could otherwise be processed before
+  const bool batched = _batch_records && !_state.track_deallocations &&
+      event_size <= k_max_batched_record_size;
+  auto now = PerfClock::now();
+  std::unique_lock<SpinLock> batch_lock;
+  Buffer buffer;
+  if (batched) {
+    batch_lock = std::unique_lock{tl_state.batch_lock};
+    DDRES_CHECK_FWD(stage_record(event_size, now, tl_state, &buffer));
+  } else {
+    if (_batch_records) {
+      // keep the order of the events of this thread
+      std::lock_guard const lock{tl_state.batch_lock};
+      DDRES_CHECK_FWD(flush_batch(tl_state));
+    }
+    buffer = writer.reserve(event_size);
+  }
 
   if (buffer.empty()) {
     // ring buffer is full, increase lost count
     _state.lost_count.fetch_add(1, std::memory_order_acq_rel);
-
-    if (timeout) {
-      DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFRB,
-                             "Unable to get write lock on ring buffer");
-    }
-
     // not an error
     return {};
   }
@@ -468,7 +621,6 @@ DDRes AllocationTracker::push_alloc_sample(uintptr_t addr,
   event->hdr.size = event_size;
   event->hdr.type = PERF_RECORD_SAMPLE;
   event->abi = PERF_SAMPLE_REGS_ABI_64;
-  auto now = PerfClock::now();
   event->sample_id.time = now.time_since_epoch().count();
   event->addr = addr;
 
@@ -479,11 +631,94 @@ DDRes AllocationTracker::push_alloc_sample(uintptr_t addr,
   event->period = allocated_size;
   event->size_stack = sample_stack_size;
 
+  if (batched) {
+    DDRES_CHECK_FWD(maybe_flush_batch(now, tl_state));
+    batch_lock.unlock();
+    check_timer(now, tl_state);
+    return {};
+  }
+
   // Even if dyn_size == 0, we keep the sample
   // This way, the overall accounting is correct (even with empty stacks)
   if (writer.commit(buffer) || notify_consumer) {
     uint64_t count = 1;
-    if (write(_pevent.fd, &count, sizeof(count)) != sizeof(count)) {
+    if (write(pevent.fd, &count, sizeof(count)) != sizeof(count)) {
+      DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFRB,
+                             "Error writing to memory allocation eventfd (%s)",
+                             strerror(errno));
+    }
+  }
+
+  check_timer(now, tl_state);
+
+  return {};
+}
+
+DDRes AllocationTracker::push_alloc_callchain(
+    uintptr_t addr, uint64_t allocated_size,
+    TrackerThreadLocalState &tl_state) {
+  std::array<uint64_t, k_max_callchain_depth> pcs;
+  const size_t nb_pcs = save_callchain(tl_state.stack_bounds, pcs);
+
+  PEvent &pevent = pevent_for(tl_state);
+  MPSCRingBufferWriter writer{&pevent.rb};
+  bool notify_consumer{false};
+
+  if (unlikely(_state.lost_count.load(std::memory_order_relaxed))) {
+    push_lost_sample(writer, tl_state, notify_consumer);
+  }
+
+  const size_t event_size = sizeof_allocation_callchain_event(nb_pcs);
+  // Same ordering constraint as stack samples with live heap tracking
+  const bool batched = _batch_records && !_state.track_deallocations &&
+      event_size <= k_max_batched_record_size;
+  auto now = PerfClock::now();
+  std::unique_lock<SpinLock> batch_lock;
+  Buffer buffer;
+  if (batched) {
+    batch_lock = std::unique_lock{tl_state.batch_lock};
+    DDRES_CHECK_FWD(stage_record(event_size, now, tl_state, &buffer));
+  } else {
+    if (_batch_records) {
+      // keep the order of the events of this thread
+      std::lock_guard const lock{tl_state.batch_lock};
+      DDRES_CHECK_FWD(flush_batch(tl_state));
+    }
+    buffer = writer.reserve(event_size);
+  }
+
+  if (buffer.empty()) {
+    // ring buffer is full, increase lost count
+    _state.lost_count.fetch_add(1, std::memory_order_acq_rel);
+    // not an error
+    return {};
+  }
+
+  auto *event = reinterpret_cast<AllocationCallchainEvent *>(buffer.data());
+  event->hdr.misc = 0;
+  event->hdr.size = event_size;
+  event->hdr.type = PERF_CUSTOM_EVENT_ALLOCATION_CALLCHAIN;
+  event->sample_id.time = now.time_since_epoch().count();
+
+  DDPROF_DCHECK_FATAL(_state.pid != 0 && tl_state.tid != 0,
+                      "pid or tid is not set");
+  event->sample_id.pid = _state.pid;
+  event->sample_id.tid = tl_state.tid;
+  event->addr = addr;
+  event->period = allocated_size;
+  event->nr = nb_pcs;
+  memcpy(event->ips, pcs.data(), nb_pcs * sizeof(uint64_t));
+
+  if (batched) {
+    DDRES_CHECK_FWD(maybe_flush_batch(now, tl_state));
+    batch_lock.unlock();
+    check_timer(now, tl_state);
+    return {};
+  }
+
+  if (writer.commit(buffer) || notify_consumer) {
+    uint64_t count = 1;
+    if (write(pevent.fd, &count, sizeof(count)) != sizeof(count)) {
       DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFRB,
                              "Error writing to memory allocation eventfd (%s)",
                              strerror(errno));
@@ -495,8 +730,151 @@ DDRes AllocationTracker::push_alloc_sample(uintptr_t addr,
   return {};
 }
 
+DDRes AllocationTracker::stage_record(size_t size, PerfClock::time_point now,
+                                      TrackerThreadLocalState &tl_state,
+                                      Buffer *record) {
+  DDPROF_DCHECK_FATAL(_state.pid != 0 && tl_state.tid != 0,
+                      "pid or tid is not set");
+  const uint32_t generation = _state.generation.load(std::memory_order_relaxed);
+  if (unlikely(tl_state.batch_generation != generation)) {
+    // records staged for a previous profiling session
+    tl_state.batch_size = 0;
+    tl_state.batch_nb_records = 0;
+    tl_state.batch_nb_events = 0;
+    tl_state.batch_generation = generation;
+  }
+  if (tl_state.batch_size + size > tl_state.batch.size()) {
+    DDRES_CHECK_FWD(flush_batch(tl_state));
+  }
+  if (!tl_state.batch_nb_records) {
+    tl_state.batch_first_time = now.time_since_epoch().count();
+  }
+  *record = Buffer{tl_state.batch.data() + tl_state.batch_size, size};
+  tl_state.batch_last_offset = tl_state.batch_size;
+  tl_state.batch_size += size;
+  ++tl_state.batch_nb_records;
+  ++tl_state.batch_nb_events;
+  return {};
+}
+
+DeallocationBatchEvent *AllocationTracker::last_staged_deallocations(
+    TrackerThreadLocalState &tl_state) {
+  if (!tl_state.batch_nb_records ||
+      tl_state.batch_generation !=
+          _state.generation.load(std::memory_order_relaxed)) {
+    return nullptr;
+  }
+  auto *hdr = reinterpret_cast<perf_event_header *>(
+      tl_state.batch.data() + tl_state.batch_last_offset);
+  if (hdr->type != PERF_CUSTOM_EVENT_DEALLOCATION_BATCH) {
+    return nullptr;
+  }
+  return reinterpret_cast<DeallocationBatchEvent *>(hdr);
+}
+
+DDRes AllocationTracker::maybe_flush_batch(PerfClock::time_point now,
+                                           TrackerThreadLocalState &tl_state) {
+  const auto first_time = PerfClock::time_point{
+      PerfClock::duration{tl_state.batch_first_time}};
+  if (tl_state.batch.size() - tl_state.batch_size < sizeof(uintptr_t) ||
+      now - first_time >= k_batch_max_delay) {
+    DDRES_CHECK_FWD(flush_batch(tl_state));
+  }
+  return {};
+}
+
+DDRes AllocationTracker::flush_batch(TrackerThreadLocalState &tl_state) {
+  const uint32_t nb_records = tl_state.batch_nb_records;
+  if (!nb_records) {
+    return {};
+  }
+  const uint32_t nb_events = tl_state.batch_nb_events;
+  const uint32_t batch_size = tl_state.batch_size;
+  tl_state.batch_size = 0;
+  tl_state.batch_nb_records = 0;
+  tl_state.batch_nb_events = 0;
+  if (tl_state.batch_generation !=
+      _state.generation.load(std::memory_order_relaxed)) {
+    return {};
+  }
+
+  // Lost events are pushed with the next direct record: this can run on
+  // another thread
+  PEvent &pevent = pevent_for(tl_state);
+  MPSCRingBufferWriter writer{&pevent.rb};
+  const size_t event_size = sizeof(BatchEvent) + batch_size;
+  auto buffer = writer.reserve(event_size);
+  if (buffer.empty()) {
+    // ring buffer is full, all the staged events are lost
+    _state.lost_count.fetch_add(nb_events, std::memory_order_acq_rel);
+    // not an error
+    return {};
+  }
+
+  auto *event = reinterpret_cast<BatchEvent *>(buffer.data());
+  event->hdr.misc = 0;
+  event->hdr.size = event_size;
+  event->hdr.type = PERF_CUSTOM_EVENT_BATCH;
+  event->sample_id.time = tl_state.batch_first_time;
+  event->sample_id.pid = _state.pid;
+  event->sample_id.tid = tl_state.tid;
+  event->nb_records = nb_records;
+  event->reserved = 0;
+  memcpy(event->data, tl_state.batch.data(), batch_size);
+
+  if (writer.commit(buffer)) {
+    uint64_t count = 1;
+    if (write(pevent.fd, &count, sizeof(count)) != sizeof(count)) {
+      DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFRB,
+                             "Error writing to memory allocation eventfd (%s)",
+                             strerror(errno));
+    }
+  }
+  return {};
+}
+
+void AllocationTracker::flush_batches(PerfClock::time_point max_first_time,
+                                      bool wait) {
+  std::unique_lock lock{_tl_states_lock, std::defer_lock};
+  if (wait) {
+    lock.lock();
+  } else if (!lock.try_lock()) {
+    return;
+  }
+  for (TrackerThreadLocalState *state = _tl_states; state;
+       state = state->next) {
+    std::unique_lock batch_lock{state->batch_lock, std::defer_lock};
+    if (wait) {
+      batch_lock.lock();
+    } else if (!batch_lock.try_lock()) {
+      // the thread is staging a record, it checks the delay itself
+      continue;
+    }
+    if (state->batch_nb_records &&
+        PerfClock::time_point{PerfClock::duration{state->batch_first_time}} <=
+            max_first_time) {
+      flush_batch(*state);
+    }
+  }
+}
+
+void AllocationTracker::flush_stale_batches(PerfClock::time_point now) {
+  // a single thread looks for the batches of idle threads
+  auto next_check = _state.next_batch_check.load(std::memory_order_relaxed);
+  if (now <= next_check ||
+      !_state.next_batch_check.compare_exchange_strong(
+          next_check, now + k_batch_max_delay, std::memory_order_relaxed)) {
+    return;
+  }
+  flush_batches(now - k_batch_max_delay, false);
+}
+
 void AllocationTracker::check_timer(PerfClock::time_point now,
                                     TrackerThreadLocalState &tl_state) {
+  if (_batch_records &&
+      now > _state.next_batch_check.load(std::memory_order_relaxed)) {
+    flush_stale_batches(now);
+  }
   if (tl_state.allocation_allowed &&
       now > _state.next_check_time.load(std::memory_order_acquire)) {
     update_timer(now);
@@ -524,16 +902,15 @@ void AllocationTracker::update_timer(PerfClock::time_point now) {
 }
 
 DDPROF_NOINLINE uint64_t
-AllocationTracker::next_sample_interval(std::minstd_rand &gen) const {
+AllocationTracker::next_sample_interval(xoshiro256ss &gen) const {
   if (_sampling_interval == 1) {
     return 1;
   }
   if (_deterministic_sampling) {
     return _sampling_interval;
   }
-  double const sampling_rate = 1.0 / static_cast<double>(_sampling_interval);
-  std::exponential_distribution<> dist(sampling_rate);
-  double value = dist(gen);
+  double value =
+      static_cast<double>(_sampling_interval) * exponential_sample(gen());
   const size_t max_value = _sampling_interval * 20;
   const size_t min_value = 8;
   if (value > max_value) {
@@ -561,6 +938,9 @@ void AllocationTracker::notify_fork() {
   if (_instance) {
     _instance->_state.pid = getpid();
   }
+  // Other threads do not exist in the child (their locks might be held)
+  _tl_states_lock.unlock();
+  _tl_states = nullptr;
   TrackerThreadLocalState *tl_state = get_tl_state();
   if (unlikely(!tl_state)) {
     // The state should already exist if we forked.
@@ -570,6 +950,12 @@ void AllocationTracker::notify_fork() {
     return;
   }
   tl_state->tid = ddprof::gettid();
+  register_tl_state(tl_state);
+  // staged records belong to the parent (it will push them)
+  tl_state->batch_lock.unlock();
+  tl_state->batch_size = 0;
+  tl_state->batch_nb_records = 0;
+  tl_state->batch_nb_events = 0;
 }
 
 } // namespace ddprof
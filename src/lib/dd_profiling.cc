@@ -371,7 +371,8 @@ int ddprof_start_profiling_internal() {
 
     g_state.profiler_pid = info.pid;
     if (info.allocation_profiling_rate != 0) {
-      uint32_t flags{0};
+      // records are staged per thread to reduce ring buffer contention
+      uint32_t flags{AllocationTracker::kBatchRecords};
       // Negative profiling rate is interpreted as deterministic sampling rate
       if (info.allocation_profiling_rate < 0) {
         flags |= AllocationTracker::kDeterministicSampling;
@@ -382,10 +383,14 @@ int ddprof_start_profiling_internal() {
         // tracking deallocations to allow a live view
         flags |= AllocationTracker::kTrackDeallocations;
       }
+      if (info.allocation_flags & ReplyMessage::kFramePointers) {
+        // walk the stack here instead of copying it
+        flags |= AllocationTracker::kFramePointers;
+      }
 
       if (IsDDResOK(AllocationTracker::allocation_tracking_init(
               info.allocation_profiling_rate, flags, info.stack_sample_size,
-              info.ring_buffer,
+              std::span{info.ring_buffers.data(), info.nb_ring_buffers},
               {update_overrides,
                std::chrono::milliseconds{
                    info.initial_loaded_libs_check_delay_ms},
@@ -63,6 +63,41 @@ save_stack(std::span<const std::byte> stack_bounds, const std::byte *stack_ptr,
 }
 } // namespace
 
+DDPROF_NO_SANITIZER_ADDRESS size_t
+save_callchain(std::span<const std::byte> stack_bounds,
+               std::span<uint64_t> pcs) {
+  if (pcs.empty()) {
+    return 0;
+  }
+  size_t nb_pcs = 0;
+  pcs[nb_pcs++] = reinterpret_cast<uint64_t>(&save_callchain);
+  // A frame record holds the caller frame pointer and the return address
+  const auto *frame =
+      static_cast<const uintptr_t *>(__builtin_frame_address(0));
+  const std::byte *stack_begin = to_address(stack_bounds.begin());
+  const std::byte *stack_end = to_address(stack_bounds.end());
+  while (nb_pcs < pcs.size()) {
+    const auto *frame_start = reinterpret_cast<const std::byte *>(frame);
+    if (frame_start < stack_begin ||
+        frame_start + (2 * sizeof(uintptr_t)) > stack_end ||
+        reinterpret_cast<uintptr_t>(frame) % alignof(uintptr_t)) {
+      break;
+    }
+    const uintptr_t return_address = frame[1];
+    if (!return_address) {
+      break;
+    }
+    pcs[nb_pcs++] = return_address;
+    const auto *caller_frame = reinterpret_cast<const uintptr_t *>(frame[0]);
+    // Stack grows down: the caller frame is above (this also stops on loops)
+    if (caller_frame <= frame) {
+      break;
+    }
+    frame = caller_frame;
+  }
+  return nb_pcs;
+}
+
 size_t save_context(std::span<const std::byte> stack_bounds,
                     std::span<uint64_t, k_perf_register_count> regs,
                     std::span<std::byte> buffer) {
@@ -22,6 +22,7 @@
 #include <ctime>
 #include <dlfcn.h>
 #include <malloc.h>
+#include <memory>
 #include <sys/mman.h>
 #include <unordered_map>
 
@@ -7,54 +7,131 @@
 
 #include "logger.hpp"
 
+#include <algorithm>
+
 namespace ddprof {
 
+namespace {
+// Upper bounds of the lifetime buckets (the last bucket is unbounded)
+constexpr std::array<uint64_t, LiveAllocation::k_nb_lifetime_buckets - 1>
+    k_lifetime_bounds_ns = {1'000,         10'000,        100'000,
+                            1'000'000,     10'000'000,    100'000'000,
+                            1'000'000'000, 10'000'000'000};
+
+constexpr std::array<std::string_view, LiveAllocation::k_nb_lifetime_buckets>
+    k_lifetime_bucket_names = {"<1us",   "<10us", "<100us",
+                               "<1ms",   "<10ms", "<100ms",
+                               "<1s",    "<10s",  ">=10s"};
+} // namespace
+
+unsigned LiveAllocation::lifetime_bucket(uint64_t lifetime_ns) {
+  return static_cast<unsigned>(
+      std::upper_bound(k_lifetime_bounds_ns.begin(),
+                       k_lifetime_bounds_ns.end(), lifetime_ns) -
+      k_lifetime_bounds_ns.begin());
+}
+
+std::string_view LiveAllocation::lifetime_bucket_name(unsigned bucket) {
+  return k_lifetime_bucket_names[bucket];
+}
+
 bool LiveAllocation::register_deallocation(uintptr_t address,
-                                           PprofStacks &stacks,
-                                           AddressMap &address_map) {
+                                           uint64_t timestamp,
+                                           PidStacks &pid_stacks) {
+  AddressMap &address_map = pid_stacks._address_map;
   // Find the ValuePerAddress object corresponding to the address
-  auto map_iter = address_map.find(address);
-  if (map_iter == address_map.end()) {
-    // No element found, nothing to do
-    // This means we lost previous events, leading to de-sync between
-    // the state of the profiler and the state of the library.
+  ValuePerAddress *value = address_map.find(address);
+  if (!value) {
+    // No element found: either we lost previous events, leading to de-sync
+    // between the state of the profiler and the state of the library, or the
+    // allocation is not processed yet (it was pushed to another ring buffer).
     LG_DBG("Unmatched de-allocation at %lx", address);
+    pid_stacks._unmatched_deallocations[address] = timestamp;
     return false;
   }
-  ValuePerAddress const &v = map_iter->second;
+  ValuePerAddress const &v = *value;
 
-  // Decrement count and value of the corresponding PprofStacks::value_type
-  // object
-  if (v._unique_stack) {
-    v._unique_stack->second._value -= v._value;
-    if (v._unique_stack->second._count) {
-      --(v._unique_stack->second._count);
-    }
-    if (!v._unique_stack->second._count) {
-      // If count reaches 0, remove the UnwindOutput from stacks
-      stacks.erase(v._unique_stack->first);
-    }
+  if (v._unique_stack && v._timestamp && timestamp >= v._timestamp) {
+    register_lifetime(v._unique_stack->first, v._value,
+                      timestamp - v._timestamp, pid_stacks._lifetime_stacks);
   }
+  unregister_value(v, pid_stacks._unique_stacks);
 
   // Remove the element from the address map
-  address_map.erase(map_iter);
+  address_map.erase(value);
   return true;
 }
 
-bool LiveAllocation::register_allocation(const UnwindOutput &uo,
+unsigned LiveAllocation::evict_addresses(liveallocation::AddressSlice slice,
+                                         PidStacks &pid_stacks) {
+  const size_t nb_evicted = pid_stacks._address_map.erase_if(
+      [&](uintptr_t address, const ValuePerAddress &v) {
+        if (!slice.contains(address)) {
+          return false;
+        }
+        unregister_value(v, pid_stacks._unique_stacks);
+        return true;
+      });
+  LG_DBG("(LIVE_ALLOC) Evicted %lu addresses (mask=%x, value=%x)", nb_evicted,
+         slice.mask, slice.value);
+  return static_cast<unsigned>(nb_evicted);
+}
+
+void LiveAllocation::unregister_value(const ValuePerAddress &v,
+                                      PprofStacks &stacks) {
+  // Decrement count and value of the corresponding PprofStacks::value_type
+  // object
+  if (!v._unique_stack) {
+    return;
+  }
+  v._unique_stack->second._value -= v._value;
+  if (v._unique_stack->second._count) {
+    --(v._unique_stack->second._count);
+  }
+  if (!v._unique_stack->second._count) {
+    // If count reaches 0, remove the stack
+    erase_stack(stacks, v._unique_stack->first);
+  }
+}
+
+bool LiveAllocation::register_allocation(const StackKey &key,
                                          uintptr_t address, int64_t value,
-                                         PprofStacks &stacks,
-                                         AddressMap &address_map) {
-  if (uo.locs.empty()) {
+                                         uint64_t timestamp,
+                                         bool measure_lifetime,
+                                         PidStacks &pid_stacks) {
+  if (_stack_table.locs(key.stack_id).empty()) {
     // avoid sending empty stacks
     LG_DBG("(LIVE_ALLOC) Avoid registering empty stack");
     return false;
   }
+  if (!address) {
+    // null is the empty key of the address map
+    LG_DBG("(LIVE_ALLOC) Avoid registering null address");
+    return false;
+  }
+  DeallocationMap &deallocations = pid_stacks._unmatched_deallocations;
+  if (unlikely(!deallocations.empty())) {
+    const uint64_t *deallocation_time = deallocations.find(address);
+    // Without timestamps, the events cannot be ordered: assume the free
+    // matches this allocation
+    if (deallocation_time &&
+        (!timestamp || !*deallocation_time ||
+         *deallocation_time >= timestamp)) {
+      // The allocation was already freed
+      LG_DBG("(LIVE_ALLOC) Allocation freed before being processed: %lx",
+             address);
+      deallocations.erase(address);
+      return false;
+    }
+  }
+  PprofStacks &stacks = pid_stacks._unique_stacks;
+  AddressMap &address_map = pid_stacks._address_map;
   // Find or create the PprofStacks::value_type object corresponding to the
-  // UnwindOutput
-  auto iter = stacks.find(uo);
+  // stack
+  auto iter = stacks.find(key);
   if (iter == stacks.end()) {
-    iter = stacks.emplace(uo, ValueAndCount{}).first;
+    iter = stacks.emplace(key, ValueAndCount{}).first;
+    _stack_table.add_ref(key.stack_id);
   }
   PprofStacks::value_type &unique_stack = *iter;
 
@@ -73,16 +150,69 @@ bool LiveAllocation::register_allocation(const UnwindOutput &uo,
       // Should we erase the element here ?
       // only if we are sure it is not the same as the one we are inserting.
       if (v._unique_stack != &unique_stack && !v._unique_stack->second._count) {
-        stacks.erase(v._unique_stack->first);
+        erase_stack(stacks, v._unique_stack->first);
       }
     }
   }
 
   v._value = value;
+  v._timestamp = measure_lifetime ? timestamp : 0;
   v._unique_stack = &unique_stack;
   v._unique_stack->second._value += value;
   ++(v._unique_stack->second._count);
   return true;
 }
 
+void LiveAllocation::register_lifetime(const StackKey &key, int64_t value,
+                                      uint64_t lifetime_ns,
+                                      LifetimeStacks &stacks) {
+  auto iter = stacks.find(key);
+  if (iter == stacks.end()) {
+    iter = stacks.emplace(key, LifetimeHistogram{}).first;
+    _stack_table.add_ref(key.stack_id);
+  }
+  const unsigned bucket = lifetime_bucket(lifetime_ns);
+  iter->second._value[bucket] += value;
+  ++iter->second._count[bucket];
+}
+
+void LiveAllocation::clear_lifetimes() {
+  for (auto &pid_map : _watcher_vector) {
+    for (auto &[pid, pid_stacks] : pid_map) {
+      for (const auto &stack : pid_stacks._lifetime_stacks) {
+        _stack_table.release(stack.first.stack_id);
+      }
+      pid_stacks._lifetime_stacks.clear();
+    }
+  }
+}
+
+void LiveAllocation::clear_unmatched_deallocations() {
+  for (auto &pid_map : _watcher_vector) {
+    for (auto &[pid, pid_stacks] : pid_map) {
+      pid_stacks._unmatched_deallocations.clear();
+    }
+  }
+}
+
+void LiveAllocation::erase_stack(PprofStacks &stacks, StackKey key) {
+  // key is a copy: it can come from the erased element
+  stacks.erase(key);
+  _stack_table.release(key.stack_id);
+}
+
+void LiveAllocation::erase_pid(PidMap &pid_map, pid_t pid) {
+  auto it = pid_map.find(pid);
+  if (it == pid_map.end()) {
+    return;
+  }
+  for (const auto &stack : it->second._unique_stacks) {
+    _stack_table.release(stack.first.stack_id);
+  }
+  for (const auto &stack : it->second._lifetime_stacks) {
+    _stack_table.release(stack.first.stack_id);
+  }
+  pid_map.erase(it);
+}
+
 } // namespace ddprof
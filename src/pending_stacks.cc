@@ -0,0 +1,66 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "pending_stacks.hpp"
+
+#include "ddprof_defs.hpp"
+
+namespace ddprof {
+
+bool PendingStacks::start(pid_t tid, const Interval &interval,
+                          uint64_t &end_time) {
+  ThreadState &state = _threads[state_key(tid, interval.watcher_pos)];
+  if (state.interval.key.stack_id != k_stack_id_null) {
+    // the end of the previous interval was lost
+    _stack_table.release(state.interval.key.stack_id);
+    state.interval = {};
+  }
+  if (state.unmatched_end_time > interval.start_time) {
+    end_time = state.unmatched_end_time;
+    state.unmatched_end_time = 0;
+    return true;
+  }
+  state.interval = interval;
+  return false;
+}
+
+bool PendingStacks::finish(pid_t tid, int watcher_pos, uint64_t end_time,
+                           Interval &interval) {
+  ThreadState &state = _threads[state_key(tid, watcher_pos)];
+  if (state.interval.key.stack_id == k_stack_id_null ||
+      end_time < state.interval.start_time) {
+    // the start is not processed yet
+    state.unmatched_end_time = end_time;
+    return false;
+  }
+  interval = state.interval;
+  state.interval = {};
+  state.unmatched_end_time = 0;
+  return true;
+}
+
+void PendingStacks::erase(pid_t tid) {
+  for (size_t watcher_pos = 0; watcher_pos < kMaxTypeWatcher; ++watcher_pos) {
+    auto it = _threads.find(state_key(tid, static_cast<int>(watcher_pos)));
+    if (it == _threads.end()) {
+      continue;
+    }
+    if (it->second.interval.key.stack_id != k_stack_id_null) {
+      _stack_table.release(it->second.interval.key.stack_id);
+    }
+    _threads.erase(it);
+  }
+}
+
+void PendingStacks::clear() {
+  for (auto &[tid, state] : _threads) {
+    if (state.interval.key.stack_id != k_stack_id_null) {
+      _stack_table.release(state.interval.key.stack_id);
+    }
+  }
+  _threads.clear();
+}
+
+} // namespace ddprof
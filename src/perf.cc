@@ -96,6 +96,20 @@ perf_event_attr perf_config_from_watcher(const PerfWatcher *watcher,
   attr.freq = watcher->options.is_freq;
   attr.sample_type = watcher->sample_type;
   attr.sample_stack_user = watcher->options.stack_sample_size;
+  if (watcher->sample_type & PERF_SAMPLE_CALLCHAIN) {
+    // user frames walked by the kernel
+    attr.sample_max_stack = watcher->options.max_stack;
+    attr.exclude_callchain_kernel = 1;
+  }
+  if (!(watcher->sample_type & PERF_SAMPLE_STACK_USER)) {
+    attr.sample_stack_user = 0;
+    attr.sample_regs_user = 0;
+  }
+  // Records of threads switched in end the off-CPU intervals
+  attr.context_switch = watcher->options.off_cpu;
+  if (watcher->options.counter_group) {
+    attr.read_format = k_perf_read_format;
+  }
 
   // If use_kernel==off means we exclude_kernel
   attr.exclude_kernel =
@@ -116,35 +130,62 @@ perf_event_attr perf_config_from_watcher(const PerfWatcher *watcher,
   return attr;
 }
 
+perf_event_attr perf_config_group_member(const perf_event_attr &leader,
+                                         uint64_t config) {
+  // Not sampled: counts while the leader is scheduled
+  perf_event_attr attr = {};
+  attr.size = sizeof(struct perf_event_attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.read_format = leader.read_format;
+  attr.inherit = leader.inherit;
+  attr.exclude_kernel = leader.exclude_kernel;
+  attr.exclude_hv = leader.exclude_hv;
+  return attr;
+}
+
 size_t perf_mmap_size(int buf_size_shift) {
   // size of buffers are constrained to a power of 2 + 1
   return ((1U << buf_size_shift) + 1) * get_page_size();
 }
 
-size_t get_mask_from_size(size_t size) {
+size_t get_mask_from_size(size_t size, size_t meta_size) {
   // assumption is that we used a (power of 2) + 1 (refer to perf_mmap_size)
-  return (size - get_page_size() - 1);
+  return (size - meta_size - 1);
 }
 
-void *perfown_sz(int fd, size_t size_of_buffer) {
+void *perfown_sz(int fd, size_t size_of_buffer, size_t meta_size) {
   // Map in the region representing the ring buffer, map the buffer twice
   // (minus metadata size) to avoid handling boundaries.
-  size_t const total_length = 2 * size_of_buffer - get_page_size();
-  // Reserve twice the size of the buffer
-  void *region = mmap(nullptr, total_length, PROT_NONE,
-                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-  if (MAP_FAILED == region || !region) {
+  size_t const total_length = 2 * size_of_buffer - meta_size;
+  // Reserve twice the size of the buffer, aligned on meta_size (huge pages
+  // are only mapped at aligned addresses)
+  size_t const slack = meta_size - get_page_size();
+  void *reservation = mmap(nullptr, total_length + slack, PROT_NONE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (MAP_FAILED == reservation || !reservation) {
     return nullptr;
   }
+  auto const reservation_addr = reinterpret_cast<uintptr_t>(reservation);
+  size_t const head =
+      ((reservation_addr + meta_size - 1) & ~(meta_size - 1)) -
+      reservation_addr;
+  auto *ptr = static_cast<std::byte *>(reservation) + head;
+  if (head) {
+    munmap(reservation, head);
+  }
+  if (slack > head) {
+    munmap(ptr + total_length, slack - head);
+  }
+  void *region = ptr;
 
-  auto defer_munmap = make_defer([&]() { perfdisown(region, size_of_buffer); });
-
-  auto *ptr = static_cast<std::byte *>(region);
+  auto defer_munmap = make_defer(
+      [&]() { perfdisown(region, size_of_buffer, meta_size); });
 
   // Each mapping of fd must have a size of 2^n+1 pages
   // That's why starts by mapping buffer on the second half of reserved
   // space and ensure that metadata page overlaps on the first part
-  if (mmap(ptr + size_of_buffer - get_page_size(), size_of_buffer,
+  if (mmap(ptr + size_of_buffer - meta_size, size_of_buffer,
            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd,
            0) == MAP_FAILED) {
     return nullptr;
@@ -166,12 +207,11 @@ void *perfown_sz(int fd, size_t size_of_buffer) {
   return region;
 }
 
-int perfdisown(void *region, size_t size) {
+int perfdisown(void *region, size_t size, size_t meta_size) {
   auto *ptr = static_cast<std::byte *>(region);
 
-  return (munmap(ptr + size - get_page_size(), size) == 0) &&
-          (munmap(ptr, size) == 0) &&
-          (munmap(ptr, 2 * size - get_page_size()) == 0)
+  return (munmap(ptr + size - meta_size, size) == 0) &&
+          (munmap(ptr, size) == 0) && (munmap(ptr, 2 * size - meta_size) == 0)
       ? 0
       : -1;
 }
@@ -189,6 +229,14 @@ all_perf_configs_from_watcher(const PerfWatcher *watcher, bool extras,
     attr.exclude_kernel = true;
     ret_attr.push_back(attr);
   }
+  if (watcher->options.counter_group) {
+    // Kernels before 6.13 do not read the counters of inherited events: new
+    // threads of the target are then not followed
+    for (size_t i = 0, nb_inherited = ret_attr.size(); i < nb_inherited; ++i) {
+      ret_attr.push_back(ret_attr[i]);
+      ret_attr.back().inherit = 0;
+    }
+  }
   return ret_attr;
 }
 
@@ -199,7 +247,7 @@ uint64_t perf_value_from_sample(const PerfWatcher *watcher,
     if (PERF_SAMPLE_RAW & watcher->sample_type) {
       uint64_t const raw_offset = watcher->raw_off;
       uint64_t const raw_sz = watcher->raw_sz;
-      if (raw_sz + raw_offset <= sample->size_raw) {
+      if (raw_sz + raw_offset > sample->size_raw) {
         assert(0 && "Overflow in raw event access");
         LG_WRN("Overflow in raw event access");
         return 0;
@@ -5,6 +5,7 @@
 
 #include "perf_mainloop.hpp"
 
+#include "ddprof.hpp"
 #include "ddprof_context_lib.hpp"
 #include "ddprof_worker.hpp"
 #include "ddres.hpp"
@@ -14,6 +15,7 @@
 #include "perf.hpp"
 #include "persistent_worker_state.hpp"
 #include "pevent.hpp"
+#include "pevent_lib.hpp"
 #include "ringbuffer_utils.hpp"
 #include "unique_fd.hpp"
 #include "unwind.h"
@@ -73,7 +75,8 @@ void modify_sigprocmask(int how) {
   sigprocmask(how, &mask, nullptr);
 }
 
-DDRes spawn_workers(PersistentWorkerState *persistent_worker_state,
+DDRes spawn_workers(DDProfContext &ctx,
+                    PersistentWorkerState *persistent_worker_state,
                     bool *is_worker) {
   *is_worker = false;
 
@@ -111,6 +114,17 @@ DDRes spawn_workers(PersistentWorkerState *persistent_worker_state,
       }
     }
     LG_NFO("Refreshing worker process");
+    // Size the ring buffers from their usage by the previous worker (before
+    // opening new CPUs, their buffers were not used yet)
+    if (IsDDResNotOK(pevent_adapt_ring_buffers(
+            ctx, &ctx.worker_ctx.pevent_hdr,
+            persistent_worker_state->ring_buffer_usage))) {
+      LG_WRN("Unable to resize the ring buffers");
+    }
+    // Follow the affinity changes of the target before starting the worker
+    if (IsDDResNotOK(ddprof_open_new_cpus(ctx))) {
+      LG_WRN("Unable to instrument the new CPUs of the target");
+    }
   }
 
   return {};
@@ -125,17 +139,19 @@ ReplyMessage create_reply_message(const DDProfContext &ctx) {
   if (alloc_watcher_idx != -1) {
     std::span const pevents{ctx.worker_ctx.pevent_hdr.pes,
                             ctx.worker_ctx.pevent_hdr.size};
-    auto event_it =
-        std::find_if(pevents.begin(), pevents.end(),
-                     [alloc_watcher_idx](const auto &pevent) {
-                       return pevent.watcher_pos == alloc_watcher_idx;
-                     });
-    if (event_it != pevents.end()) {
-      reply.ring_buffer.event_fd = event_it->fd;
-      reply.ring_buffer.ring_fd = event_it->mapfd;
-      reply.ring_buffer.mem_size = event_it->ring_buffer_size;
-      reply.ring_buffer.ring_buffer_type =
-          static_cast<int>(event_it->ring_buffer_type);
+    // Advertise all the ring buffers of the allocation watcher
+    for (const PEvent &pevent : pevents) {
+      if (pevent.watcher_pos != alloc_watcher_idx ||
+          reply.nb_ring_buffers == reply.ring_buffers.size()) {
+        continue;
+      }
+      RingBufferInfo &info = reply.ring_buffers[reply.nb_ring_buffers++];
+      info.event_fd = pevent.fd;
+      info.ring_fd = pevent.mapfd;
+      info.mem_size = pevent.ring_buffer_size;
+      info.ring_buffer_type = static_cast<int>(pevent.ring_buffer_type);
+    }
+    if (reply.nb_ring_buffers) {
       reply.allocation_profiling_rate =
           ctx.watchers[alloc_watcher_idx].sample_period;
       reply.stack_sample_size =
@@ -145,10 +161,15 @@ ReplyMessage create_reply_message(const DDProfContext &ctx) {
       reply.loaded_libs_check_interval_ms =
           ctx.params.loaded_libs_check_interval.count();
 
+      // Lifetimes are measured on matched allocations and deallocations
       if (Any(ctx.watchers[alloc_watcher_idx].aggregation_mode &
-              EventAggregationMode::kLiveSum)) {
+              (EventAggregationMode::kLiveSum |
+               EventAggregationMode::kLifetime))) {
         reply.allocation_flags |= ReplyMessage::kLiveSum;
       }
+      if (ctx.watchers[alloc_watcher_idx].options.frame_pointers) {
+        reply.allocation_flags |= ReplyMessage::kFramePointers;
+      }
     }
   }
 
@@ -184,6 +205,18 @@ struct EventWrapper {
 using EventQueue = std::priority_queue<EventWrapper, std::vector<EventWrapper>,
                                        std::greater<EventWrapper>>;
 
+// Record how full a perf ring buffer gets and the events it lost, to size it
+// for the next worker
+void track_ring_buffer_fill(RingBufferUsage &usage, const RingBuffer &rb) {
+  usage.max_used_size = std::max(usage.max_used_size, perf_rb_used_size(rb));
+}
+
+void track_lost_events(RingBufferUsage &usage, const perf_event_header *hdr) {
+  if (hdr->type == PERF_RECORD_LOST) {
+    usage.lost += reinterpret_cast<const perf_event_lost *>(hdr)->lost;
+  }
+}
+
 DDRes worker_process_ring_buffers_ordered(std::span<PEvent> pes,
                                           DDProfContext &ctx,
                                           EventQueue &event_queue, bool drain) {
@@ -225,6 +258,8 @@ DDRes worker_process_ring_buffers_ordered(std::span<PEvent> pes,
 
   const std::chrono::microseconds kMaxSampleLatency{100};
 
+  RingBufferUsage *usages =
+      ctx.worker_ctx.persistent_worker_state->ring_buffer_usage;
   auto now = PerfClock::now();
   auto deadline =
       drain ? PerfClock::time_point::max() : now + k_sample_default_wakeup;
@@ -242,6 +277,7 @@ DDRes worker_process_ring_buffers_ordered(std::span<PEvent> pes,
       if (rb.type == RingBufferType::kPerfRingBuffer) {
         // if perf ring buffer has already events in the priority queue, skip it
         if (!perf_rb_has_inflight_events(rb)) {
+          track_ring_buffer_fill(usages[i], rb);
           const perf_event_header *event = perf_rb_read_event(rb);
           if (event) {
             auto timestamp = perf_clock_time_point_from_timestamp(
@@ -283,6 +319,7 @@ DDRes worker_process_ring_buffers_ordered(std::span<PEvent> pes,
 
       auto &rb = pevent.rb;
       if (rb.type == RingBufferType::kPerfRingBuffer) {
+        track_lost_events(usages[evt.buffer_idx], evt.event);
         // advance ring buffer, this frees space for the writer end
         perf_rb_advance(rb);
 
@@ -319,18 +356,23 @@ worker_process_ring_buffers(std::span<PEvent> pes, DDProfContext &ctx,
   auto loop_start = std::chrono::steady_clock::now();
   std::chrono::steady_clock::time_point local_now;
 
+  RingBufferUsage *usages =
+      ctx.worker_ctx.persistent_worker_state->ring_buffer_usage;
   bool events;
   do {
     events = false;
-    for (auto &pevent : pes) {
+    for (size_t i = 0; i < pes.size(); ++i) {
+      auto &pevent = pes[i];
       auto &ring_buffer = pevent.rb;
       if (ring_buffer.type == RingBufferType::kPerfRingBuffer) {
+        track_ring_buffer_fill(usages[i], ring_buffer);
         PerfRingBufferReader reader(&ring_buffer);
 
         ConstBuffer buffer = reader.read_all_available();
         while (!buffer.empty()) {
           const auto *hdr =
               reinterpret_cast<const perf_event_header *>(buffer.data());
+          track_lost_events(usages[i], hdr);
           DDRes res = ddprof_worker_process_event(hdr, pevent.watcher_pos, ctx);
 
           // Check for processing error
@@ -483,7 +525,7 @@ DDRes main_loop(const WorkerAttr *attr, DDProfContext *ctx) {
   // Create worker processes to fulfill poll loop.  Only the parent process
   // can exit with an error code, which signals the termination of profiling.
   bool is_worker = false;
-  DDRes res = spawn_workers(persistent_worker_state, &is_worker);
+  DDRes res = spawn_workers(*ctx, persistent_worker_state, &is_worker);
   if (IsDDResNotOK(res)) {
     return res;
   }
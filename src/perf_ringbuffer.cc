@@ -15,14 +15,13 @@
 namespace ddprof {
 
 bool rb_init(RingBuffer *rb, void *base, size_t size,
-             RingBufferType ring_buffer_type) {
-  rb->meta_size = get_page_size();
+             RingBufferType ring_buffer_type, size_t meta_size) {
+  rb->meta_size = meta_size;
   rb->base = base;
   rb->data = reinterpret_cast<std::byte *>(base) + rb->meta_size;
   rb->data_size = size - rb->meta_size;
-  rb->mask = get_mask_from_size(size);
+  rb->mask = get_mask_from_size(size, meta_size);
   rb->type = ring_buffer_type;
-  rb->spinlock = nullptr;
 
   switch (ring_buffer_type) {
   case RingBufferType::kPerfRingBuffer: {
@@ -35,7 +34,6 @@ bool rb_init(RingBuffer *rb, void *base, size_t size,
     auto *meta = reinterpret_cast<MPSCRingBufferMetaDataPage *>(rb->base);
     rb->reader_pos = &meta->reader_pos;
     rb->writer_pos = &meta->writer_pos;
-    rb->spinlock = &meta->spinlock;
     rb->perf_clock_source = meta->perf_clock_source;
     rb->time_mult = meta->time_mult;
     rb->time_shift = meta->time_shift;
@@ -128,13 +126,14 @@ bool samp2hdr(perf_event_header *hdr, const perf_event_sample *sample,
     SZ_CHECK;
   }
   if (PERF_SAMPLE_READ & mask) {
-    *(reinterpret_cast<struct read_format *>(buf)) = *sample->v;
-    buf += sizeof(struct read_format) /
-        sizeof(size_t); // read_format is uint64_t's
-    sz += sizeof(struct read_format);
+    size_t const read_sz =
+        sizeof(struct read_format) + sample->v->nr * sizeof(struct read_value);
+    sz += read_sz;
     if (sz >= sz_hdr) {
       return false;
     }
+    memcpy(buf, sample->v, read_sz);
+    buf += read_sz / sizeof(*buf); // read_format is uint64_t's
   }
   if (PERF_SAMPLE_CALLCHAIN & mask) {
     *buf++ = sample->nr;
@@ -145,7 +144,7 @@ bool samp2hdr(perf_event_header *hdr, const perf_event_sample *sample,
     if (sz >= sz_hdr) {
       return false;
     }
-    memcpy(buf, sample->ips, sample->nr);
+    memcpy(buf, sample->ips, sample->nr * sizeof(*buf));
     buf += sample->nr;
   }
   if (PERF_SAMPLE_RAW & mask) {
@@ -197,6 +196,8 @@ bool samp2hdr(perf_event_header *hdr, const perf_event_sample *sample,
 
 perf_event_sample *hdr2samp(const perf_event_header *hdr, uint64_t mask) {
   static perf_event_sample sample = {};
+  // fields absent from the mask must not come from a previous sample
+  sample = {};
   sample.header = *hdr;
 
   const auto *buf =
@@ -234,7 +235,9 @@ perf_event_sample *hdr2samp(const perf_event_header *hdr, uint64_t mask) {
     sample.period = *buf++;
   }
   if (PERF_SAMPLE_READ & mask) {
-    sample.v = reinterpret_cast<const struct read_format *>(buf++);
+    // counter group (k_perf_read_format)
+    sample.v = reinterpret_cast<const struct read_format *>(buf);
+    buf += 1 + (sample.v->nr * sizeof(struct read_value) / sizeof(*buf));
   }
 
   if (PERF_SAMPLE_CALLCHAIN & mask) {
@@ -326,7 +329,9 @@ uint64_t hdr_time(const perf_event_header *hdr, uint64_t mask) {
   case PERF_RECORD_COMM:
   case PERF_RECORD_EXIT:
   case PERF_RECORD_FORK:
-  case PERF_RECORD_LOST: {
+  case PERF_RECORD_LOST:
+  case PERF_RECORD_SWITCH:
+  case PERF_RECORD_SWITCH_CPU_WIDE: {
     auto nb_fields_after = std::popcount(
         mask &
         (PERF_SAMPLE_TIME | PERF_SAMPLE_ID | PERF_SAMPLE_STREAM_ID |
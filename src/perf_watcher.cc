@@ -19,18 +19,18 @@ namespace ddprof {
 
 uint64_t perf_event_default_sample_type() { return BASE_STYPES; }
 
-#define X_STR(a, b, c, d, e) std::array{b, d},
+#define X_STR(a, b, c, d, e, f) std::array{b, d, f},
 const char *sample_type_name_from_idx(int idx, EventAggregationModePos pos) {
   static constexpr std::array<
       std::array<const char *, kNbEventAggregationModes>, DDPROF_PWT_LENGTH + 1>
-      sample_names = {PROFILE_TYPE_TABLE(X_STR){nullptr, nullptr}};
+      sample_names = {PROFILE_TYPE_TABLE(X_STR){nullptr, nullptr, nullptr}};
   if (idx < 0 || idx >= DDPROF_PWT_LENGTH) {
     return nullptr;
   }
   return sample_names[idx][pos];
 }
 #undef X_STR
-#define X_STR(a, b, c, d, e) #c,
+#define X_STR(a, b, c, d, e, f) #c,
 const char *sample_type_unit_from_idx(int idx) {
   static const char *sample_units[] = {PROFILE_TYPE_TABLE(X_STR)};
   if (idx < 0 || idx >= DDPROF_PWT_LENGTH) {
@@ -39,7 +39,7 @@ const char *sample_type_unit_from_idx(int idx) {
   return sample_units[idx];
 }
 #undef X_STR
-#define X_DEP(a, b, c, d, e) DDPROF_PWT_##e,
+#define X_DEP(a, b, c, d, e, f) DDPROF_PWT_##e,
 int sample_type_id_to_count_sample_type_id(int idx) {
   static const int count_ids[] = {PROFILE_TYPE_TABLE(X_DEP)};
   if (idx < 0 || idx >= DDPROF_PWT_LENGTH) {
@@ -69,6 +69,7 @@ bool watcher_has_countable_sample_type(const PerfWatcher *watcher) {
       .tracepoint_event = "",                                                  \
       .tracepoint_group = "",                                                  \
       .tracepoint_label = "",                                                  \
+      .tracepoint_filter = "",                                                 \
       .ddprof_event_type = DDPROF_PWE_##a,                                     \
       .type = (c),                                                             \
       .sample_frequency = (e),                                                 \
@@ -77,6 +78,7 @@ bool watcher_has_countable_sample_type(const PerfWatcher *watcher) {
       .aggregation_mode = EventAggregationMode::kSum,                          \
       .options = g,                                                            \
       .pprof_indices = {},                                                     \
+      .counter_pprof_indices = {},                                             \
       .regno = 0,                                                              \
       .raw_off = 0,                                                            \
       .raw_sz = 0,                                                             \
@@ -132,6 +134,7 @@ const PerfWatcher *tracepoint_default_watcher() {
       .tracepoint_event = {},
       .tracepoint_group = {},
       .tracepoint_label = {},
+      .tracepoint_filter = {},
       .ddprof_event_type = DDPROF_PWE_TRACEPOINT,
       .type = PERF_TYPE_TRACEPOINT,
       .sample_period = 1,
@@ -140,6 +143,7 @@ const PerfWatcher *tracepoint_default_watcher() {
       .aggregation_mode = EventAggregationMode::kSum,
       .options = {.use_kernel = PerfWatcherUseKernel::kRequired},
       .pprof_indices = {},
+      .counter_pprof_indices = {},
       .regno = 0,
       .raw_off = 0,
       .raw_sz = 0,
@@ -187,7 +191,20 @@ void log_watcher(const PerfWatcher *w, int idx) {
   PRINT_NFO("    EventName: %s, GroupName: %s, Label: %s",
             w->tracepoint_event.c_str(), w->tracepoint_group.c_str(),
             w->tracepoint_label.c_str());
+  if (!w->tracepoint_filter.empty()) {
+    PRINT_NFO("    Filter: %s", w->tracepoint_filter.c_str());
+  }
   PRINT_NFO("    Sample user Stack Size: %u", w->options.stack_sample_size);
+  if (w->options.frame_pointers) {
+    PRINT_NFO("    Unwinding: frame pointers (max stack %u)",
+              static_cast<unsigned>(w->options.max_stack));
+  } else if (w->options.hybrid_unwind) {
+    PRINT_NFO("    Unwinding: hybrid (max stack %u)",
+              static_cast<unsigned>(w->options.max_stack));
+  }
+  if (w->options.huge_pages) {
+    PRINT_NFO("    Ring buffers: huge pages");
+  }
 
   if (w->options.is_freq) {
     PRINT_NFO("    Cadence: Freq, Freq: %lu", w->sample_frequency);
@@ -200,6 +217,9 @@ void log_watcher(const PerfWatcher *w, int idx) {
   if (Any(EventAggregationMode::kLiveSum & w->aggregation_mode)) {
     PRINT_NFO("    Outputting live usage");
   }
+  if (Any(EventAggregationMode::kLifetime & w->aggregation_mode)) {
+    PRINT_NFO("    Outputting allocation lifetimes");
+  }
 }
 
 std::string_view watcher_help_text() {
@@ -219,12 +239,18 @@ std::string_view watcher_help_text() {
 "----------------\n"
 "1. CPU profiling with a custom sampling frequency: -e \"sCPU p=50\"\n"
 "2. Live Allocation Tracking (leak detection):\n"
-"  -e sALLOC,mode=l\n\n"
+"  -e sALLOC,mode=l\n"
+"3. Allocation lifetimes (short-lived allocations), next to allocations:\n"
+"  -e sALLOC,mode=st\n"
+"4. Large reads only (filtered in the kernel):\n"
+"  -e \"e=syscalls:sys_enter_read filter='count > 65536'\"\n\n"
 "Event Types:\n"
 "------------\n"
 "The most common types are:\n"
 "- sCPU for CPU Time \n"
 "- sALLOC for allocations (only available in wrapper mode) \n"
+"- hIPC for CPU cycles, with the instructions and cache misses of the sampled stacks (in PID mode, threads created after the start of the profiler are only followed from Linux 6.13) \n"
+"- sSYSCALL for the time spent in syscalls, labeled by syscall \n"
 "Please consult the `https://github.com/DataDog/ddprof/blob/main/include/perf_watcher.hpp#L117-L138` for an up to date list of available events. \n"
 "Note: Some events may require hardware support and elevated permissions.\n\n"
 "Configuration Keys:\n"
@@ -240,8 +266,12 @@ std::string_view watcher_help_text() {
 "- `p|period|per`: Period of the event.\n"
 "- `r|register|regno`: Register to retrieve the value associated with this event.\n"
 "- `st|stack_sample_size|stcksz : Same as the stack_sample_size input option for this event."
+"- `u|unwind`: `fp` to walk frame pointers (in the profiled process for allocations, by the kernel for other events), `dwarf` (default) to copy the stack, `hybrid` to copy a small stack for the leaf frames and walk frame pointers in the kernel for the others.\n"
+"- `max_stack|maxstack`: Maximum depth of the stacks walked by the kernel (`u=fp` or `u=hybrid`).\n"
 "- `o|raw_offset|rawoff`: Raw offset to retrieve the value associated with this event.\n"
-"- `z|raw_size|rawsz`: Raw size associated to raw offset.\n\n"
+"- `z|raw_size|rawsz`: Raw size associated to raw offset.\n"
+"- `filter|flt`: Quoted filter on the fields of a tracepoint, evaluated in the kernel (eg. filter='count > 65536').\n"
+"- `huge_pages|hugepages`: 1 to back the ring buffers of allocation events with huge pages (if available).\n\n"
 "Disclaimer:\n"
 "-----------\n"
 "Please note that this documentation is currently under construction. We recommend the use of presets.\n"
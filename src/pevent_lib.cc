@@ -6,6 +6,7 @@
 #include "pevent_lib.hpp"
 
 #include "ddprof_cmdline.hpp"
+#include "ddprof_cpumask.hpp"
 #include "ddres.hpp"
 #include "defer.hpp"
 #include "lib/allocation_event.hpp"
@@ -16,17 +17,25 @@
 #include "tracepoint_config.hpp"
 #include "user_override.hpp"
 
+#include <algorithm>
+#include <bit>
 #include <cassert>
 #include <cerrno>
 #include <cstddef>
 #include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <string>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 
 namespace ddprof {
 
 namespace {
+constexpr std::string_view k_cgroup_root = "/sys/fs/cgroup/";
+
 DDRes pevent_create(PEventHdr *pevent_hdr, int watcher_idx,
                     size_t *pevent_idx) {
   if (pevent_hdr->size >= pevent_hdr->max_size) {
@@ -49,14 +58,28 @@ void display_system_config() {
   }
 }
 
+// Size of the stack data of the samples of a watcher: the copy of the user
+// stack and / or the callchain walked by the kernel (nr, the context marker
+// and the pcs)
+uint32_t watcher_stack_data_size(const PerfWatcher &watcher) {
+  uint32_t size = 0;
+  if (watcher.sample_type & PERF_SAMPLE_STACK_USER) {
+    size += watcher.options.stack_sample_size;
+  }
+  if (watcher.sample_type & PERF_SAMPLE_CALLCHAIN) {
+    size += (watcher.options.max_stack + 2) * sizeof(uint64_t);
+  }
+  return size;
+}
+
 // set info for a perf_event_open type of buffer
 void pevent_set_info(int fd, int attr_idx, PEvent &pevent,
-                     uint32_t stack_sample_size) {
+                     uint32_t stack_data_size) {
   static bool log_once = true;
   pevent.fd = fd;
   pevent.mapfd = fd;
   int const buffer_size_order = pevent_compute_min_mmap_order(
-      k_default_buffer_size_shift, stack_sample_size,
+      k_default_buffer_size_shift, stack_data_size,
       k_min_number_samples_per_ring_buffer);
   if (buffer_size_order > k_default_buffer_size_shift && log_once) {
     LG_NTC("Increasing size order of the ring buffer to %d (from %d)",
@@ -69,10 +92,91 @@ void pevent_set_info(int fd, int attr_idx, PEvent &pevent,
   pevent.attr_idx = attr_idx;
 }
 
-DDRes pevent_register_cpu_0(const PerfWatcher *watcher, int watcher_idx,
-                            pid_t pid, PerfClockSource perf_clock_source,
-                            PEventHdr *pevent_hdr, size_t &pevent_idx) {
-  // register cpu 0 and find a working config
+// Install the in-kernel filter of a tracepoint watcher: events that do not
+// match never reach the ring buffer
+DDRes pevent_set_filter(const PerfWatcher *watcher, int fd) {
+  if (watcher->tracepoint_filter.empty()) {
+    return {};
+  }
+  if (ioctl(fd, PERF_EVENT_IOC_SET_FILTER,
+            watcher->tracepoint_filter.c_str()) == -1) {
+    DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFOPEN,
+                           "Invalid filter \"%s\" for watcher %s (%s)",
+                           watcher->tracepoint_filter.c_str(),
+                           watcher->desc.c_str(), strerror(errno));
+  }
+  return {};
+}
+
+// Open the counters read with the samples of a counter group leader
+DDRes pevent_open_group_members(const perf_event_attr &leader_attr,
+                                int leader_fd, pid_t pid, int cpu,
+                                unsigned long flags, PEvent &pevent) {
+  if (!(leader_attr.read_format & PERF_FORMAT_GROUP)) {
+    return {};
+  }
+  for (const auto &member : k_counter_group_members) {
+    perf_event_attr attr = perf_config_group_member(leader_attr, member.config);
+    int const fd = perf_event_open(&attr, pid, cpu, leader_fd, flags);
+    if (fd == -1) {
+      DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFOPEN,
+                             "Error opening counter %lu of group (%s)",
+                             member.config, strerror(errno));
+    }
+    pevent.group_fds.push_back(fd);
+  }
+  return {};
+}
+
+// Syscall time watchers also sample the syscall exits (without copying the
+// stack), to the ring buffer of the syscall entries
+DDRes pevent_open_syscall_exit(const PerfWatcher *watcher,
+                               const perf_event_attr &enter_attr, pid_t pid,
+                               int cpu, unsigned long flags, PEvent &pevent) {
+  if (!watcher->options.syscall_time) {
+    return {};
+  }
+  static const int64_t exit_id =
+      tracepoint_get_id("raw_syscalls", "sys_exit");
+  if (exit_id == -1) {
+    DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFOPEN,
+                           "Unable to find the sys_exit tracepoint");
+  }
+  perf_event_attr attr = enter_attr;
+  attr.config = exit_id;
+  // every exit is needed to end the sampled entries
+  attr.sample_period = 1;
+  attr.freq = 0;
+  attr.sample_stack_user = 0;
+  // process state is tracked by the entry event
+  attr.mmap = 0;
+  attr.mmap2 = 0;
+  attr.task = 0;
+  attr.comm = 0;
+  int const fd = perf_event_open(&attr, pid, cpu, -1, flags);
+  if (fd == -1) {
+    DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFOPEN,
+                           "Error opening sys_exit for watcher %s (%s)",
+                           watcher->desc.c_str(), strerror(errno));
+  }
+  pevent.sub_fds.push_back(fd);
+  // Exits of filtered out entries are ignored by the worker: the filter only
+  // saves their records, if its fields also exist on sys_exit (id)
+  if (!watcher->tracepoint_filter.empty() &&
+      ioctl(fd, PERF_EVENT_IOC_SET_FILTER,
+            watcher->tracepoint_filter.c_str()) == -1) {
+    LG_DBG("Filter \"%s\" of watcher %s does not apply to sys_exit (%s)",
+           watcher->tracepoint_filter.c_str(), watcher->desc.c_str(),
+           strerror(errno));
+  }
+  return {};
+}
+
+DDRes pevent_register_cpu(const PerfWatcher *watcher, int watcher_idx,
+                          pid_t pid, int cpu, unsigned long flags,
+                          PerfClockSource perf_clock_source,
+                          PEventHdr *pevent_hdr, size_t &pevent_idx) {
+  // register the first cpu and find a working config
   PEvent *pes = pevent_hdr->pes;
   std::vector<perf_event_attr> perf_event_data =
       all_perf_configs_from_watcher(watcher, true, perf_clock_source);
@@ -80,15 +184,26 @@ DDRes pevent_register_cpu_0(const PerfWatcher *watcher, int watcher_idx,
 
   // attempt with different configs
   for (auto &attr : perf_event_data) {
-    // register cpu 0
-    int const fd = perf_event_open(&attr, pid, 0, -1, PERF_FLAG_FD_CLOEXEC);
+    int const fd = perf_event_open(&attr, pid, cpu, -1, flags);
     if (fd != -1) {
       // Copy the successful config
       pevent_hdr->attrs[pevent_hdr->nb_attrs] = attr;
       pevent_set_info(fd, pevent_hdr->nb_attrs, pes[pevent_idx],
-                      watcher->options.stack_sample_size);
+                      watcher_stack_data_size(*watcher));
       ++pevent_hdr->nb_attrs;
       assert(pevent_hdr->nb_attrs <= kMaxTypeWatcher);
+      DDRES_CHECK_FWD(pevent_set_filter(watcher, fd));
+      DDRES_CHECK_FWD(pevent_open_group_members(attr, fd, pid, cpu, flags,
+                                                pes[pevent_idx]));
+      DDRES_CHECK_FWD(pevent_open_syscall_exit(watcher, attr, pid, cpu, flags,
+                                               pes[pevent_idx]));
+      if (watcher->options.counter_group && !attr.inherit && pid != -1 &&
+          !(flags & PERF_FLAG_PID_CGROUP)) {
+        // CPU wide events (global and cgroup modes) are not affected
+        LG_NTC("Counters of watcher %s are not inherited (requires Linux "
+               "6.13): threads created later are not profiled",
+               watcher->desc.c_str());
+      }
       break;
     }
     LG_NFO("Expected failure (we retry with different settings) "
@@ -100,65 +215,214 @@ DDRes pevent_register_cpu_0(const PerfWatcher *watcher, int watcher_idx,
   // check if one of the configs was successful
   if (pes[pevent_idx].attr_idx == -1) {
     display_system_config();
-    DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFOPEN,
-                           "Error calling perf_event_open on watcher %d.0 (%s)",
-                           watcher_idx, strerror(errno));
+    DDRES_RETURN_ERROR_LOG(
+        DD_WHAT_PERFOPEN, "Error calling perf_event_open on watcher %d.%d (%s)",
+        watcher_idx, cpu, strerror(errno));
   }
 
   return {};
 }
 
+// do perf_event_open for the other tids, but record them as sub fds
+// attached to the first. These are not mmaped, but their output will
+// be redirected to the first one.
+void pevent_open_sub_fds(const PerfWatcher *watcher, perf_event_attr *attr,
+                         int watcher_idx, std::span<pid_t> tids, int cpu,
+                         unsigned long flags, PEvent &pevent) {
+  for (auto tid : tids) {
+    int const fd = perf_event_open(attr, tid, cpu, -1, flags);
+    if (fd == -1) {
+      // Ignore failure, thread may have exited
+      LG_WRN("Error calling perf_event_open on watcher %d.%d (%s) for tid %d",
+             watcher_idx, cpu, strerror(errno), tid);
+    } else if (!IsDDResOK(pevent_set_filter(watcher, fd))) {
+      // unfiltered events would be accounted
+      close(fd);
+    } else {
+      pevent.sub_fds.push_back(fd);
+      DDRes const res =
+          pevent_open_group_members(*attr, fd, tid, cpu, flags, pevent);
+      if (!IsDDResOK(res)) {
+        LG_WRN("Error opening counter group on watcher %d.%d for tid %d",
+               watcher_idx, cpu, tid);
+      }
+      if (!IsDDResOK(pevent_open_syscall_exit(watcher, *attr, tid, cpu, flags,
+                                              pevent))) {
+        LG_WRN("Error opening sys_exit on watcher %d.%d for tid %d",
+               watcher_idx, cpu, tid);
+      }
+    }
+  }
+}
+
+// Open the event of a watcher on a cpu with an already working config
+DDRes pevent_open_cpu(const PerfWatcher *watcher, int watcher_idx,
+                      int attr_idx, std::span<pid_t> pids, int cpu,
+                      unsigned long flags, PEventHdr *pevent_hdr) {
+  PEvent *pes = pevent_hdr->pes;
+  perf_event_attr *attr = &pevent_hdr->attrs[attr_idx];
+  size_t pevent_idx = -1;
+  DDRES_CHECK_FWD(pevent_create(pevent_hdr, watcher_idx, &pevent_idx));
+  int const fd = perf_event_open(attr, pids[0], cpu, -1, flags);
+  if (fd == -1) {
+    DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFOPEN,
+                           "Error calling perfopen on watcher %d.%d (%s)",
+                           watcher_idx, cpu, strerror(errno));
+  }
+  pevent_set_info(fd, attr_idx, pes[pevent_idx],
+                  watcher_stack_data_size(*watcher));
+  DDRES_CHECK_FWD(pevent_set_filter(watcher, fd));
+  DDRES_CHECK_FWD(pevent_open_group_members(*attr, fd, pids[0], cpu, flags,
+                                            pes[pevent_idx]));
+  DDRES_CHECK_FWD(pevent_open_syscall_exit(watcher, *attr, pids[0], cpu, flags,
+                                           pes[pevent_idx]));
+  pevent_open_sub_fds(watcher, attr, watcher_idx, pids.subspan(1), cpu, flags,
+                      pes[pevent_idx]);
+  return {};
+}
+
+// In cgroup mode, pids holds the fd of the cgroup directory (flags include
+// PERF_FLAG_PID_CGROUP)
 DDRes pevent_open_all_cpus(const PerfWatcher *watcher, int watcher_idx,
-                           std::span<pid_t> pids, int num_cpu,
+                           std::span<pid_t> pids, unsigned long flags,
+                           const cpu_set_t &cpus,
                            PerfClockSource perf_clock_source,
                            PEventHdr *pevent_hdr) {
   PEvent *pes = pevent_hdr->pes;
+  int first_cpu = 0;
+  while (!CPU_ISSET(first_cpu, &cpus)) {
+    ++first_cpu;
+  }
 
   size_t template_pevent_idx = -1;
-  DDRES_CHECK_FWD(pevent_register_cpu_0(watcher, watcher_idx, pids[0],
-                                        perf_clock_source, pevent_hdr,
-                                        template_pevent_idx));
+  DDRES_CHECK_FWD(pevent_register_cpu(watcher, watcher_idx, pids[0],
+                                      first_cpu, flags, perf_clock_source,
+                                      pevent_hdr, template_pevent_idx));
   int const template_attr_idx = pes[template_pevent_idx].attr_idx;
-  perf_event_attr *attr = &pevent_hdr->attrs[template_attr_idx];
+  pevent_open_sub_fds(watcher, &pevent_hdr->attrs[template_attr_idx],
+                      watcher_idx, pids.subspan(1), first_cpu, flags,
+                      pes[template_pevent_idx]);
 
   // used the fixed attr for the others
-  for (int cpu_idx = 0; cpu_idx < num_cpu; ++cpu_idx) {
-    PEvent *pevent = nullptr;
-    // skip first cpu, since already done in pevent_register_cpu_0
-    if (cpu_idx > 0) {
-      size_t pevent_idx = -1;
-      DDRES_CHECK_FWD(pevent_create(pevent_hdr, watcher_idx, &pevent_idx));
-      int const fd =
-          perf_event_open(attr, pids[0], cpu_idx, -1, PERF_FLAG_FD_CLOEXEC);
-      if (fd == -1) {
-        DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFOPEN,
-                               "Error calling perfopen on watcher %d.%d (%s)",
-                               watcher_idx, cpu_idx, strerror(errno));
-      }
-      pevent_set_info(fd, pes[template_pevent_idx].attr_idx, pes[pevent_idx],
-                      watcher->options.stack_sample_size);
-      pevent = &pes[pevent_idx];
-    } else {
-      pevent = &pes[template_pevent_idx];
-    }
-    // do perf_event_open for the other tids, but record them as sub fds
-    // attached to the first. These are not mmaped, but their output will
-    // be redirected to the first one.
-    for (auto tid : pids.subspan(1)) {
-      int const fd =
-          perf_event_open(attr, tid, cpu_idx, -1, PERF_FLAG_FD_CLOEXEC);
-      if (fd == -1) {
-        // Ignore failure, thread may have exited
-        LG_WRN("Error calling perf_event_open on watcher %d.%d (%s) for tid %d",
-               watcher_idx, cpu_idx, strerror(errno), tid);
-      } else {
-        pevent->sub_fds.push_back(fd);
-      }
+  for (int cpu = first_cpu + 1; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &cpus)) {
+      DDRES_CHECK_FWD(pevent_open_cpu(watcher, watcher_idx, template_attr_idx,
+                                      pids, cpu, flags, pevent_hdr));
     }
   }
   return {};
 }
 
+std::string cgroup_path(const std::string &cgroup) {
+  std::string path = cgroup;
+  if (!path.starts_with('/')) {
+    path.insert(0, k_cgroup_root);
+  }
+  return path;
+}
+
+DDRes open_cgroup(const std::string &cgroup, UniqueFd &cgroup_fd) {
+  std::string const path = cgroup_path(cgroup);
+  cgroup_fd.reset(::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+  if (!cgroup_fd) {
+    DDRES_RETURN_ERROR_LOG(DD_WHAT_CGROUP, "Unable to open cgroup %s (%s)",
+                           path.c_str(), strerror(errno));
+  }
+  return {};
+}
+
+// Perf event target: the given pids, or the cgroup fd in cgroup mode.
+// Cgroup events count the threads of the cgroup (including future ones) on
+// each CPU: no event per thread is needed. The cgroup fd is only needed to
+// open the events.
+struct PerfTarget {
+  std::span<pid_t> pids;
+  unsigned long flags{PERF_FLAG_FD_CLOEXEC};
+  UniqueFd cgroup_fd;
+  pid_t cgroup_pid{-1};
+};
+
+DDRes perf_target_init(const DDProfContext &ctx, std::span<pid_t> pids,
+                       PerfTarget &target) {
+  target.pids = pids;
+  if (!ctx.params.cgroup.empty()) {
+    DDRES_CHECK_FWD(open_cgroup(ctx.params.cgroup, target.cgroup_fd));
+    target.cgroup_pid = target.cgroup_fd.get();
+    target.pids = std::span<pid_t>{&target.cgroup_pid, 1};
+    target.flags |= PERF_FLAG_PID_CGROUP;
+  }
+  return {};
+}
+
+// CPUs on which the threads of the cgroup are allowed to run
+bool cgroup_cpus(const std::string &cgroup, cpu_set_t &cpus) {
+  std::ifstream cpuset_file(cgroup_path(cgroup) + "/cpuset.cpus.effective");
+  std::string line;
+  // cgroup v1 has no cpuset file in the perf_event hierarchy
+  return cpuset_file && std::getline(cpuset_file, line) &&
+      parse_cpu_list(line, cpus);
+}
+
+DDRes pevent_enable_event(PEvent &pevent, size_t idx) {
+  for (auto fd : pevent.sub_fds) {
+    // Redirect the output of the sub fds to the main one
+    DDRES_CHECK_INT(ioctl(fd, PERF_EVENT_IOC_SET_OUTPUT, pevent.fd),
+                    DD_WHAT_IOCTL,
+                    "Error ioctl PERF_EVENT_IOC_SET_OUTPUT fd=%d output_fd=%d "
+                    "(idx#%zu)",
+                    fd, pevent.fd, idx);
+    DDRES_CHECK_INT(ioctl(fd, PERF_EVENT_IOC_ENABLE), DD_WHAT_IOCTL,
+                    "Error ioctl fd=%d (idx#%zu)", fd, idx);
+  }
+
+  DDRES_CHECK_INT(ioctl(pevent.fd, PERF_EVENT_IOC_ENABLE), DD_WHAT_IOCTL,
+                  "Error ioctl fd=%d (idx#%zu)", pevent.fd, idx);
+  return {};
+}
+
+// MPSC ring buffers can be backed by huge pages (refer to ring_buffer_create):
+// their metadata then takes a whole huge page to keep the mappings aligned.
+// The page size of a memfd is its block size.
+size_t ring_buffer_meta_size(const PEvent &event) {
+  struct stat st;
+  if (event.ring_buffer_type == RingBufferType::kMPSCRingBuffer &&
+      fstat(event.mapfd, &st) == 0 && st.st_blksize > get_page_size()) {
+    return st.st_blksize;
+  }
+  return get_page_size();
+}
+
+// a ring buffer never filled above 1/k_idle_fill_divisor is considered idle
+constexpr uint64_t k_idle_fill_divisor = 4;
+
+// inverse of perf_mmap_size
+int perf_mmap_order(size_t ring_buffer_size) {
+  return std::countr_zero(ring_buffer_size / get_page_size() - 1);
+}
+
+// perf only accepts a new size once the last mapping of the ring buffer is
+// gone, which is the case between workers (the caller holds the only one).
+// Unmapping detaches the sub fds from the ring buffer: their output is set
+// again.
+DDRes pevent_remap_event(PEvent &pevent, size_t ring_buffer_size) {
+  size_t const previous_size = pevent.ring_buffer_size;
+  DDRES_CHECK_FWD(pevent_munmap_event(&pevent));
+  pevent.ring_buffer_size = ring_buffer_size;
+  if (!IsDDResOK(pevent_mmap_event(&pevent))) {
+    LG_NTC("Keeping the previous ring buffer size for watcher #%d",
+           pevent.watcher_pos);
+    pevent.ring_buffer_size = previous_size;
+    DDRES_CHECK_FWD(pevent_mmap_event(&pevent));
+  }
+  for (auto fd : pevent.sub_fds) {
+    DDRES_CHECK_INT(ioctl(fd, PERF_EVENT_IOC_SET_OUTPUT, pevent.fd),
+                    DD_WHAT_IOCTL,
+                    "Error ioctl PERF_EVENT_IOC_SET_OUTPUT fd=%d output_fd=%d",
+                    fd, pevent.fd);
+  }
+  return {};
+}
+
 } // namespace
 
 void pevent_init(PEventHdr *pevent_hdr) {
@@ -185,32 +449,226 @@ int pevent_compute_min_mmap_order(int min_buffer_size_order,
   return ret_order;
 }
 
+void pevent_adapt_mmap_orders(std::span<const RingBufferUsage> usages,
+                              std::span<const int> min_orders,
+                              std::span<int> orders, size_t budget) {
+  size_t total_size = 0;
+  std::vector<size_t> lossy;
+  for (size_t i = 0; i < orders.size(); ++i) {
+    if (usages[i].lost > 0) {
+      if (orders[i] < k_max_buffer_size_shift) {
+        lossy.push_back(i);
+      }
+    } else if (orders[i] > min_orders[i] &&
+               usages[i].max_used_size * k_idle_fill_divisor <
+                   perf_mmap_size(orders[i]) - get_page_size()) {
+      --orders[i];
+    }
+    total_size += perf_mmap_size(orders[i]);
+  }
+  std::ranges::stable_sort(lossy, [&](size_t lhs, size_t rhs) {
+    return usages[lhs].lost > usages[rhs].lost;
+  });
+  for (size_t const i : lossy) {
+    size_t const growth =
+        perf_mmap_size(orders[i] + 1) - perf_mmap_size(orders[i]);
+    if (total_size + growth <= budget) {
+      ++orders[i];
+      total_size += growth;
+    }
+  }
+}
+
+DDRes pevent_adapt_ring_buffers(const DDProfContext &ctx,
+                                PEventHdr *pevent_hdr,
+                                std::span<RingBufferUsage> usages) {
+  std::vector<size_t> indices;
+  std::vector<RingBufferUsage> perf_usages;
+  std::vector<int> min_orders;
+  std::vector<int> orders;
+  size_t budget = 0;
+  for (size_t i = 0; i < pevent_hdr->size && i < usages.size(); ++i) {
+    const PEvent &pevent = pevent_hdr->pes[i];
+    if (pevent.custom_event || pevent.mapfd == -1) {
+      continue;
+    }
+    int const min_order = pevent_compute_min_mmap_order(
+        k_default_buffer_size_shift,
+        watcher_stack_data_size(ctx.watchers[pevent.watcher_pos]),
+        k_min_number_samples_per_ring_buffer);
+    indices.push_back(i);
+    perf_usages.push_back(usages[i]);
+    min_orders.push_back(min_order);
+    orders.push_back(perf_mmap_order(pevent.ring_buffer_size));
+    budget += k_ring_buffers_budget_factor * perf_mmap_size(min_order);
+  }
+  std::fill(usages.begin(), usages.end(), RingBufferUsage{});
+  pevent_adapt_mmap_orders(perf_usages, min_orders, orders, budget);
+
+  // pinned memory is accounted as in pevent_mmap
+  UIDInfo info;
+  DDRES_CHECK_FWD(user_override_to_nobody_if_root(&info));
+  defer { user_override(info.uid, info.gid); };
+
+  for (size_t k = 0; k < indices.size(); ++k) {
+    PEvent &pevent = pevent_hdr->pes[indices[k]];
+    size_t const ring_buffer_size = perf_mmap_size(orders[k]);
+    if (ring_buffer_size == pevent.ring_buffer_size) {
+      continue;
+    }
+    LG_NTC("Resizing ring buffer #%zu from %zu to %zu bytes (%lu lost events)",
+           indices[k], pevent.ring_buffer_size, ring_buffer_size,
+           perf_usages[k].lost);
+    DDRES_CHECK_FWD(pevent_remap_event(pevent, ring_buffer_size));
+  }
+  return {};
+}
+
+void pevent_target_cpus(const DDProfContext &ctx, std::span<const pid_t> pids,
+                        int num_cpu, cpu_set_t &cpus) {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (!ctx.params.cgroup.empty()) {
+    if (!cgroup_cpus(ctx.params.cgroup, allowed)) {
+      CPU_ZERO(&allowed);
+    }
+  } else if (ctx.params.pid > 0) {
+    // Union of the affinities of the threads (Cpus_allowed, which includes
+    // the restrictions of the cpuset cgroup)
+    for (pid_t const tid : pids) {
+      cpu_set_t tid_cpus;
+      if (sched_getaffinity(tid, sizeof(tid_cpus), &tid_cpus) == 0) {
+        CPU_OR(&allowed, &allowed, &tid_cpus);
+      }
+    }
+  }
+
+  CPU_ZERO(&cpus);
+  for (int cpu = 0; cpu < std::min(num_cpu, CPU_SETSIZE); ++cpu) {
+    if (CPU_ISSET(cpu, &allowed)) {
+      CPU_SET(cpu, &cpus);
+    }
+  }
+  if (CPU_COUNT(&cpus) == 0) {
+    // global mode, or unknown affinity: instrument all CPUs
+    for (int cpu = 0; cpu < std::min(num_cpu, CPU_SETSIZE); ++cpu) {
+      CPU_SET(cpu, &cpus);
+    }
+  }
+}
+
 DDRes pevent_open(DDProfContext &ctx, std::span<pid_t> pids, int num_cpu,
                   PEventHdr *pevent_hdr) {
   assert(pevent_hdr->size == 0); // check for previous init
+  PerfTarget target;
+  DDRES_CHECK_FWD(perf_target_init(ctx, pids, target));
+  // Only open per-cpu events where the target can run
+  pevent_target_cpus(ctx, pids, num_cpu, pevent_hdr->cpus);
+  if (CPU_COUNT(&pevent_hdr->cpus) < num_cpu) {
+    LG_NTC("Instrumenting %d out of %d CPUs (cpus=%s)",
+           CPU_COUNT(&pevent_hdr->cpus), num_cpu,
+           cpu_mask_to_string(pevent_hdr->cpus).c_str());
+  }
   for (unsigned long watcher_idx = 0; watcher_idx < ctx.watchers.size();
        ++watcher_idx) {
     PerfWatcher *watcher = &ctx.watchers[watcher_idx];
     if (watcher->type < kDDPROF_TYPE_CUSTOM) {
-      DDRES_CHECK_FWD(pevent_open_all_cpus(watcher, watcher_idx, pids, num_cpu,
-                                           ctx.perf_clock_source, pevent_hdr));
+      DDRES_CHECK_FWD(pevent_open_all_cpus(
+          watcher, watcher_idx, target.pids, target.flags, pevent_hdr->cpus,
+          ctx.perf_clock_source, pevent_hdr));
     } else {
       // custom event, eg.allocation profiling
-      size_t pevent_idx = 0;
-      DDRES_CHECK_FWD(pevent_create(pevent_hdr, watcher_idx, &pevent_idx));
+      // Producers are spread over one ring buffer per cpu (up to a limit)
+      unsigned const nb_ring_buffers = std::clamp(
+          static_cast<unsigned>(num_cpu), 1U, k_max_allocation_ring_buffers);
       int const order = pevent_compute_min_mmap_order(
           k_mpsc_buffer_size_shift, watcher->options.stack_sample_size,
           k_min_number_samples_per_ring_buffer);
-      DDRES_CHECK_FWD(ring_buffer_create(order, RingBufferType::kMPSCRingBuffer,
-                                         true, &pevent_hdr->pes[pevent_idx]));
+      for (unsigned i = 0; i < nb_ring_buffers; ++i) {
+        size_t pevent_idx = 0;
+        DDRES_CHECK_FWD(pevent_create(pevent_hdr, watcher_idx, &pevent_idx));
+        DDRES_CHECK_FWD(ring_buffer_create(
+            order, RingBufferType::kMPSCRingBuffer, true,
+            &pevent_hdr->pes[pevent_idx], watcher->options.huge_pages));
+      }
     }
   }
   return {};
 }
 
+DDRes pevent_open_new_cpus(DDProfContext &ctx, std::span<pid_t> pids,
+                           int num_cpu, PEventHdr *pevent_hdr) {
+  cpu_set_t cpus;
+  pevent_target_cpus(ctx, pids, num_cpu, cpus);
+  cpu_set_t new_cpus;
+  CPU_ZERO(&new_cpus);
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &cpus) && !CPU_ISSET(cpu, &pevent_hdr->cpus)) {
+      CPU_SET(cpu, &new_cpus);
+    }
+  }
+  if (CPU_COUNT(&new_cpus) == 0) {
+    return {};
+  }
+  LG_NTC("Target affinity changed, instrumenting new CPUs (cpus=%s)",
+         cpu_mask_to_string(new_cpus).c_str());
+  // Events of CPUs that are no longer allowed are kept (they stay idle).
+  // CPUs are flagged before opening: failing CPUs are not retried.
+  CPU_OR(&pevent_hdr->cpus, &pevent_hdr->cpus, &new_cpus);
+
+  PerfTarget target;
+  DDRES_CHECK_FWD(perf_target_init(ctx, pids, target));
+  size_t const first_new_pevent = pevent_hdr->size;
+  for (unsigned long watcher_idx = 0; watcher_idx < ctx.watchers.size();
+       ++watcher_idx) {
+    const PerfWatcher *watcher = &ctx.watchers[watcher_idx];
+    // reuse the config that worked for the other CPUs
+    const PEvent *template_pevent = std::find_if(
+        pevent_hdr->pes, pevent_hdr->pes + first_new_pevent,
+        [&](const PEvent &pevent) {
+          return pevent.watcher_pos == static_cast<int>(watcher_idx) &&
+              !pevent.custom_event;
+        });
+    if (watcher->type >= kDDPROF_TYPE_CUSTOM ||
+        template_pevent == pevent_hdr->pes + first_new_pevent) {
+      continue;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &new_cpus)) {
+        DDRES_CHECK_FWD(pevent_open_cpu(watcher, watcher_idx,
+                                        template_pevent->attr_idx,
+                                        target.pids, cpu, target.flags,
+                                        pevent_hdr));
+      }
+    }
+  }
+  // Ring buffers are mapped before their sub fds are redirected to them
+  // (as in pevent_setup). Events that can not be mapped are dropped.
+  DDRes res = pevent_mmap(pevent_hdr, true, first_new_pevent);
+  if (!IsDDResOK(res)) {
+    LG_NTC("Retrying attachment without user override");
+    res = pevent_mmap(pevent_hdr, false, first_new_pevent);
+  }
+  if (!IsDDResOK(res)) {
+    for (size_t i = first_new_pevent; i < pevent_hdr->size; ++i) {
+      PEvent &pevent = pevent_hdr->pes[i];
+      pevent_close_event(&pevent);
+      pevent = {.fd = -1, .mapfd = -1, .attr_idx = -1};
+    }
+    pevent_hdr->size = first_new_pevent;
+    return res;
+  }
+  for (size_t i = first_new_pevent; i < pevent_hdr->size; ++i) {
+    DDRES_CHECK_FWD(pevent_enable_event(pevent_hdr->pes[i], i));
+  }
+  return {};
+}
+
 DDRes pevent_mmap_event(PEvent *event) {
   if (event->mapfd != -1) {
-    void *region = perfown_sz(event->mapfd, event->ring_buffer_size);
+    size_t const meta_size = ring_buffer_meta_size(*event);
+    void *region =
+        perfown_sz(event->mapfd, event->ring_buffer_size, meta_size);
     if (!region) {
       DDRES_RETURN_ERROR_LOG(
           DD_WHAT_PERFMMAP,
@@ -220,7 +678,7 @@ DDRes pevent_mmap_event(PEvent *event) {
           event->watcher_pos, strerror(errno));
     }
     if (!rb_init(&event->rb, region, event->ring_buffer_size,
-                 event->ring_buffer_type)) {
+                 event->ring_buffer_type, meta_size)) {
       DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFMMAP,
                              "Could not initialize ring buffer for watcher #%d",
                              event->watcher_pos);
@@ -229,7 +687,7 @@ DDRes pevent_mmap_event(PEvent *event) {
   return {};
 }
 
-DDRes pevent_mmap(PEventHdr *pevent_hdr, bool use_override) {
+DDRes pevent_mmap(PEventHdr *pevent_hdr, bool use_override, size_t first) {
   // Switch user if needed (when root switch to nobody user)
   // Pinned memory is accounted by the kernel by (real) uid across containers
   // (uid 1000 in the host and in containers will share the same count).
@@ -247,10 +705,14 @@ DDRes pevent_mmap(PEventHdr *pevent_hdr, bool use_override) {
     }
   };
 
-  auto defer_munmap = make_defer([&] { pevent_munmap(pevent_hdr); });
-
   PEvent *pes = pevent_hdr->pes;
-  for (size_t k = 0; k < pevent_hdr->size; ++k) {
+  auto defer_munmap = make_defer([&] {
+    for (size_t k = first; k < pevent_hdr->size; ++k) {
+      pevent_munmap_event(&pes[k]);
+    }
+  });
+
+  for (size_t k = first; k < pevent_hdr->size; ++k) {
     DDRES_CHECK_FWD(pevent_mmap_event(&pes[k]));
   }
 
@@ -275,21 +737,7 @@ DDRes pevent_enable(PEventHdr *pevent_hdr) {
   // contexts
   for (size_t i = 0; i < pevent_hdr->size; ++i) {
     if (!pevent_hdr->pes[i].custom_event) {
-      for (auto fd : pevent_hdr->pes[i].sub_fds) {
-        // Redirect the output of the sub fds to the main one
-        DDRES_CHECK_INT(
-            ioctl(fd, PERF_EVENT_IOC_SET_OUTPUT, pevent_hdr->pes[i].fd),
-            DD_WHAT_IOCTL,
-            "Error ioctl PERF_EVENT_IOC_SET_OUTPUT fd=%d output_fd=%d "
-            "(idx#%zu)",
-            fd, pevent_hdr->pes[i].fd, i);
-        DDRES_CHECK_INT(ioctl(fd, PERF_EVENT_IOC_ENABLE), DD_WHAT_IOCTL,
-                        "Error ioctl fd=%d (idx#%zu)", fd, i);
-      }
-
-      DDRES_CHECK_INT(ioctl(pevent_hdr->pes[i].fd, PERF_EVENT_IOC_ENABLE),
-                      DD_WHAT_IOCTL, "Error ioctl fd=%d (idx#%zu)",
-                      pevent_hdr->pes[i].fd, i);
+      DDRES_CHECK_FWD(pevent_enable_event(pevent_hdr->pes[i], i));
     }
   }
   return {};
@@ -297,7 +745,8 @@ DDRes pevent_enable(PEventHdr *pevent_hdr) {
 
 DDRes pevent_munmap_event(PEvent *event) {
   if (event->rb.base) {
-    if (perfdisown(event->rb.base, event->ring_buffer_size) != 0) {
+    if (perfdisown(event->rb.base, event->ring_buffer_size,
+                   event->rb.meta_size) != 0) {
       DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFMMAP,
                              "Error when using perfdisown for watcher #%d",
                              event->watcher_pos);
@@ -338,6 +787,14 @@ DDRes pevent_close_event(PEvent *event) {
             sub_fd, event->watcher_pos, strerror(errno));
       }
     }
+    for (auto group_fd : event->group_fds) {
+      if (close(group_fd) == -1) {
+        DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFOPEN,
+                               "Error when closing group_fd=%d (watcher #%d) "
+                               "(%s)",
+                               group_fd, event->watcher_pos, strerror(errno));
+      }
+    }
   }
   if (event->custom_event && event->mapfd != -1) {
     if (close(event->mapfd) == -1) {
@@ -17,10 +17,12 @@
 
 #include <absl/strings/str_format.h>
 #include <absl/strings/substitute.h>
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <datadog/common.h>
 #include <datadog/profiling.h>
+#include <memory>
 #include <span>
 #include <string_view>
 
@@ -35,6 +37,18 @@ constexpr size_t k_max_pprof_labels{6};
 constexpr int k_max_value_types =
     DDPROF_PWT_LENGTH * static_cast<int>(kNbEventAggregationModes);
 
+// Stack and thread a sample was captured on (labels derive from them)
+struct SampleStack {
+  std::span<const FunLoc> locs;
+  std::string_view container_id;
+  pid_t pid;
+  pid_t tid;
+  // lifetime bucket of freed allocations (empty for other samples)
+  std::string_view lifetime{};
+  // syscall of syscall time samples (empty for other samples)
+  std::string_view syscall{};
+};
+
 struct ActiveIdsResult {
   EventAggregationMode output_mode[DDPROF_PWT_LENGTH] = {};
   PerfWatcher *default_watcher = nullptr;
@@ -68,7 +82,10 @@ bool is_stack_complete(std::span<const ddog_prof_Location> locations) {
       "_exit"sv,
       "gnome-shell"sv,
       "main"sv,
+      // Go symbol tables (pclntab) name functions without the ABI suffix
+      "runtime.goexit"sv,
       "runtime.goexit.abi0"sv,
+      "runtime.systemstack"sv,
       "runtime.systemstack.abi0"sv,
       "_start"sv,
       "start_thread"sv,
@@ -162,6 +179,11 @@ DDRes get_active_ids(std::span<PerfWatcher> watchers, ActiveIdsResult &result) {
       // if the count is valid, update mask for it
       result.output_mode[count_id] |= watchers[i].aggregation_mode;
     }
+    if (watchers[i].options.counter_group) {
+      for (const auto &member : k_counter_group_members) {
+        result.output_mode[member.sample_type_id] |= EventAggregationMode::kSum;
+      }
+    }
   }
   return {};
 }
@@ -234,7 +256,7 @@ ProfValueTypes compute_pprof_values(const ActiveIdsResult &active_ids) {
   return result;
 }
 
-size_t prepare_labels(const UnwindOutput &uw_output, const PerfWatcher &watcher,
+size_t prepare_labels(const SampleStack &stack, const PerfWatcher &watcher,
                       std::unordered_map<pid_t, std::string> &pid_strs,
                       std::span<ddog_prof_Label> labels) {
   constexpr std::string_view k_container_id_label = "container_id"sv;
@@ -243,9 +265,11 @@ size_t prepare_labels(const UnwindOutput &uw_output, const PerfWatcher &watcher,
   // process_id)
   constexpr std::string_view k_thread_id_label = "thread id"sv;
   constexpr std::string_view k_tracepoint_label = "tracepoint_type"sv;
+  constexpr std::string_view k_lifetime_label = "lifetime"sv;
+  constexpr std::string_view k_syscall_label = "syscall"sv;
   size_t labels_num = 0;
   labels[labels_num].key = to_CharSlice(k_container_id_label);
-  labels[labels_num].str = to_CharSlice(uw_output.container_id);
+  labels[labels_num].str = to_CharSlice(stack.container_id);
   ++labels_num;
 
   // Add any configured labels.  Note that TID alone has the same cardinality as
@@ -253,12 +277,12 @@ size_t prepare_labels(const UnwindOutput &uw_output, const PerfWatcher &watcher,
   // much if TID implies PID for clarity.
   if (!watcher.suppress_pid || !watcher.suppress_tid) {
     labels[labels_num].key = to_CharSlice(k_process_id_label);
-    labels[labels_num].str = to_CharSlice(pid_str(uw_output.pid, pid_strs));
+    labels[labels_num].str = to_CharSlice(pid_str(stack.pid, pid_strs));
     ++labels_num;
   }
   if (!watcher.suppress_tid) {
     labels[labels_num].key = to_CharSlice(k_thread_id_label);
-    labels[labels_num].str = to_CharSlice(pid_str(uw_output.tid, pid_strs));
+    labels[labels_num].str = to_CharSlice(pid_str(stack.tid, pid_strs));
     ++labels_num;
   }
   if (watcher_has_tracepoint(&watcher)) {
@@ -272,6 +296,16 @@ size_t prepare_labels(const UnwindOutput &uw_output, const PerfWatcher &watcher,
     }
     ++labels_num;
   }
+  if (!stack.lifetime.empty()) {
+    labels[labels_num].key = to_CharSlice(k_lifetime_label);
+    labels[labels_num].str = to_CharSlice(stack.lifetime);
+    ++labels_num;
+  }
+  if (!stack.syscall.empty()) {
+    labels[labels_num].key = to_CharSlice(k_syscall_label);
+    labels[labels_num].str = to_CharSlice(stack.syscall);
+    ++labels_num;
+  }
   DDPROF_DCHECK_FATAL(labels_num <= labels.size(),
                       "pprof_aggregate - label buffer exceeded");
   return labels_num;
@@ -412,6 +446,10 @@ DDRes pprof_create_profile(DDProfPProf *pprof, DDProfContext &ctx) {
                 count_id, static_cast<EventAggregationModePos>(value_pos));
       }
     }
+    for (int j = 0; j < k_nb_counter_group_members; ++j) {
+      ctx.watchers[i].counter_pprof_indices[j] = pprof_values.get_index(
+          k_counter_group_members[j].sample_type_id, kSumPos);
+    }
   }
 
   pprof->_nb_values = pprof_values.get_num_sample_type_ids();
@@ -491,17 +529,24 @@ DDRes pprof_free_profile(DDProfPProf *pprof) {
   ddog_prof_Profile_drop(&pprof->_profile);
   pprof->_profile = {};
   pprof->_nb_values = 0;
+  for (const auto &[pid, pid_stacks] : pprof->_pre_aggregated) {
+    for (const auto &[pre_aggregation_key, stacks] : pid_stacks) {
+      for (const auto &[key, value] : stacks) {
+        pprof->_stack_table->release(key.stack_id);
+      }
+    }
+  }
+  pprof->_pre_aggregated.clear();
   return {};
 }
 
+namespace {
 // Assumption of API is that sample is valid in a single type
-DDRes pprof_aggregate(const UnwindOutput *uw_output,
-                      const SymbolHdr &symbol_hdr, const DDProfValuePack &pack,
-                      const PerfWatcher *watcher,
-                      const FileInfoVector &file_infos, bool show_samples,
-                      EventAggregationModePos value_pos, Symbolizer *symbolizer,
-                      DDProfPProf *pprof) {
-
+// Add a sample made of already symbolized locations to the profile
+DDRes add_sample(std::span<const ddog_prof_Location> locations,
+                 const SampleStack &stack, const DDProfValuePack &pack,
+                 const PerfWatcher *watcher, bool show_samples,
+                 EventAggregationModePos value_pos, DDProfPProf *pprof) {
   const PProfIndices &pprof_indices = watcher->pprof_indices[value_pos];
   ddog_prof_Profile *profile = &pprof->_profile;
   int64_t values[k_max_value_types] = {};
@@ -511,33 +556,26 @@ DDRes pprof_aggregate(const UnwindOutput *uw_output,
     assert(pprof_indices.pprof_count_index != -1);
     values[pprof_indices.pprof_count_index] = pack.count;
   }
+  for (size_t i = 0; i < pack.counter_values.size(); ++i) {
+    assert(watcher->counter_pprof_indices[i] != -1);
+    values[watcher->counter_pprof_indices[i]] = pack.counter_values[i];
+  }
 
-  std::array<ddog_prof_Location, kMaxStackDepth> locations_buff;
-  std::span locs{uw_output->locs};
-  locs = adjust_locations(watcher, locs);
-
-  // Blaze results should remain alive until we aggregate the pprof data
-  Symbolizer::BlazeResultsWrapper session_results;
-  unsigned write_index = 0;
-  DDRES_CHECK_FWD(process_symbolization(locs, symbol_hdr, file_infos,
-                                        symbolizer, pprof, locations_buff,
-                                        session_results, write_index));
   std::array<ddog_prof_Label, k_max_pprof_labels> labels{};
   // Create the labels for the sample.  Two samples are the same only when
   // their locations _and_ all labels are identical, so we admit a very limited
   // number of labels at present
   const size_t labels_num =
-      prepare_labels(*uw_output, *watcher, pprof->_pid_str, std::span{labels});
+      prepare_labels(stack, *watcher, pprof->_pid_str, std::span{labels});
 
   ddog_prof_Sample const sample = {
-      .locations = {.ptr = locations_buff.data(), .len = write_index},
+      .locations = {.ptr = locations.data(), .len = locations.size()},
       .values = {.ptr = values, .len = pprof->_nb_values},
       .labels = {.ptr = labels.data(), .len = labels_num},
   };
 
   if (show_samples) {
-    ddprof_print_sample(std::span{locations_buff.data(), write_index},
-                        pack.value, uw_output->pid, uw_output->tid, value_pos,
+    ddprof_print_sample(locations, pack.value, stack.pid, stack.tid, value_pos,
                         *watcher);
   }
   auto res = ddog_prof_Profile_add(profile, sample, pack.timestamp);
@@ -550,6 +588,237 @@ DDRes pprof_aggregate(const UnwindOutput *uw_output,
   return {};
 }
 
+// Assumption of API is that sample is valid in a single type
+DDRes aggregate_sample(const SampleStack &stack, const SymbolHdr &symbol_hdr,
+                       const DDProfValuePack &pack, const PerfWatcher *watcher,
+                       const FileInfoVector &file_infos, bool show_samples,
+                       EventAggregationModePos value_pos,
+                       Symbolizer *symbolizer, DDProfPProf *pprof) {
+  std::array<ddog_prof_Location, kMaxStackDepth> locations_buff;
+  const std::span locs = adjust_locations(watcher, stack.locs);
+
+  // Blaze results should remain alive until we aggregate the pprof data
+  Symbolizer::BlazeResultsWrapper session_results;
+  unsigned write_index = 0;
+  DDRES_CHECK_FWD(process_symbolization(locs, symbol_hdr, file_infos,
+                                        symbolizer, pprof, locations_buff,
+                                        session_results, write_index));
+  return add_sample(std::span{locations_buff.data(), write_index}, stack, pack,
+                    watcher, show_samples, value_pos, pprof);
+}
+
+size_t string_size(ddog_CharSlice slice) { return slice.ptr ? slice.len : 0; }
+
+ddog_CharSlice copy_string(ddog_CharSlice slice, std::string &storage) {
+  if (!slice.ptr || !slice.len) {
+    return slice;
+  }
+  const size_t offset = storage.size();
+  storage.append(slice.ptr, slice.len);
+  return {.ptr = storage.data() + offset, .len = slice.len};
+}
+} // namespace
+
+DDRes pprof_aggregate(const UnwindOutput *uw_output,
+                      const SymbolHdr &symbol_hdr, const DDProfValuePack &pack,
+                      const PerfWatcher *watcher,
+                      const FileInfoVector &file_infos, bool show_samples,
+                      EventAggregationModePos value_pos, Symbolizer *symbolizer,
+                      DDProfPProf *pprof) {
+  const SampleStack stack{.locs = uw_output->locs,
+                          .container_id = uw_output->container_id,
+                          .pid = uw_output->pid,
+                          .tid = uw_output->tid};
+  return aggregate_sample(stack, symbol_hdr, pack, watcher, file_infos,
+                          show_samples, value_pos, symbolizer, pprof);
+}
+
+DDRes pprof_aggregate(const StackKey &key, const StackTable &stack_table,
+                      const SymbolHdr &symbol_hdr, const DDProfValuePack &pack,
+                      const PerfWatcher *watcher,
+                      const FileInfoVector &file_infos, bool show_samples,
+                      EventAggregationModePos value_pos, Symbolizer *symbolizer,
+                      DDProfPProf *pprof) {
+  const SampleStack stack{
+      .locs = stack_table.locs(key.stack_id),
+      .container_id = stack_table.container_id(key.stack_id),
+      .pid = key.pid,
+      .tid = key.tid};
+  return aggregate_sample(stack, symbol_hdr, pack, watcher, file_infos,
+                          show_samples, value_pos, symbolizer, pprof);
+}
+
+SymbolizedStack::SymbolizedStack(
+    std::span<const ddog_prof_Location> locations)
+    : _locations(locations.begin(), locations.end()) {
+  size_t total_size = 0;
+  for (const auto &loc : locations) {
+    total_size += string_size(loc.mapping.filename) +
+        string_size(loc.mapping.build_id) + string_size(loc.function.name) +
+        string_size(loc.function.system_name) +
+        string_size(loc.function.filename);
+  }
+  // no reallocation: slices point inside the storage
+  _strings.reserve(total_size);
+  for (auto &loc : _locations) {
+    loc.mapping.filename = copy_string(loc.mapping.filename, _strings);
+    loc.mapping.build_id = copy_string(loc.mapping.build_id, _strings);
+    loc.function.name = copy_string(loc.function.name, _strings);
+    loc.function.system_name = copy_string(loc.function.system_name, _strings);
+    loc.function.filename = copy_string(loc.function.filename, _strings);
+  }
+}
+
+namespace {
+DDRes aggregate_cached(const SampleStack &stack, const SymbolHdr &symbol_hdr,
+                       const DDProfValuePack &pack, const PerfWatcher *watcher,
+                       const FileInfoVector &file_infos, bool show_samples,
+                       EventAggregationModePos value_pos,
+                       Symbolizer *symbolizer,
+                       std::shared_ptr<const SymbolizedStack> &cache,
+                       DDProfPProf *pprof) {
+  if (!cache) {
+    std::array<ddog_prof_Location, kMaxStackDepth> locations_buff;
+    const std::span locs = adjust_locations(watcher, stack.locs);
+    Symbolizer::BlazeResultsWrapper session_results;
+    unsigned write_index = 0;
+    DDRES_CHECK_FWD(process_symbolization(locs, symbol_hdr, file_infos,
+                                          symbolizer, pprof, locations_buff,
+                                          session_results, write_index));
+    cache = std::make_shared<const SymbolizedStack>(
+        std::span{locations_buff.data(), write_index});
+  }
+  return add_sample(cache->locations(), stack, pack, watcher, show_samples,
+                    value_pos, pprof);
+}
+} // namespace
+
+DDRes pprof_aggregate_cached(
+    const StackKey &key, const StackTable &stack_table,
+    const SymbolHdr &symbol_hdr, const DDProfValuePack &pack,
+    const PerfWatcher *watcher, const FileInfoVector &file_infos,
+    bool show_samples, EventAggregationModePos value_pos,
+    Symbolizer *symbolizer, std::shared_ptr<const SymbolizedStack> &cache,
+    DDProfPProf *pprof) {
+  const SampleStack stack{
+      .locs = stack_table.locs(key.stack_id),
+      .container_id = stack_table.container_id(key.stack_id),
+      .pid = key.pid,
+      .tid = key.tid};
+  return aggregate_cached(stack, symbol_hdr, pack, watcher, file_infos,
+                          show_samples, value_pos, symbolizer, cache, pprof);
+}
+
+DDRes pprof_aggregate_lifetime(
+    const StackKey &key, const StackTable &stack_table,
+    const SymbolHdr &symbol_hdr, const DDProfValuePack &pack,
+    const PerfWatcher *watcher, const FileInfoVector &file_infos,
+    bool show_samples, std::string_view lifetime, Symbolizer *symbolizer,
+    std::shared_ptr<const SymbolizedStack> &cache, DDProfPProf *pprof) {
+  const SampleStack stack{
+      .locs = stack_table.locs(key.stack_id),
+      .container_id = stack_table.container_id(key.stack_id),
+      .pid = key.pid,
+      .tid = key.tid,
+      .lifetime = lifetime};
+  return aggregate_cached(stack, symbol_hdr, pack, watcher, file_infos,
+                          show_samples, kLifetimePos, symbolizer, cache, pprof);
+}
+
+DDRes pprof_pre_aggregate(const StackKey &key, const DDProfValuePack &pack,
+                          const PerfWatcher *watcher,
+                          EventAggregationModePos value_pos,
+                          StackTable &stack_table, DDProfPProf *pprof,
+                          std::string_view syscall) {
+  PreAggregatedStacks::StackMap &stacks =
+      pprof->_pre_aggregated[key.pid][PreAggregatedStacks::Key{
+          ._watcher = watcher, ._value_pos = value_pos, ._syscall = syscall}];
+  auto stack_it = stacks.find(key);
+  if (stack_it == stacks.end()) {
+    stack_it = stacks.emplace(key, PreAggregatedStacks::ValueAndCount{}).first;
+    // released when flushed
+    stack_table.add_ref(key.stack_id);
+    pprof->_stack_table = &stack_table;
+  }
+  stack_it->second._value += pack.value;
+  stack_it->second._count += pack.count;
+  for (size_t i = 0; i < pack.counter_values.size(); ++i) {
+    stack_it->second._counter_values[i] += pack.counter_values[i];
+  }
+  return {};
+}
+
+namespace {
+// Add the stacks of a process to the profile, releasing every stack even if
+// we fail to add some of them
+DDRes flush_pre_aggregated(const PreAggregatedStacks::Map &pid_stacks,
+                           StackTable &stack_table, const SymbolHdr &symbol_hdr,
+                           const FileInfoVector &file_infos, bool show_samples,
+                           Symbolizer *symbolizer, DDProfPProf *pprof) {
+  DDRes res{};
+  for (const auto &[pre_aggregation_key, stacks] : pid_stacks) {
+    const PerfWatcher *watcher = pre_aggregation_key._watcher;
+    for (const auto &[key, value] : stacks) {
+      std::span<const int64_t> counter_values;
+      if (watcher->options.counter_group) {
+        counter_values = value._counter_values;
+      }
+      const DDProfValuePack pack{value._value, value._count, 0,
+                                 counter_values};
+      if (IsDDResOK(res)) {
+        const SampleStack stack{
+            .locs = stack_table.locs(key.stack_id),
+            .container_id = stack_table.container_id(key.stack_id),
+            .pid = key.pid,
+            .tid = key.tid,
+            .syscall = pre_aggregation_key._syscall};
+        res = aggregate_sample(stack, symbol_hdr, pack, watcher, file_infos,
+                               show_samples, pre_aggregation_key._value_pos,
+                               symbolizer, pprof);
+      }
+      stack_table.release(key.stack_id);
+    }
+  }
+  return res;
+}
+} // namespace
+
+DDRes pprof_flush_pre_aggregated(StackTable &stack_table,
+                                 const SymbolHdr &symbol_hdr,
+                                 const FileInfoVector &file_infos,
+                                 bool show_samples, Symbolizer *symbolizer,
+                                 DDProfPProf *pprof) {
+  LG_DBG("Flushing pre-aggregated stacks of %lu processes",
+         pprof->_pre_aggregated.size());
+  DDRes res{};
+  for (const auto &[pid, pid_stacks] : pprof->_pre_aggregated) {
+    DDRes const pid_res =
+        flush_pre_aggregated(pid_stacks, stack_table, symbol_hdr, file_infos,
+                             show_samples, symbolizer, pprof);
+    if (IsDDResOK(res)) {
+      res = pid_res;
+    }
+  }
+  pprof->_pre_aggregated.clear();
+  return res;
+}
+
+DDRes pprof_flush_pre_aggregated_pid(pid_t pid, StackTable &stack_table,
+                                     const SymbolHdr &symbol_hdr,
+                                     const FileInfoVector &file_infos,
+                                     bool show_samples, Symbolizer *symbolizer,
+                                     DDProfPProf *pprof) {
+  auto it = pprof->_pre_aggregated.find(pid);
+  if (it == pprof->_pre_aggregated.end()) {
+    return {};
+  }
+  DDRes const res =
+      flush_pre_aggregated(it->second, stack_table, symbol_hdr, file_infos,
+                           show_samples, symbolizer, pprof);
+  pprof->_pre_aggregated.erase(it);
+  return res;
+}
+
 DDRes pprof_reset(DDProfPProf *pprof) {
   auto res = ddog_prof_Profile_reset(&pprof->_profile, nullptr);
   if (res.tag != DDOG_PROF_PROFILE_RESULT_OK) {
@@ -24,6 +24,7 @@ DDRes add_preset(std::string_view preset, bool pid_or_global_mode,
       {"cpu_only", "sCPU"},
       {"alloc_only", "sALLOC"},
       {"cpu_live_heap", "sCPU;sALLOC mode=sl"},
+      {"cpu_wall", "sCPU;sOFFCPU"},
   };
 
   if (preset == "default"sv && pid_or_global_mode) {
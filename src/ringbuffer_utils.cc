@@ -13,11 +13,50 @@
 #include "syscalls.hpp"
 #include "tsc_clock.hpp"
 
+#include <algorithm>
 #include <sys/eventfd.h>
+#include <sys/mman.h>
 
 namespace ddprof {
 
 namespace {
+// memfd_create flags (linux/memfd.h clashes with the libc definitions)
+constexpr unsigned k_mfd_cloexec = 0x1U;
+constexpr unsigned k_mfd_hugetlb = 0x4U;
+constexpr unsigned k_mfd_huge_2mb = 21U << 26;
+
+// memfd backed by 2MB huge pages, -1 if they are not available. Data is
+// rounded up to a huge page and the metadata takes a whole huge page (mappings
+// of the memfd are aligned on huge pages).
+int huge_page_memfd(size_t buffer_size_page_order, size_t &buffer_size) {
+  int const fd = memfd_create("allocation_ring_buffer",
+                              k_mfd_cloexec | k_mfd_hugetlb | k_mfd_huge_2mb);
+  if (fd == -1) {
+    LG_NTC("Huge pages are not supported (%s), using regular pages",
+           strerror(errno));
+    return -1;
+  }
+  size_t const data_size = std::max(
+      (1UL << buffer_size_page_order) * get_page_size(), k_huge_page_size);
+  size_t const size = k_huge_page_size + data_size;
+  // huge pages are reserved by the first mapping (and stay reserved for the
+  // memfd): fail now rather than when the ring buffer is attached
+  void *addr = MAP_FAILED;
+  if (ftruncate(fd, size) == 0) {
+    addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (addr == MAP_FAILED) {
+    LG_NTC("Unable to reserve %zu bytes of huge pages (%s), using regular "
+           "pages",
+           size, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  munmap(addr, size);
+  buffer_size = size;
+  return fd;
+}
+
 void init_metadata_page(MPSCRingBufferMetaDataPage *page) {
   const auto &calibration = TscClock::calibration();
   if (calibration.state == TscClock::State::kOK) {
@@ -53,13 +92,19 @@ DDRes ring_buffer_attach(PEvent &event) { return pevent_mmap_event(&event); }
 
 DDRes ring_buffer_create(size_t buffer_size_page_order,
                          RingBufferType ring_buffer_type, bool custom_event,
-                         PEvent *pevent) {
-  size_t const buffer_size = perf_mmap_size(buffer_size_page_order);
-  pevent->mapfd = memfd_create("allocation_ring_buffer", 1U /*MFD_CLOEXEC*/);
+                         PEvent *pevent, bool huge_pages) {
+  size_t buffer_size = perf_mmap_size(buffer_size_page_order);
+  pevent->mapfd = -1;
+  if (huge_pages && ring_buffer_type == RingBufferType::kMPSCRingBuffer) {
+    pevent->mapfd = huge_page_memfd(buffer_size_page_order, buffer_size);
+  }
   if (pevent->mapfd == -1) {
-    DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFOPEN,
-                           "Error calling memfd_create on watcher %d (%s)",
-                           pevent->watcher_pos, strerror(errno));
+    pevent->mapfd = memfd_create("allocation_ring_buffer", k_mfd_cloexec);
+    if (pevent->mapfd == -1) {
+      DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFOPEN,
+                             "Error calling memfd_create on watcher %d (%s)",
+                             pevent->watcher_pos, strerror(errno));
+    }
   }
   if (ftruncate(pevent->mapfd, buffer_size) == -1) {
     DDRES_RETURN_ERROR_LOG(DD_WHAT_PERFOPEN,
@@ -98,9 +143,9 @@ DDRes ring_buffer_detach(PEvent &event) { return pevent_munmap_event(&event); }
 
 DDRes ring_buffer_setup(size_t buffer_size_page_order,
                         RingBufferType ring_buffer_type, bool custom_event,
-                        PEvent *event) {
+                        PEvent *event, bool huge_pages) {
   DDRES_CHECK_FWD(ring_buffer_create(buffer_size_page_order, ring_buffer_type,
-                                     custom_event, event));
+                                     custom_event, event, huge_pages));
   DDRES_CHECK_FWD(ring_buffer_attach(*event));
   return {};
 }
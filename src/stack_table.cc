@@ -0,0 +1,105 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "stack_table.hpp"
+
+#include "ddres.hpp"
+
+#include <algorithm>
+
+namespace ddprof {
+
+namespace {
+// Below this size, keeping released frames is cheaper than compacting
+constexpr size_t k_min_arena_compaction_size = 4096;
+} // namespace
+
+bool StackTable::IndexEqual::operator()(const StackView &view,
+                                        StackId id) const {
+  const Entry &entry = table->_entries[id];
+  if (entry.hash != view.hash || entry.container_id != view.container_id) {
+    return false;
+  }
+  const auto locs = table->locs(id);
+  return std::equal(locs.begin(), locs.end(), view.locs.begin(),
+                    view.locs.end());
+}
+
+std::size_t StackTable::hash_locs(std::span<const FunLoc> locs) {
+  std::size_t seed = 0;
+  for (const auto &fl : locs) {
+    hash_combine(seed, fl.ip);
+    // no need to hash fl.elf_addr since it's derived from fl.ip
+    hash_combine(seed, fl.symbol_idx);
+    hash_combine(seed, fl.map_info_idx);
+  }
+  return seed;
+}
+
+StackId StackTable::intern(std::span<const FunLoc> locs,
+                           std::string_view container_id) {
+  const StackView view{locs, container_id, hash_locs(locs)};
+  auto it = _index.find(view);
+  if (it != _index.end()) {
+    add_ref(*it);
+    return *it;
+  }
+
+  StackId id;
+  if (!_free_ids.empty()) {
+    id = _free_ids.back();
+    _free_ids.pop_back();
+  } else {
+    id = static_cast<StackId>(_entries.size());
+    _entries.emplace_back();
+  }
+  Entry &entry = _entries[id];
+  entry.offset = static_cast<uint32_t>(_arena.size());
+  entry.nb_locs = static_cast<uint32_t>(locs.size());
+  entry.ref_count = 1;
+  entry.hash = view.hash;
+  entry.container_id = container_id;
+  _arena.insert(_arena.end(), locs.begin(), locs.end());
+  _index.insert(id);
+  return id;
+}
+
+void StackTable::release(StackId id) {
+  Entry &entry = _entries[id];
+  DDPROF_DCHECK_FATAL(entry.ref_count > 0, "Stack %u released too many times",
+                      id);
+  if (--entry.ref_count) {
+    return;
+  }
+  _index.erase(id);
+  _nb_released_locs += entry.nb_locs;
+  entry.nb_locs = 0;
+  entry.container_id.clear();
+  _free_ids.push_back(id);
+  maybe_compact();
+}
+
+void StackTable::maybe_compact() {
+  if (_arena.size() < k_min_arena_compaction_size ||
+      _nb_released_locs * 2 < _arena.size()) {
+    return;
+  }
+  // Ids are stable, only offsets move
+  std::vector<FunLoc> arena;
+  arena.reserve(_arena.size() - _nb_released_locs);
+  for (Entry &entry : _entries) {
+    if (!entry.ref_count) {
+      entry.offset = 0;
+      continue;
+    }
+    const auto first = _arena.begin() + entry.offset;
+    entry.offset = static_cast<uint32_t>(arena.size());
+    arena.insert(arena.end(), first, first + entry.nb_locs);
+  }
+  _arena = std::move(arena);
+  _nb_released_locs = 0;
+}
+
+} // namespace ddprof
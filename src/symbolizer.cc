@@ -10,6 +10,7 @@
 #include "demangler/demangler.hpp"
 #include "logger.hpp"
 
+#include <array>
 #include <cassert>
 
 namespace ddprof {
@@ -21,6 +22,42 @@ inline void write_location_no_sym(ElfAddress_t ip, const MapInfo &mapinfo,
   ffi_location->address = ip;
 }
 
+namespace {
+DDRes symbolize_go(const GoPclntab &go_pclntab,
+                   std::span<ElfAddress_t> elf_addrs,
+                   std::span<ProcessAddress_t> reported_addrs,
+                   const MapInfo &map_info,
+                   std::span<ddog_prof_Location> locations,
+                   unsigned &write_index, bool inlined_functions) {
+  std::array<GoFrame, GoPclntab::k_max_inline_depth> frames;
+  for (size_t i = 0; i < elf_addrs.size(); ++i) {
+    const size_t nb_frames = go_pclntab.symbolize(elf_addrs[i], frames);
+    if (nb_frames == 0) {
+      if (write_index >= locations.size()) {
+        return ddres_warn(DD_WHAT_UW_MAX_DEPTH);
+      }
+      write_location_no_sym(reported_addrs[i], map_info,
+                            &locations[write_index++]);
+      continue;
+    }
+    // frames are innermost first: only keep the outer function if inlined
+    // frames are not requested
+    for (size_t j = inlined_functions ? 0 : nb_frames - 1; j < nb_frames;
+         ++j) {
+      if (write_index >= locations.size()) {
+        return ddres_warn(DD_WHAT_UW_MAX_DEPTH);
+      }
+      const GoFrame &frame = frames[j];
+      write_location(reported_addrs[i], frame.function,
+                     frame.file.empty() ? std::string_view{map_info._sopath}
+                                        : frame.file,
+                     frame.line, map_info, &locations[write_index++]);
+    }
+  }
+  return {};
+}
+} // namespace
+
 int Symbolizer::remove_unvisited() {
   // Remove all unvisited blaze_symbolizer instances from the map
   const auto count = std::erase_if(_symbolizer_map, [](const auto &item) {
@@ -47,6 +84,7 @@ Symbolizer::get_symbolizer(FileInfoId_t file_id, const std::string &elf_src) {
   DDPROF_DCHECK_FATAL(inserted, "Unable to insert symbolizer object");
   auto &symbolizer_wrapper = it->second;
   symbolizer_wrapper.visited = true;
+  symbolizer_wrapper.go_pclntab = GoPclntab::open(elf_src);
   return symbolizer_wrapper;
 }
 
@@ -66,6 +104,13 @@ DDRes Symbolizer::symbolize_pprof(std::span<ElfAddress_t> elf_addrs,
 
   if (!_disable_symbolization) {
     auto &symbolizer_wrapper = get_symbolizer(file_id, elf_src);
+    if (symbolizer_wrapper.go_pclntab) {
+      return symbolize_go(*symbolizer_wrapper.go_pclntab, elf_addrs,
+                          _reported_addr_format == k_elf ? elf_addrs
+                                                         : process_addrs,
+                          map_info, locations, write_index,
+                          inlined_functions);
+    }
 
     blaze_symbolize_src_elf src_elf{
         .type_size = sizeof(blaze_symbolize_src_elf),
@@ -0,0 +1,172 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include "syscall_names.hpp"
+
+#include <string>
+#include <sys/syscall.h>
+#include <unordered_map>
+
+namespace ddprof {
+
+namespace {
+struct SyscallName {
+  uint64_t nr;
+  std::string_view name;
+};
+
+#define SYSCALL_NAME(name) {SYS_##name, #name},
+
+// Syscalls that usually matter for latency (blocking I/O, waits, memory).
+// Syscalls only defined on some architectures are guarded.
+constexpr SyscallName k_syscall_names[] = {
+    // clang-format off
+    SYSCALL_NAME(read)
+    SYSCALL_NAME(write)
+    SYSCALL_NAME(pread64)
+    SYSCALL_NAME(pwrite64)
+    SYSCALL_NAME(readv)
+    SYSCALL_NAME(writev)
+    SYSCALL_NAME(preadv)
+    SYSCALL_NAME(pwritev)
+    SYSCALL_NAME(openat)
+    SYSCALL_NAME(close)
+    SYSCALL_NAME(lseek)
+    SYSCALL_NAME(fsync)
+    SYSCALL_NAME(fdatasync)
+    SYSCALL_NAME(sync_file_range)
+    SYSCALL_NAME(fallocate)
+    SYSCALL_NAME(ftruncate)
+    SYSCALL_NAME(getdents64)
+    SYSCALL_NAME(newfstatat)
+    SYSCALL_NAME(fstat)
+    SYSCALL_NAME(statx)
+    SYSCALL_NAME(unlinkat)
+    SYSCALL_NAME(mkdirat)
+    SYSCALL_NAME(ioctl)
+    SYSCALL_NAME(fcntl)
+    SYSCALL_NAME(flock)
+    SYSCALL_NAME(sendfile)
+    SYSCALL_NAME(splice)
+    SYSCALL_NAME(tee)
+    SYSCALL_NAME(pipe2)
+    SYSCALL_NAME(dup3)
+    SYSCALL_NAME(socket)
+    SYSCALL_NAME(connect)
+    SYSCALL_NAME(accept4)
+    SYSCALL_NAME(bind)
+    SYSCALL_NAME(listen)
+    SYSCALL_NAME(shutdown)
+    SYSCALL_NAME(sendto)
+    SYSCALL_NAME(recvfrom)
+    SYSCALL_NAME(sendmsg)
+    SYSCALL_NAME(recvmsg)
+    SYSCALL_NAME(sendmmsg)
+    SYSCALL_NAME(recvmmsg)
+    SYSCALL_NAME(getsockopt)
+    SYSCALL_NAME(setsockopt)
+    SYSCALL_NAME(epoll_create1)
+    SYSCALL_NAME(epoll_ctl)
+    SYSCALL_NAME(epoll_pwait)
+    SYSCALL_NAME(ppoll)
+    SYSCALL_NAME(pselect6)
+    SYSCALL_NAME(eventfd2)
+    SYSCALL_NAME(timerfd_settime)
+    SYSCALL_NAME(futex)
+    SYSCALL_NAME(nanosleep)
+    SYSCALL_NAME(clock_nanosleep)
+    SYSCALL_NAME(clock_gettime)
+    SYSCALL_NAME(sched_yield)
+    SYSCALL_NAME(sched_getaffinity)
+    SYSCALL_NAME(wait4)
+    SYSCALL_NAME(waitid)
+    SYSCALL_NAME(clone)
+    SYSCALL_NAME(execve)
+    SYSCALL_NAME(exit)
+    SYSCALL_NAME(exit_group)
+    SYSCALL_NAME(kill)
+    SYSCALL_NAME(tgkill)
+    SYSCALL_NAME(rt_sigaction)
+    SYSCALL_NAME(rt_sigprocmask)
+    SYSCALL_NAME(rt_sigtimedwait)
+    SYSCALL_NAME(mmap)
+    SYSCALL_NAME(munmap)
+    SYSCALL_NAME(mprotect)
+    SYSCALL_NAME(mremap)
+    SYSCALL_NAME(madvise)
+    SYSCALL_NAME(msync)
+    SYSCALL_NAME(mlock)
+    SYSCALL_NAME(brk)
+    SYSCALL_NAME(getrandom)
+    SYSCALL_NAME(io_setup)
+    SYSCALL_NAME(io_submit)
+    SYSCALL_NAME(io_getevents)
+    SYSCALL_NAME(io_uring_enter)
+    SYSCALL_NAME(perf_event_open)
+    SYSCALL_NAME(process_vm_readv)
+    SYSCALL_NAME(membarrier)
+#ifdef SYS_open
+    SYSCALL_NAME(open)
+#endif
+#ifdef SYS_stat
+    SYSCALL_NAME(stat)
+    SYSCALL_NAME(lstat)
+#endif
+#ifdef SYS_poll
+    SYSCALL_NAME(poll)
+#endif
+#ifdef SYS_select
+    SYSCALL_NAME(select)
+#endif
+#ifdef SYS_epoll_wait
+    SYSCALL_NAME(epoll_wait)
+#endif
+#ifdef SYS_accept
+    SYSCALL_NAME(accept)
+#endif
+#ifdef SYS_pipe
+    SYSCALL_NAME(pipe)
+#endif
+#ifdef SYS_fork
+    SYSCALL_NAME(fork)
+    SYSCALL_NAME(vfork)
+#endif
+#ifdef SYS_pause
+    SYSCALL_NAME(pause)
+#endif
+#ifdef SYS_renameat
+    SYSCALL_NAME(renameat)
+#endif
+#ifdef SYS_clone3
+    SYSCALL_NAME(clone3)
+#endif
+    // clang-format on
+};
+
+#undef SYSCALL_NAME
+} // namespace
+
+std::string_view syscall_name(uint64_t nr) {
+  static const std::unordered_map<uint64_t, std::string_view> names = [] {
+    std::unordered_map<uint64_t, std::string_view> map;
+    for (const auto &el : k_syscall_names) {
+      map.emplace(el.nr, el.name);
+    }
+    return map;
+  }();
+  // map nodes are stable: views of the strings remain valid
+  static std::unordered_map<uint64_t, std::string> unknown_names;
+
+  if (auto it = names.find(nr); it != names.end()) {
+    return it->second;
+  }
+  auto [it, inserted] = unknown_names.try_emplace(nr);
+  if (inserted) {
+    it->second = "sys_" + std::to_string(nr);
+  }
+  return it->second;
+}
+
+} // namespace ddprof
@@ -55,6 +55,27 @@ void unwind_init_sample(UnwindState *us, const uint64_t *sample_regs,
   us->pid = sample_pid;
   us->stack_sz = sample_size_stack;
   us->stack = sample_data_stack;
+  us->callchain.reset();
+}
+
+void unwind_init_sample_callchain(UnwindState *us, pid_t sample_pid,
+                                  std::span<const uint64_t> callchain) {
+  us->output.clear();
+  unwind_registers_clear(&us->initial_regs);
+  us->current_ip = callchain.empty() ? 0 : callchain.front();
+  us->pid = sample_pid;
+  us->stack_sz = 0;
+  us->stack = nullptr;
+  us->callchain = callchain;
+}
+
+void unwind_init_sample_hybrid(UnwindState *us, const uint64_t *sample_regs,
+                               pid_t sample_pid, uint64_t sample_size_stack,
+                               const char *sample_data_stack,
+                               std::span<const uint64_t> callchain) {
+  unwind_init_sample(us, sample_regs, sample_pid, sample_size_stack,
+                     sample_data_stack);
+  us->callchain = callchain;
 }
 
 DDRes unwindstate_unwind(UnwindState *us) {
@@ -72,7 +93,13 @@ DDRes unwindstate_unwind(UnwindState *us) {
     avoid_new_attach = true;
   }
   if (us->pid != 0) { // we can not unwind pid 0
-    res = unwind_dwfl(process, avoid_new_attach, us);
+    if (!us->callchain) {
+      res = unwind_dwfl(process, avoid_new_attach, us);
+    } else if (us->stack) {
+      res = unwind_dwfl_hybrid(process, avoid_new_attach, us);
+    } else {
+      res = unwind_dwfl_callchain(process, avoid_new_attach, us);
+    }
   }
   if (IsDDResNotOK(res)) {
     if (res._what == DD_WHAT_UW_MAX_PIDS) {
@@ -16,12 +16,17 @@
 #include "unwind_helper.hpp"
 #include "unwind_state.hpp"
 
+#include <algorithm>
 #include <fcntl.h>
+#include <linux/perf_event.h>
 
 namespace ddprof {
 
 namespace {
 
+// Hybrid unwinding stops using the stack after this number of frames
+constexpr size_t k_max_hybrid_dwarf_frames = 16;
+
 int frame_cb(Dwfl_Frame * /*dwfl_frame*/, void * /*arg*/);
 
 DDRes add_unsymbolized_frame(UnwindState *us, const Dso &dso, ElfAddress_t pc,
@@ -64,13 +69,22 @@ DDRes add_runtime_symbol_frame(UnwindState *us, const Dso &dso, ElfAddress_t pc,
                                std::string_view jitdump_path);
 
 // returns an OK status if we should continue unwinding
-DDRes add_symbol(Dwfl_Frame *dwfl_frame, UnwindState *us) {
+DDRes check_max_stack_depth(UnwindState *us) {
   if (is_max_stack_depth_reached(*us)) {
     add_common_frame(us, SymbolErrors::truncated_stack);
     LG_DBG("Max stack depth reached (depth#%lu)", us->output.locs.size());
     ddprof_stats_add(STATS_UNWIND_TRUNCATED_OUTPUT, 1, nullptr);
     return ddres_warn(DD_WHAT_UW_MAX_DEPTH);
   }
+  return {};
+}
+
+// Without dwfl_frame, pc is a return address unless it is the first frame
+DDRes add_pc_frame(Dwfl_Frame *dwfl_frame, Dwarf_Addr pc, UnwindState *us);
+
+// returns an OK status if we should continue unwinding
+DDRes add_symbol(Dwfl_Frame *dwfl_frame, UnwindState *us) {
+  DDRES_CHECK_FWD(check_max_stack_depth(us));
 
   Dwarf_Addr pc = 0;
   if (!dwfl_frame_pc(dwfl_frame, &pc, nullptr)) {
@@ -79,6 +93,10 @@ DDRes add_symbol(Dwfl_Frame *dwfl_frame, UnwindState *us) {
     add_error_frame(nullptr, us, pc, SymbolErrors::unwind_failure);
     return {}; // invalid pc : do not add frame
   }
+  return add_pc_frame(dwfl_frame, pc, us);
+}
+
+DDRes add_pc_frame(Dwfl_Frame *dwfl_frame, Dwarf_Addr pc, UnwindState *us) {
   us->current_ip = pc;
   DsoHdr &dsoHdr = us->dso_hdr;
   DsoHdr::PidMapping &pid_mapping = dsoHdr.get_pid_mapping(us->pid);
@@ -159,7 +177,9 @@ DDRes add_symbol(Dwfl_Frame *dwfl_frame, UnwindState *us) {
   // frame
   bool is_activation = false;
 
-  if (!dwfl_frame_pc(dwfl_frame, &pc, &is_activation)) {
+  if (!dwfl_frame) {
+    is_activation = us->output.locs.empty();
+  } else if (!dwfl_frame_pc(dwfl_frame, &pc, &is_activation)) {
     LG_DBG("Failure to compute frame PC: %s (depth#%lu)", dwfl_errmsg(-1),
            us->output.locs.size());
     add_error_frame(nullptr, us, pc, SymbolErrors::unwind_failure);
@@ -178,6 +198,54 @@ DDRes add_symbol(Dwfl_Frame *dwfl_frame, UnwindState *us) {
   return {};
 }
 
+// Add frames for pcs of a callchain (the first one is the sampled pc when no
+// frame was added yet)
+DDRes add_callchain_frames(std::span<const uint64_t> callchain,
+                           UnwindState *us) {
+  for (const uint64_t pc : callchain) {
+    if (pc >= PERF_CONTEXT_MAX) {
+      // context marker of kernel callchains (eg. PERF_CONTEXT_USER)
+      continue;
+    }
+    ddprof_stats_add(STATS_UNWIND_FRAMES, 1, nullptr);
+    if (IsDDResNotOK(check_max_stack_depth(us)) ||
+        IsDDResNotOK(add_pc_frame(nullptr, pc, us))) {
+      break;
+    }
+  }
+  return !us->output.locs.empty() ? ddres_init()
+                                  : ddres_warn(DD_WHAT_DWFL_LIB_ERROR);
+}
+
+struct HybridUnwind {
+  UnwindState *us;
+  std::span<const uint64_t> callchain; // user pcs, leaf first
+  // position in the callchain of the first return address the dwarf
+  // unwinding agrees on (0 if none)
+  size_t splice_pos{0};
+};
+
+// frame_cb callback of the hybrid unwinding: stops at the first return
+// address found in the callchain
+int hybrid_frame_cb(Dwfl_Frame *dwfl_frame, void *arg) {
+  auto *hybrid = static_cast<HybridUnwind *>(arg);
+  UnwindState *us = hybrid->us;
+  Dwarf_Addr pc = 0;
+  // the leaf pc is the same for both
+  if (!us->output.locs.empty() && dwfl_frame_pc(dwfl_frame, &pc, nullptr)) {
+    auto it = std::find(hybrid->callchain.begin() + 1,
+                        hybrid->callchain.end(), pc);
+    if (it != hybrid->callchain.end()) {
+      hybrid->splice_pos = it - hybrid->callchain.begin();
+      return DWARF_CB_ABORT;
+    }
+  }
+  if (us->output.locs.size() >= k_max_hybrid_dwarf_frames) {
+    return DWARF_CB_ABORT;
+  }
+  return frame_cb(dwfl_frame, us);
+}
+
 // frame_cb callback at every frame for the dwarf unwinding
 int frame_cb(Dwfl_Frame *dwfl_frame, void *arg) {
   auto *us = static_cast<UnwindState *>(arg);
@@ -277,4 +345,41 @@ DDRes unwind_dwfl(Process &process, bool avoid_new_attach, UnwindState *us) {
   return res;
 }
 
+DDRes unwind_dwfl_callchain(Process &process, bool avoid_new_attach,
+                            UnwindState *us) {
+  // Modules are registered in dwfl to get their build id and bias
+  DDRes res = unwind_init_dwfl(process, avoid_new_attach, us);
+  if (!IsDDResOK(res)) {
+    LOG_ERROR_DETAILS(LG_DBG, res._what);
+    return res;
+  }
+  return add_callchain_frames(*us->callchain, us);
+}
+
+DDRes unwind_dwfl_hybrid(Process &process, bool avoid_new_attach,
+                         UnwindState *us) {
+  DDRes const res = unwind_init_dwfl(process, avoid_new_attach, us);
+  if (!IsDDResOK(res)) {
+    LOG_ERROR_DETAILS(LG_DBG, res._what);
+    return res;
+  }
+  std::span<const uint64_t> callchain = *us->callchain;
+  while (!callchain.empty() && callchain.front() >= PERF_CONTEXT_MAX) {
+    callchain = callchain.subspan(1);
+  }
+  if (callchain.empty()) {
+    return add_callchain_frames(callchain, us);
+  }
+  HybridUnwind hybrid{.us = us, .callchain = callchain};
+  dwfl_getthread_frames(us->_dwfl_wrapper->_dwfl, us->pid, hybrid_frame_cb,
+                        &hybrid);
+  if (hybrid.splice_pos == 0) {
+    // dwarf and frame pointers never agreed: frame pointers only
+    LG_DBG("No common frame for hybrid unwinding (depth#%lu)",
+           us->output.locs.size());
+    us->output.locs.clear();
+  }
+  return add_callchain_frames(callchain.subspan(hybrid.splice_pos), us);
+}
+
 } // namespace ddprof
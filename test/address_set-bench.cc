@@ -0,0 +1,96 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <vector>
+
+#include "address_set.hpp"
+#include "live_allocation-c.hpp"
+
+namespace ddprof {
+
+namespace {
+// Sizes used by the allocation tracker
+constexpr unsigned k_nb_addresses = liveallocation::kMaxTracked;
+constexpr size_t k_capacity = size_t{k_nb_addresses} * 3 / 2;
+
+std::vector<uintptr_t> random_addresses(uint64_t seed = 0) {
+  std::mt19937_64 gen{seed};
+  std::vector<uintptr_t> addresses(k_nb_addresses);
+  for (auto &addr : addresses) {
+    // 16 byte aligned user space addresses
+    addr = (gen() & 0x7ffffffffff0) + 0x10;
+  }
+  return addresses;
+}
+
+// Fill the set to its tracking limit (returns the number of addresses that
+// could not be added)
+int64_t fill(AddressSet &set, const std::vector<uintptr_t> &addresses) {
+  int64_t nb_collisions = 0;
+  for (auto addr : addresses) {
+    nb_collisions += !set.add(addr);
+  }
+  return nb_collisions;
+}
+
+} // namespace
+
+// Remove and add back tracked addresses
+static void BM_AddressSet_AddRemove(benchmark::State &state) {
+  AddressSet set{k_capacity};
+  const auto addresses = random_addresses();
+  const int64_t nb_collisions = fill(set, addresses);
+  size_t pos = 0;
+  for (auto _ : state) {
+    const uintptr_t addr = addresses[pos];
+    set.remove(addr);
+    set.add(addr);
+    pos = (pos + 1) % addresses.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["collision_rate"] =
+      static_cast<double>(nb_collisions) / addresses.size();
+}
+
+BENCHMARK(BM_AddressSet_AddRemove);
+
+// Remove addresses that are not tracked (most frees)
+static void BM_AddressSet_RemoveUntracked(benchmark::State &state) {
+  AddressSet set{k_capacity};
+  fill(set, random_addresses());
+  const auto untracked = random_addresses(1);
+  size_t pos = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(set.remove(untracked[pos]));
+    pos = (pos + 1) % untracked.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_AddressSet_RemoveUntracked);
+
+// Evict a slice of a full set (as done when too many addresses are tracked)
+static void BM_AddressSet_ClearSlice(benchmark::State &state) {
+  AddressSet set{k_capacity};
+  constexpr unsigned k_nb_slices = 16;
+  const auto addresses = random_addresses();
+  unsigned index = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (auto addr : addresses) {
+      set.add(addr);
+    }
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(set.clear_slice(index, k_nb_slices));
+    index = (index + 1) % k_nb_slices;
+  }
+}
+
+BENCHMARK(BM_AddressSet_ClearSlice)->Iterations(64);
+
+} // namespace ddprof
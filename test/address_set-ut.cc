@@ -0,0 +1,184 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "address_set.hpp"
+#include "live_allocation-c.hpp"
+
+namespace ddprof {
+
+TEST(address_set, simple) {
+  AddressSet address_set(1024);
+  EXPECT_GE(address_set.capacity(), 1024);
+  EXPECT_TRUE(address_set.add(0xbadbeef));
+  EXPECT_FALSE(address_set.add(0xbadbeef));
+  EXPECT_EQ(address_set.count(), 1);
+  EXPECT_TRUE(address_set.remove(0xbadbeef));
+  EXPECT_FALSE(address_set.remove(0xbadbeef));
+  EXPECT_EQ(address_set.count(), 0);
+  // null is never tracked
+  EXPECT_FALSE(address_set.add(0));
+}
+
+TEST(address_set, empty) {
+  AddressSet address_set;
+  EXPECT_FALSE(address_set.add(0xbadbeef));
+  EXPECT_FALSE(address_set.remove(0xbadbeef));
+  EXPECT_EQ(address_set.clear_slice(0, 16), 0);
+}
+
+TEST(address_set, many_addresses) {
+  // load used by the allocation tracker
+  constexpr unsigned k_nb_elements = 100000;
+  AddressSet address_set(k_nb_elements * 3 / 2);
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  std::uniform_int_distribution<uintptr_t> dis(
+      1, std::numeric_limits<uintptr_t>::max());
+
+  std::vector<uintptr_t> addresses;
+  for (unsigned i = 0; i < k_nb_elements; ++i) {
+    const uintptr_t addr = dis(gen);
+    if (address_set.add(addr)) {
+      addresses.push_back(addr);
+    }
+  }
+  // no collision (full lines are rare)
+  EXPECT_GE(addresses.size(), k_nb_elements - (k_nb_elements / 100));
+  for (auto addr : addresses) {
+    EXPECT_TRUE(address_set.remove(addr));
+  }
+  EXPECT_EQ(0, address_set.count());
+}
+
+TEST(address_set, full_lines) {
+  // a single line (it is its own next line)
+  AddressSet address_set(AddressSet::k_nb_addresses_per_line);
+  EXPECT_EQ(address_set.capacity(), AddressSet::k_nb_addresses_per_line);
+  for (uintptr_t i = 1; i <= AddressSet::k_nb_addresses_per_line; ++i) {
+    EXPECT_TRUE(address_set.add(i * 16));
+  }
+  EXPECT_FALSE(address_set.add(0x1000000));
+  EXPECT_TRUE(address_set.remove(16));
+  EXPECT_TRUE(address_set.add(0x1000000));
+  address_set.clear();
+  EXPECT_EQ(0, address_set.count());
+  EXPECT_FALSE(address_set.remove(0x1000000));
+}
+
+TEST(address_set, clear_slice) {
+  AddressSet address_set(100000);
+  constexpr unsigned k_nb_slices = 16;
+  std::vector<uintptr_t> addresses;
+  for (uintptr_t addr = 0x1000; addr < 0x1000 + 10000 * 16; addr += 16) {
+    if (address_set.add(addr)) {
+      addresses.push_back(addr);
+    }
+  }
+  EXPECT_EQ(addresses.size(), 10000);
+  for (unsigned index : {3U, k_nb_slices - 1}) {
+    const auto slice = AddressSet::slice(index, k_nb_slices);
+    const int nb_in_slice = static_cast<int>(
+        std::count_if(addresses.begin(), addresses.end(),
+                      [&](uintptr_t addr) { return slice.contains(addr); }));
+    EXPECT_GT(nb_in_slice, 0);
+    const int count = address_set.count();
+    EXPECT_EQ(address_set.clear_slice(index, k_nb_slices), nb_in_slice);
+    EXPECT_EQ(address_set.count(), count - nb_in_slice);
+    std::erase_if(addresses,
+                  [&](uintptr_t addr) { return slice.contains(addr); });
+  }
+  // addresses of the slices are gone, others are still there
+  for (auto addr : addresses) {
+    EXPECT_TRUE(address_set.remove(addr));
+  }
+  EXPECT_EQ(0, address_set.count());
+}
+
+TEST(address_set, concurrent) {
+  constexpr unsigned k_nb_threads = 4;
+  constexpr uintptr_t k_nb_addresses = 10000;
+  AddressSet address_set(k_nb_threads * k_nb_addresses * 3 / 2);
+  std::vector<std::thread> threads;
+  std::vector<unsigned> nb_added(k_nb_threads);
+  for (unsigned t = 0; t < k_nb_threads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int round = 0; round < 10; ++round) {
+        for (uintptr_t i = 0; i < k_nb_addresses; ++i) {
+          nb_added[t] += address_set.add((t * k_nb_addresses + i + 1) << 4);
+        }
+        for (uintptr_t i = 0; i < k_nb_addresses; i += 2) {
+          address_set.remove((t * k_nb_addresses + i + 1) << 4);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  // odd addresses are added once, even ones on every round
+  for (unsigned t = 0; t < k_nb_threads; ++t) {
+    EXPECT_EQ(nb_added[t], (k_nb_addresses / 2) * 11);
+  }
+  EXPECT_EQ(address_set.count(), k_nb_threads * k_nb_addresses / 2);
+}
+
+// This test to tune the hash approach
+// Collision rate is around 5.7%, which will have an impact on sampling
+#ifdef COLLISION_TEST
+// Your hash function
+#  ifdef TEST_IDENTITY
+inline uint64_t my_hash(uintptr_t h1) { return h1; }
+#  else
+inline uint64_t my_hash(uintptr_t h1) {
+  return liveallocation::address_hash(h1);
+}
+#  endif
+
+TEST(address_set, hash_function) {
+  // Number of values to hash
+  const int num_values = 1000000;
+
+  // A large address range (33 bits)
+  const uintptr_t min_address = 0x100000000;
+  const uintptr_t max_address = 0x200000000;
+
+  // Create an unordered set to store hashed values
+  std::unordered_set<uint32_t> lower_bits_hashed_values;
+
+  // Initialize random number generator
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  std::uniform_int_distribution<uintptr_t> distribution(min_address,
+                                                        max_address);
+
+  // Generate and hash random values within the address range
+  for (int i = 0; i < num_values; ++i) {
+    uintptr_t address = distribution(gen);
+    uint32_t lower_bits = my_hash(address) & (8 * 1024 * 1024 - 1);
+    // Insert the lower 16 bits into the set
+    lower_bits_hashed_values.insert(lower_bits);
+  }
+
+  // Calculate collision statistics
+  int num_collisions = num_values - lower_bits_hashed_values.size();
+  double collision_rate =
+      static_cast<double>(num_collisions) / num_values * 100.0;
+
+  std::cout << "Hash test results:" << std::endl;
+  std::cout << "Number of values: " << num_values << std::endl;
+  std::cout << "Number of collisions: " << num_collisions << std::endl;
+  std::cout << "Collision rate: " << collision_rate << "%" << std::endl;
+}
+#endif
+} // namespace ddprof
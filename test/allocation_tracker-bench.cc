@@ -31,6 +31,7 @@ void read_buffer(ddprof::RingBufferHolder &holder) {
   int nb_alloc_samples = 0;
   int nb_dealloc_samples = 0;
   int nb_unknown_samples = 0;
+  int nb_batched_records = 0;
 
   error_in_reader = false;
   while (reader_continue) {
@@ -46,6 +47,19 @@ void read_buffer(ddprof::RingBufferHolder &holder) {
 
       } else if (hdr->type == PERF_CUSTOM_EVENT_DEALLOCATION) {
         ++nb_dealloc_samples;
+      } else if (hdr->type == PERF_CUSTOM_EVENT_BATCH) {
+        const auto *batch = reinterpret_cast<const BatchEvent *>(hdr);
+        nb_batched_records += batch->nb_records;
+        const std::byte *pos = batch->data;
+        for (uint32_t i = 0; i < batch->nb_records; ++i) {
+          const auto *record = reinterpret_cast<const perf_event_header *>(pos);
+          if (record->type == PERF_CUSTOM_EVENT_DEALLOCATION_BATCH) {
+            nb_dealloc_samples +=
+                reinterpret_cast<const DeallocationBatchEvent *>(record)
+                    ->nb_addrs;
+          }
+          pos += record->size;
+        }
       } else {
         ++nb_unknown_samples;
       }
@@ -56,8 +70,10 @@ void read_buffer(ddprof::RingBufferHolder &holder) {
           "Reader thread exit,"
           "nb_alloc_samples=%d,"
           "nb_dealloc_samples=%d,"
-          "nb_unknown_samples=%d\n",
-          nb_alloc_samples, nb_dealloc_samples, nb_unknown_samples);
+          "nb_unknown_samples=%d,"
+          "nb_batched_records=%d\n",
+          nb_alloc_samples, nb_dealloc_samples, nb_unknown_samples,
+          nb_batched_records);
   if (nb_alloc_samples == 0) {
     error_in_reader = true;
   }
@@ -314,6 +330,111 @@ static void BM_LongLived_Tracking(benchmark::State &state) {
   perform_memory_operations_2(true, state);
 }
 
+// Many threads allocating and freeing concurrently: all of them contend on
+// the ring buffer (args: number of threads, thread local batching)
+static void BM_Contention_Tracking(benchmark::State &state) {
+  LogHandle handle;
+  const int nb_threads = state.range(0);
+  uint32_t flags = ddprof::AllocationTracker::kDeterministicSampling |
+      ddprof::AllocationTracker::kTrackDeallocations;
+  if (state.range(1)) {
+    flags |= ddprof::AllocationTracker::kBatchRecords;
+  }
+  const size_t buf_size_order = 8;
+  ddprof::RingBufferHolder ring_buffer{buf_size_order,
+                                       RingBufferType::kMPSCRingBuffer};
+  // drain the ring buffer so that events are not dropped
+  reader_continue = true;
+  std::thread reader_thread{read_buffer, std::ref(ring_buffer)};
+  ddprof::AllocationTracker::allocation_tracking_init(
+      k_rate / 100, flags, k_default_perf_stack_sample_size,
+      ring_buffer.get_buffer_info(), {});
+
+  const int num_allocations = 1000;
+  const size_t page_size = 0x1000;
+  std::vector<std::thread> threads;
+  for (auto _ : state) {
+    threads.clear();
+    for (int i = 0; i < nb_threads; ++i) {
+      threads.emplace_back([&, i] {
+        ddprof::AllocationTracker::init_tl_state();
+        for (int j = 0; j < num_allocations; ++j) {
+          const uintptr_t addr = (i * page_size + j) << 4;
+          my_malloc(1024, addr);
+          my_free(addr);
+        }
+      });
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * nb_threads * num_allocations);
+
+  ddprof::AllocationTracker::allocation_tracking_free();
+  reader_continue = false;
+  reader_thread.join();
+}
+
+// A thread frees many tracked addresses in a row (arg: thread local batching)
+static void BM_FreeHeavy_Tracking(benchmark::State &state) {
+  LogHandle handle;
+  uint32_t flags = ddprof::AllocationTracker::kDeterministicSampling |
+      ddprof::AllocationTracker::kTrackDeallocations;
+  if (state.range(0)) {
+    flags |= ddprof::AllocationTracker::kBatchRecords;
+  }
+  const size_t buf_size_order = 8;
+  ddprof::RingBufferHolder ring_buffer{buf_size_order,
+                                       RingBufferType::kMPSCRingBuffer};
+  reader_continue = true;
+  std::thread reader_thread{read_buffer, std::ref(ring_buffer)};
+  // every allocation is sampled, so that every free is tracked
+  ddprof::AllocationTracker::allocation_tracking_init(
+      1, flags, k_default_perf_stack_sample_size,
+      ring_buffer.get_buffer_info(), {});
+
+  const int num_allocations = 1000;
+  std::vector<uintptr_t> addresses;
+  for (int j = 0; j < num_allocations; ++j) {
+    addresses.push_back(static_cast<uintptr_t>(j + 1) << 4);
+  }
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (auto addr : addresses) {
+      my_malloc(1024, addr);
+    }
+    state.ResumeTiming();
+    for (auto addr : addresses) {
+      my_free(addr);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num_allocations);
+
+  ddprof::AllocationTracker::allocation_tracking_free();
+  reader_continue = false;
+  reader_thread.join();
+}
+
+// Cost of the hooks for an allocation that is not sampled (most of them):
+// thread local state lookup and sampling countdown
+static void BM_Malloc_Unsampled(benchmark::State &state) {
+  LogHandle handle;
+  const size_t buf_size_order = 8;
+  ddprof::RingBufferHolder ring_buffer{buf_size_order,
+                                       RingBufferType::kMPSCRingBuffer};
+  // the rate is never reached
+  constexpr uint64_t k_unreached_rate = uint64_t{1} << 50;
+  ddprof::AllocationTracker::allocation_tracking_init(
+      k_unreached_rate, ddprof::AllocationTracker::kDeterministicSampling,
+      k_default_perf_stack_sample_size, ring_buffer.get_buffer_info(), {});
+  for (auto _ : state) {
+    my_malloc(8);
+  }
+  state.SetItemsProcessed(state.iterations());
+  ddprof::AllocationTracker::allocation_tracking_free();
+}
+
 // short lived threads
 BENCHMARK(BM_ShortLived_NoTracking)->MeasureProcessCPUTime()->UseRealTime();
 BENCHMARK(BM_ShortLived_Tracking)->MeasureProcessCPUTime()->UseRealTime();
@@ -322,4 +443,16 @@ BENCHMARK(BM_ShortLived_Tracking)->MeasureProcessCPUTime()->UseRealTime();
 BENCHMARK(BM_LongLived_NoTracking)->MeasureProcessCPUTime();
 BENCHMARK(BM_LongLived_Tracking)->MeasureProcessCPUTime();
 
+// many threads, without and with thread local batching
+BENCHMARK(BM_Contention_Tracking)
+    ->ArgsProduct({{16, 64}, {0, 1}})
+    ->MeasureProcessCPUTime()
+    ->UseRealTime();
+
+// deallocation records, without and with thread local batching
+BENCHMARK(BM_FreeHeavy_Tracking)->Arg(0)->Arg(1)->MeasureProcessCPUTime();
+
+// hook overhead per allocation
+BENCHMARK(BM_Malloc_Unsampled);
+
 } // namespace ddprof
@@ -19,6 +19,7 @@
 #include "perf_clock.hpp"
 #include "pevent_lib.hpp"
 #include "ringbuffer_holder.hpp"
+#include "savecontext.hpp"
 #include "symbol_helper.hpp"
 #include "symbol_overrides.hpp"
 #include "syscalls.hpp"
@@ -26,6 +27,8 @@
 #include "unwind.hpp"
 #include "unwind_state.hpp"
 
+#include <array>
+#include <atomic>
 #include <cstdlib>
 #include <gtest/gtest.h>
 #ifdef USE_JEMALLOC
@@ -41,7 +44,9 @@ DDPROF_WEAK void sdallocx(void *ptr, size_t size, int flags);
 }
 #endif
 #include <malloc.h>
+#include <optional>
 #include <sys/mman.h>
+#include <thread>
 #include <unistd.h>
 
 #if defined(__GNUC__) && !defined(__clang__)
@@ -172,7 +177,7 @@ TEST(allocation_tracker, start_stop) {
   ASSERT_FALSE(AllocationTracker::is_active());
 }
 
-TEST(allocation_tracker, stale_lock) {
+TEST(allocation_tracker, full_ring_buffer) {
   LogHandle log_handle;
   const uint64_t rate = 1;
   const size_t buf_size_order = 5;
@@ -184,17 +189,11 @@ TEST(allocation_tracker, stale_lock) {
       k_default_perf_stack_sample_size, ring_buffer.get_buffer_info(), {});
   defer { AllocationTracker::allocation_tracking_free(); };
 
-  // simulate stale lock
-  ring_buffer.get_ring_buffer().spinlock->lock();
-
-  for (uint32_t i = 0; i < AllocationTracker::k_max_consecutive_failures; ++i) {
-    TrackerThreadLocalState *tl_state = AllocationTracker::get_tl_state();
-    assert(tl_state);
-    if (tl_state) {
-      AllocationTracker::track_allocation_s(0xdeadbeef, 1, *tl_state);
-    }
+  // nobody reads the ring buffer: samples are lost, profiling goes on
+  for (uint32_t i = 0; i < 1000; ++i) {
+    my_malloc(1, 0x1000 + (i * 16));
   }
-  ASSERT_FALSE(AllocationTracker::is_active());
+  ASSERT_TRUE(AllocationTracker::is_active());
 }
 
 TEST(allocation_tracker, max_tracked_allocs) {
@@ -207,7 +206,7 @@ TEST(allocation_tracker, max_tracked_allocs) {
   defer { AllocationTracker::allocation_tracking_free(); };
 
   ASSERT_TRUE(ddprof::AllocationTracker::is_active());
-  bool clear_found = false;
+  bool evict_found = false;
   uint64_t nb_samples = 0;
   for (int i = 0; i <= ddprof::liveallocation::kMaxTracked +
            ddprof::liveallocation::kMaxTracked / 10;
@@ -228,16 +227,207 @@ TEST(allocation_tracker, max_tracked_allocs) {
         ASSERT_EQ(sample->pid, getpid());
         ASSERT_EQ(sample->tid, ddprof::gettid());
         ASSERT_EQ(sample->addr, addr);
-      } else {
-        if (hdr->type == PERF_CUSTOM_EVENT_CLEAR_LIVE_ALLOCATION) {
-          clear_found = true;
-        }
+      } else if (hdr->type == PERF_CUSTOM_EVENT_EVICT_LIVE_ALLOCATION) {
+        const auto *event =
+            reinterpret_cast<const EvictLiveAllocationEvent *>(hdr);
+        // only a slice of the addresses is evicted
+        EXPECT_NE(event->hash_mask, 0);
+        evict_found = true;
       }
     }
   }
   fprintf(stderr, "Number of found samples %lu (vs max = %d) \n", nb_samples,
           ddprof::liveallocation::kMaxTracked);
-  EXPECT_TRUE(clear_found);
+  EXPECT_TRUE(evict_found);
+}
+
+TEST(allocation_tracker, frame_pointers) {
+  RingBufferHolder ring_buffer{kBufSizeOrder, RingBufferType::kMPSCRingBuffer};
+  AllocationTracker::allocation_tracking_init(
+      kSamplingRate,
+      AllocationTracker::kDeterministicSampling |
+          AllocationTracker::kFramePointers,
+      k_default_perf_stack_sample_size, ring_buffer.get_buffer_info(), {});
+  defer { AllocationTracker::allocation_tracking_free(); };
+  ASSERT_TRUE(AllocationTracker::is_active());
+
+  my_func_calling_malloc(1);
+  MPSCRingBufferReader reader{&ring_buffer.get_ring_buffer()};
+  auto buf = reader.read_sample();
+  ASSERT_FALSE(buf.empty());
+  const auto *event =
+      reinterpret_cast<const AllocationCallchainEvent *>(buf.data());
+  ASSERT_EQ(event->hdr.type, PERF_CUSTOM_EVENT_ALLOCATION_CALLCHAIN);
+  EXPECT_EQ(event->hdr.size, sizeof_allocation_callchain_event(event->nr));
+  EXPECT_EQ(event->sample_id.tid, ddprof::gettid());
+  EXPECT_EQ(event->addr, 0xdeadbeef);
+  EXPECT_EQ(event->period, 1);
+  // tracker frames, then my_malloc and the callers
+  EXPECT_GT(event->nr, 4);
+  EXPECT_EQ(event->ips[0], reinterpret_cast<uint64_t>(&save_callchain));
+}
+
+TEST(allocation_tracker, sharded_ring_buffers) {
+  std::array<RingBufferHolder, 2> ring_buffers{
+      RingBufferHolder{kBufSizeOrder, RingBufferType::kMPSCRingBuffer},
+      RingBufferHolder{kBufSizeOrder, RingBufferType::kMPSCRingBuffer}};
+  const std::array<RingBufferInfo, 2> infos{
+      ring_buffers[0].get_buffer_info(), ring_buffers[1].get_buffer_info()};
+  AllocationTracker::allocation_tracking_init(
+      kSamplingRate, AllocationTracker::kDeterministicSampling,
+      k_default_perf_stack_sample_size, infos, {});
+  defer { AllocationTracker::allocation_tracking_free(); };
+  ASSERT_TRUE(AllocationTracker::is_active());
+
+  // the events of a thread always go to the same ring buffer
+  my_malloc(1, 0x1000);
+  my_malloc(1, 0x2000);
+  const unsigned shard = ddprof::gettid() % infos.size();
+  MPSCRingBufferReader reader{&ring_buffers[shard].get_ring_buffer()};
+  for (uintptr_t addr : {0x1000, 0x2000}) {
+    auto buf = reader.read_sample();
+    ASSERT_FALSE(buf.empty());
+    perf_event_sample *sample =
+        hdr2samp(reinterpret_cast<const perf_event_header *>(buf.data()),
+                 perf_event_default_sample_type() | PERF_SAMPLE_ADDR);
+    EXPECT_EQ(sample->addr, addr);
+  }
+  MPSCRingBufferReader other_reader{
+      &ring_buffers[1 - shard].get_ring_buffer()};
+  EXPECT_EQ(other_reader.available_size(), 0);
+}
+
+TEST(allocation_tracker, batched_records) {
+  RingBufferHolder ring_buffer{kBufSizeOrder, RingBufferType::kMPSCRingBuffer};
+  // events are only read while the reader is alive
+  std::optional<MPSCRingBufferReader> reader;
+  auto read_event = [&]() -> const perf_event_header * {
+    reader.emplace(&ring_buffer.get_ring_buffer());
+    auto buf = reader->read_sample();
+    return buf.empty() ? nullptr
+                       : reinterpret_cast<const perf_event_header *>(
+                             buf.data());
+  };
+  // small stack copies so that allocation records can be staged
+  constexpr uint32_t k_stack_sample_size = 512;
+
+  AllocationTracker::allocation_tracking_init(
+      kSamplingRate,
+      AllocationTracker::kDeterministicSampling |
+          AllocationTracker::kBatchRecords,
+      k_stack_sample_size, ring_buffer.get_buffer_info(), {});
+  ASSERT_TRUE(AllocationTracker::is_active());
+  my_malloc(1, 0x1000);
+  my_malloc(1, 0x2000);
+  EXPECT_FALSE(read_event());
+  // staged records are pushed when profiling stops
+  AllocationTracker::allocation_tracking_free();
+  const perf_event_header *hdr = read_event();
+  ASSERT_TRUE(hdr);
+  ASSERT_EQ(hdr->type, PERF_CUSTOM_EVENT_BATCH);
+  const auto *batch = reinterpret_cast<const BatchEvent *>(hdr);
+  ASSERT_EQ(batch->nb_records, 2);
+  EXPECT_EQ(batch->sample_id.tid, ddprof::gettid());
+  const auto *record = reinterpret_cast<const perf_event_header *>(batch->data);
+  EXPECT_EQ(record->type, PERF_RECORD_SAMPLE);
+  EXPECT_FALSE(read_event());
+
+  AllocationTracker::allocation_tracking_init(
+      kSamplingRate,
+      AllocationTracker::kDeterministicSampling |
+          AllocationTracker::kTrackDeallocations |
+          AllocationTracker::kBatchRecords,
+      k_stack_sample_size, ring_buffer.get_buffer_info(), {});
+  defer { AllocationTracker::allocation_tracking_free(); };
+  ASSERT_TRUE(AllocationTracker::is_active());
+
+  // allocations are not delayed when deallocations are tracked
+  my_malloc(1, 0x1000);
+  my_malloc(1, 0x2000);
+  for (int i = 0; i < 2; ++i) {
+    hdr = read_event();
+    ASSERT_TRUE(hdr);
+    EXPECT_EQ(hdr->type, PERF_RECORD_SAMPLE);
+  }
+
+  // deallocations are staged in a single record
+  my_free(0x1000);
+  my_free(0x2000);
+  EXPECT_FALSE(read_event());
+
+  // the next allocation pushes them first
+  my_malloc(1, 0x3000);
+  hdr = read_event();
+  ASSERT_TRUE(hdr);
+  ASSERT_EQ(hdr->type, PERF_CUSTOM_EVENT_BATCH);
+  batch = reinterpret_cast<const BatchEvent *>(hdr);
+  ASSERT_EQ(batch->nb_records, 1);
+  EXPECT_EQ(batch->sample_id.tid, ddprof::gettid());
+  const auto *event =
+      reinterpret_cast<const DeallocationBatchEvent *>(batch->data);
+  EXPECT_EQ(event->hdr.type, PERF_CUSTOM_EVENT_DEALLOCATION_BATCH);
+  EXPECT_EQ(event->sample_id.tid, ddprof::gettid());
+  ASSERT_EQ(event->nb_addrs, 2);
+  EXPECT_EQ(event->addrs[0], 0x1000);
+  EXPECT_EQ(event->addrs[1], 0x2000);
+  EXPECT_EQ(batch->data + event->hdr.size,
+            reinterpret_cast<const std::byte *>(hdr) + hdr->size);
+  hdr = read_event();
+  ASSERT_TRUE(hdr);
+  EXPECT_EQ(hdr->type, PERF_RECORD_SAMPLE);
+
+  // staged deallocations are pushed when profiling stops
+  my_free(0x3000);
+  EXPECT_FALSE(read_event());
+  AllocationTracker::allocation_tracking_free();
+  hdr = read_event();
+  ASSERT_TRUE(hdr);
+  EXPECT_EQ(hdr->type, PERF_CUSTOM_EVENT_BATCH);
+}
+
+TEST(allocation_tracker, idle_thread_batch) {
+  // the delay of staged records is measured with the clock of the ring buffer
+  PerfClock::init(PerfClockSource::kClockMonotonic);
+  RingBufferHolder ring_buffer{kBufSizeOrder, RingBufferType::kMPSCRingBuffer};
+  AllocationTracker::allocation_tracking_init(
+      kSamplingRate,
+      AllocationTracker::kDeterministicSampling |
+          AllocationTracker::kBatchRecords,
+      512, ring_buffer.get_buffer_info(), {});
+  defer { AllocationTracker::allocation_tracking_free(); };
+  ASSERT_TRUE(AllocationTracker::is_active());
+
+  // a thread stages a record, then stops allocating
+  std::atomic<pid_t> idle_tid{0};
+  std::atomic<bool> done{false};
+  std::thread idle_thread{[&]() {
+    AllocationTracker::notify_thread_start();
+    my_malloc(1, 0x1000);
+    idle_tid = ddprof::gettid();
+    while (!done) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }};
+  defer {
+    done = true;
+    idle_thread.join();
+  };
+  while (!idle_tid) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // its batch is pushed by the next thread that records an event late enough
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  my_malloc(1, 0x2000);
+  MPSCRingBufferReader reader{&ring_buffer.get_ring_buffer()};
+  auto buf = reader.read_sample();
+  ASSERT_FALSE(buf.empty());
+  const auto *batch = reinterpret_cast<const BatchEvent *>(buf.data());
+  ASSERT_EQ(batch->hdr.type, PERF_CUSTOM_EVENT_BATCH);
+  EXPECT_EQ(batch->sample_id.tid, idle_tid);
+  EXPECT_EQ(batch->nb_records, 1);
+  // the record of this thread is still staged
+  EXPECT_TRUE(reader.read_sample().empty());
 }
 
 class AllocFunctionChecker {
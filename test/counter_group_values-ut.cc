@@ -0,0 +1,71 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include <gtest/gtest.h>
+
+#include "counter_group_values.hpp"
+
+#include <array>
+
+namespace ddprof {
+
+namespace {
+// Group read: the leader, then the counters of the group
+struct GroupRead {
+  GroupRead(uint64_t id, uint64_t instructions, uint64_t cache_misses) {
+    buf[0] = 1 + k_nb_counter_group_members;
+    buf[2] = id;
+    buf[3] = instructions;
+    buf[5] = cache_misses;
+  }
+  [[nodiscard]] const read_format &get() const {
+    return *reinterpret_cast<const read_format *>(buf.data());
+  }
+  std::array<uint64_t, 1 + (2 * (1 + k_nb_counter_group_members))> buf{};
+};
+} // namespace
+
+TEST(CounterGroupValues, deltas) {
+  CounterGroupValues values;
+  CounterGroupValues::Deltas deltas{};
+  // the first read only records the values
+  EXPECT_FALSE(values.deltas(GroupRead{1, 100, 10}.get(), 0, deltas));
+  EXPECT_TRUE(values.deltas(GroupRead{1, 150, 12}.get(), 0, deltas));
+  EXPECT_EQ(deltas[0], 50);
+  EXPECT_EQ(deltas[1], 2);
+  // another leader
+  EXPECT_FALSE(values.deltas(GroupRead{2, 1000, 100}.get(), 0, deltas));
+  EXPECT_TRUE(values.deltas(GroupRead{1, 160, 12}.get(), 0, deltas));
+  EXPECT_EQ(deltas[0], 10);
+  EXPECT_EQ(deltas[1], 0);
+
+  // unexpected group
+  GroupRead read{1, 170, 12};
+  read.buf[0] = 1;
+  EXPECT_FALSE(values.deltas(read.get(), 0, deltas));
+}
+
+TEST(CounterGroupValues, inherited_counters) {
+  // Inherited events report the id of the parent event, with the counts of
+  // each thread
+  CounterGroupValues values;
+  CounterGroupValues::Deltas deltas{};
+  EXPECT_FALSE(values.deltas(GroupRead{1, 1000, 100}.get(), 10, deltas));
+  EXPECT_FALSE(values.deltas(GroupRead{1, 20, 2}.get(), 11, deltas));
+  EXPECT_TRUE(values.deltas(GroupRead{1, 1100, 101}.get(), 10, deltas));
+  EXPECT_EQ(deltas[0], 100);
+  EXPECT_EQ(deltas[1], 1);
+  EXPECT_TRUE(values.deltas(GroupRead{1, 50, 5}.get(), 11, deltas));
+  EXPECT_EQ(deltas[0], 30);
+  EXPECT_EQ(deltas[1], 3);
+  EXPECT_EQ(values.size(), 2);
+
+  // counters of exited threads are forgotten
+  values.erase(11);
+  EXPECT_EQ(values.size(), 1);
+  EXPECT_FALSE(values.deltas(GroupRead{1, 60, 6}.get(), 11, deltas));
+}
+
+} // namespace ddprof
@@ -98,6 +98,26 @@ TEST(DDProfContext, global) {
   }
 }
 
+TEST(DDProfContext, cgroup) {
+  LogHandle handle;
+  DDProfCLI ddprof_cli;
+  const char *input_values[] = {MYNAME, "--cgroup", "kubepods/pod1"};
+  DDProfContext ctx;
+  {
+    int res = ddprof_cli.parse(std::size(input_values), input_values);
+    ASSERT_EQ(res, 0);
+    EXPECT_TRUE(ddprof_cli.continue_exec);
+  }
+  {
+    DDRes res = context_set(ddprof_cli, ctx);
+    EXPECT_TRUE(IsDDResOK(res));
+    // same watchers as global mode
+    EXPECT_EQ(ctx.watchers.size(), 1);
+    EXPECT_EQ(ctx.params.pid, -1);
+    EXPECT_EQ(ctx.params.cgroup, "kubepods/pod1");
+  }
+}
+
 TEST(DDProfContext, version_called) {
   DDProfCLI ddprof_cli;
   const char *input_values[] = {MYNAME, "-v", "my_program"};
@@ -52,4 +52,22 @@ TEST(ddprof_cpumask, parse_cpu_mask) {
   ASSERT_TRUE(CPU_ISSET(32, &cpus));
 }
 
+TEST(ddprof_cpumask, parse_cpu_list) {
+  cpu_set_t cpus;
+  ASSERT_TRUE(parse_cpu_list("0", cpus));
+  ASSERT_EQ(CPU_COUNT(&cpus), 1);
+  ASSERT_TRUE(CPU_ISSET(0, &cpus));
+  ASSERT_TRUE(parse_cpu_list("0-3,8,10-11\n", cpus));
+  ASSERT_EQ(CPU_COUNT(&cpus), 7);
+  ASSERT_TRUE(CPU_ISSET(3, &cpus));
+  ASSERT_TRUE(CPU_ISSET(8, &cpus));
+  ASSERT_FALSE(CPU_ISSET(9, &cpus));
+  ASSERT_TRUE(CPU_ISSET(11, &cpus));
+  ASSERT_TRUE(parse_cpu_list("", cpus));
+  ASSERT_EQ(CPU_COUNT(&cpus), 0);
+  ASSERT_FALSE(parse_cpu_list("3-1", cpus));
+  ASSERT_FALSE(parse_cpu_list("1-", cpus));
+  ASSERT_FALSE(parse_cpu_list("a", cpus));
+}
+
 } // namespace ddprof
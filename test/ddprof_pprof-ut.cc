@@ -84,6 +84,128 @@ TEST(DDProfPProf, aggregate) {
   EXPECT_TRUE(IsDDResOK(res));
 }
 
+TEST(DDProfPProf, pre_aggregate) {
+  LogHandle handle;
+  SymbolHdr symbol_hdr;
+  UnwindOutput mock_output;
+  SymbolTable &table = symbol_hdr._symbol_table;
+  MapInfoTable &mapinfo_table = symbol_hdr._mapinfo_table;
+  FileInfoVector file_infos;
+  fill_unwind_symbols(table, mapinfo_table, mock_output);
+  DDProfPProf pprof;
+  DDProfContext ctx = {};
+
+  bool ok = watchers_from_str("sCPU", ctx.watchers);
+  EXPECT_TRUE(ok);
+  DDRes res = pprof_create_profile(&pprof, ctx);
+  EXPECT_TRUE(IsDDResOK(res));
+  StackTable &stack_table = ctx.worker_ctx.stack_table;
+  const StackKey key{stack_table.intern(mock_output), 42, 42};
+  for (int i = 0; i < 3; ++i) {
+    res = pprof_pre_aggregate(key, {1000, 1, 0}, &ctx.watchers[0], kSumPos,
+                              stack_table, &pprof);
+    EXPECT_TRUE(IsDDResOK(res));
+  }
+  // a different thread is a different label set
+  const StackKey other_key{key.stack_id, 42, 43};
+  res = pprof_pre_aggregate(other_key, {500, 1, 0}, &ctx.watchers[0], kSumPos,
+                            stack_table, &pprof);
+  EXPECT_TRUE(IsDDResOK(res));
+  stack_table.release(key.stack_id);
+
+  ASSERT_EQ(pprof._pre_aggregated.size(), 1);
+  ASSERT_EQ(pprof._pre_aggregated[42].size(), 1);
+  const auto &stacks = pprof._pre_aggregated[42].begin()->second;
+  ASSERT_EQ(stacks.size(), 2);
+  EXPECT_EQ(stacks.at(key)._value, 3000);
+  EXPECT_EQ(stacks.at(key)._count, 3);
+  EXPECT_EQ(stacks.at(other_key)._value, 500);
+  EXPECT_EQ(stack_table.size(), 1);
+
+  res = pprof_flush_pre_aggregated(stack_table, symbol_hdr, file_infos, false,
+                                   ctx.worker_ctx.symbolizer, &pprof);
+  EXPECT_TRUE(IsDDResOK(res));
+  EXPECT_TRUE(pprof._pre_aggregated.empty());
+  // stacks are released once flushed
+  EXPECT_EQ(stack_table.size(), 0);
+
+  test_pprof(&pprof);
+
+  // the stacks of a process can be flushed on their own
+  res = pprof_pre_aggregate(key, {1000, 1, 0}, &ctx.watchers[0], kSumPos,
+                            stack_table, &pprof);
+  EXPECT_TRUE(IsDDResOK(res));
+  const StackKey other_pid_key{key.stack_id, 43, 43};
+  res = pprof_pre_aggregate(other_pid_key, {1000, 1, 0}, &ctx.watchers[0],
+                            kSumPos, stack_table, &pprof);
+  EXPECT_TRUE(IsDDResOK(res));
+  res = pprof_flush_pre_aggregated_pid(43, stack_table, symbol_hdr, file_infos,
+                                       false, ctx.worker_ctx.symbolizer,
+                                       &pprof);
+  EXPECT_TRUE(IsDDResOK(res));
+  EXPECT_EQ(pprof._pre_aggregated.size(), 1);
+  EXPECT_TRUE(pprof._pre_aggregated.contains(42));
+  res = pprof_flush_pre_aggregated(stack_table, symbol_hdr, file_infos, false,
+                                   ctx.worker_ctx.symbolizer, &pprof);
+  EXPECT_TRUE(IsDDResOK(res));
+
+  // stacks left in the table are released when the profile is freed
+  res = pprof_pre_aggregate(key, {1000, 1, 0}, &ctx.watchers[0], kSumPos,
+                            stack_table, &pprof);
+  EXPECT_TRUE(IsDDResOK(res));
+  EXPECT_EQ(stack_table.size(), 1);
+  res = pprof_free_profile(&pprof);
+  EXPECT_TRUE(IsDDResOK(res));
+  EXPECT_EQ(stack_table.size(), 0);
+}
+
+TEST(DDProfPProf, aggregate_cached) {
+  LogHandle handle;
+  SymbolHdr symbol_hdr;
+  UnwindOutput mock_output;
+  SymbolTable &table = symbol_hdr._symbol_table;
+  MapInfoTable &mapinfo_table = symbol_hdr._mapinfo_table;
+  FileInfoVector file_infos;
+  fill_unwind_symbols(table, mapinfo_table, mock_output);
+  DDProfPProf pprof;
+  DDProfContext ctx = {};
+
+  bool ok = watchers_from_str("sALLOC mode=l", ctx.watchers);
+  EXPECT_TRUE(ok);
+  DDRes res = pprof_create_profile(&pprof, ctx);
+  EXPECT_TRUE(IsDDResOK(res));
+  StackTable &stack_table = ctx.worker_ctx.stack_table;
+  const StackKey key{stack_table.intern(mock_output), 42, 42};
+  std::shared_ptr<const SymbolizedStack> cache;
+  res = pprof_aggregate_cached(key, stack_table, symbol_hdr, {1000, 1, 0},
+                               &ctx.watchers[0], file_infos, false,
+                               kLiveSumPos, ctx.worker_ctx.symbolizer, cache,
+                               &pprof);
+  EXPECT_TRUE(IsDDResOK(res));
+  ASSERT_TRUE(cache);
+  const SymbolizedStack *symbolized = cache.get();
+  ASSERT_FALSE(cache->locations().empty());
+  // strings are owned by the cache
+  for (const auto &loc : cache->locations()) {
+    for (const auto &symbol : table) {
+      EXPECT_NE(loc.function.name.ptr, symbol._demangled_name.data());
+    }
+  }
+
+  // next export reuses the symbolized locations
+  res = pprof_aggregate_cached(key, stack_table, symbol_hdr, {2000, 2, 0},
+                               &ctx.watchers[0], file_infos, false,
+                               kLiveSumPos, ctx.worker_ctx.symbolizer, cache,
+                               &pprof);
+  EXPECT_TRUE(IsDDResOK(res));
+  EXPECT_EQ(cache.get(), symbolized);
+
+  test_pprof(&pprof);
+  stack_table.release(key.stack_id);
+  res = pprof_free_profile(&pprof);
+  EXPECT_TRUE(IsDDResOK(res));
+}
+
 TEST(DDProfPProf, just_live) {
   LogHandle handle;
   SymbolHdr symbol_hdr;
@@ -123,4 +245,43 @@ TEST(DDProfPProf, just_live) {
   EXPECT_TRUE(IsDDResOK(res));
 }
 
+TEST(DDProfPProf, lifetime) {
+  LogHandle handle;
+  SymbolHdr symbol_hdr;
+  UnwindOutput mock_output;
+  SymbolTable &table = symbol_hdr._symbol_table;
+  MapInfoTable &mapinfo_table = symbol_hdr._mapinfo_table;
+  FileInfoVector file_infos;
+  fill_unwind_symbols(table, mapinfo_table, mock_output);
+  DDProfPProf pprof;
+  DDProfContext ctx = {};
+
+  bool ok = watchers_from_str("sALLOC mode=st", ctx.watchers);
+  EXPECT_TRUE(ok);
+  EXPECT_TRUE(
+      Any(ctx.watchers[0].aggregation_mode & EventAggregationMode::kLifetime));
+  DDRes res = pprof_create_profile(&pprof, ctx);
+  EXPECT_TRUE(IsDDResOK(res));
+  EXPECT_NE(ctx.watchers[0].pprof_indices[kLifetimePos].pprof_index, -1);
+  EXPECT_NE(ctx.watchers[0].pprof_indices[kLifetimePos].pprof_count_index, -1);
+  EXPECT_EQ(ctx.watchers[0].pprof_indices[kLiveSumPos].pprof_index, -1);
+
+  StackTable &stack_table = ctx.worker_ctx.stack_table;
+  const StackKey key{stack_table.intern(mock_output), 42, 42};
+  std::shared_ptr<const SymbolizedStack> cache;
+  res = pprof_aggregate_lifetime(key, stack_table, symbol_hdr, {1000, 10, 0},
+                                 &ctx.watchers[0], file_infos, false, "<1us",
+                                 ctx.worker_ctx.symbolizer, cache, &pprof);
+  EXPECT_TRUE(IsDDResOK(res));
+  res = pprof_aggregate_lifetime(key, stack_table, symbol_hdr, {500, 1, 0},
+                                 &ctx.watchers[0], file_infos, false, ">=10s",
+                                 ctx.worker_ctx.symbolizer, cache, &pprof);
+  EXPECT_TRUE(IsDDResOK(res));
+
+  test_pprof(&pprof);
+  stack_table.release(key.stack_id);
+  res = pprof_free_profile(&pprof);
+  EXPECT_TRUE(IsDDResOK(res));
+}
+
 } // namespace ddprof
@@ -5,6 +5,7 @@
 
 #include "ddprof_cmdline.hpp"
 #include "ddprof_cmdline_watcher.hpp"
+#include "event_config.hpp"
 #include "perf_archmap.hpp"
 #include "perf_watcher.hpp"
 
@@ -188,6 +189,11 @@ TEST(CmdLineTst, ParserKeyPatterns) {
                   EventAggregationMode::kSum)); // watcher.output_mode <=
                                                 // EventConfMode::kCallgraph
 
+  // T or t designate allocation lifetimes
+  ASSERT_TRUE(watcher_from_str("e=sALLOC mode=st", &watcher));
+  EXPECT_TRUE(Any(watcher.aggregation_mode & EventAggregationMode::kLifetime));
+  EXPECT_FALSE(Any(watcher.aggregation_mode & EventAggregationMode::kLiveSum));
+
   // M or m is a metric (no callgraph unless specified)
   ASSERT_TRUE(watcher_from_str("e=hCPU mode=s", &watcher));
   ASSERT_TRUE(Any(watcher.aggregation_mode &
@@ -298,6 +304,86 @@ TEST(CmdLineTst, LastEventHit) {
   ASSERT_EQ(w1, w2);
 }
 
+TEST(CmdLineTst, CounterGroup) {
+  PerfWatcher watcher = {};
+  ASSERT_TRUE(watcher_from_str("e=hIPC", &watcher));
+  EXPECT_TRUE(watcher.options.counter_group);
+  EXPECT_TRUE(watcher.sample_type & PERF_SAMPLE_READ);
+  EXPECT_EQ(watcher.sample_type_id, DDPROF_PWT_CPU_CYCLES);
+}
+
+TEST(CmdLineTst, KernelCallchain) {
+  PerfWatcher watcher;
+  ASSERT_TRUE(watcher_from_str("sCPU u=fp max_stack=64", &watcher));
+  EXPECT_TRUE(watcher.options.frame_pointers);
+  EXPECT_EQ(watcher.options.max_stack, 64);
+  EXPECT_TRUE(watcher.sample_type & PERF_SAMPLE_CALLCHAIN);
+  EXPECT_FALSE(watcher.sample_type & PERF_SAMPLE_STACK_USER);
+  EXPECT_FALSE(watcher.sample_type & PERF_SAMPLE_REGS_USER);
+
+  // allocations walk their frame pointers in the profiled process
+  ASSERT_TRUE(watcher_from_str("sALLOC u=fp", &watcher));
+  EXPECT_FALSE(watcher.sample_type & PERF_SAMPLE_CALLCHAIN);
+
+  ASSERT_TRUE(watcher_from_str("sCPU", &watcher));
+  EXPECT_FALSE(watcher.sample_type & PERF_SAMPLE_CALLCHAIN);
+  ASSERT_FALSE(watcher_from_str("sCPU u=fp max_stack=0", &watcher));
+  ASSERT_FALSE(watcher_from_str("sCPU u=fp max_stack=65536", &watcher));
+}
+
+TEST(CmdLineTst, HybridUnwind) {
+  PerfWatcher watcher;
+  ASSERT_TRUE(watcher_from_str("sCPU u=hybrid", &watcher));
+  EXPECT_TRUE(watcher.options.hybrid_unwind);
+  EXPECT_FALSE(watcher.options.frame_pointers);
+  EXPECT_TRUE(watcher.sample_type & PERF_SAMPLE_CALLCHAIN);
+  EXPECT_TRUE(watcher.sample_type & PERF_SAMPLE_STACK_USER);
+  EXPECT_TRUE(watcher.sample_type & PERF_SAMPLE_REGS_USER);
+  EXPECT_EQ(watcher.options.stack_sample_size,
+            k_default_hybrid_stack_sample_size);
+
+  // an explicit stack size is kept
+  ASSERT_TRUE(watcher_from_str("sCPU u=hybrid st=1024", &watcher));
+  EXPECT_EQ(watcher.options.stack_sample_size, 1024);
+  ASSERT_FALSE(watcher_from_str("sALLOC u=hybrid", &watcher));
+}
+
+TEST(CmdLineTst, HugePages) {
+  PerfWatcher watcher;
+  ASSERT_TRUE(watcher_from_str("sALLOC huge_pages=1", &watcher));
+  EXPECT_TRUE(watcher.options.huge_pages);
+  ASSERT_TRUE(watcher_from_str("sALLOC hugepages=0", &watcher));
+  EXPECT_FALSE(watcher.options.huge_pages);
+  // perf ring buffers are allocated by the kernel
+  ASSERT_FALSE(watcher_from_str("sCPU huge_pages=1", &watcher));
+  ASSERT_FALSE(watcher_from_str("sALLOC huge_pages=2", &watcher));
+}
+
+TEST(CmdLineTst, Filter) {
+  std::vector<EventConf> configs;
+  ASSERT_EQ(EventConf_parse("e=syscalls:sys_enter_read filter='count > 65536'",
+                            EventConf{}, configs),
+            0);
+  ASSERT_EQ(configs.size(), 1);
+  EXPECT_EQ(configs[0].filter, "count > 65536");
+
+  // Quoted values keep their separators
+  configs.clear();
+  ASSERT_EQ(EventConf_parse("sCPU flt=\"comm == 'a,b' && pid != 1\"; sALLOC",
+                            EventConf{}, configs),
+            0);
+  ASSERT_EQ(configs.size(), 2);
+  EXPECT_EQ(configs[0].filter, "comm == 'a,b' && pid != 1");
+  EXPECT_TRUE(configs[1].filter.empty());
+
+  // Only filters are quoted, and filters are only valid on tracepoints
+  PerfWatcher watcher;
+  ASSERT_FALSE(watcher_from_str("sCPU filter=", &watcher));
+  ASSERT_FALSE(watcher_from_str("sCPU filter=\"\"", &watcher));
+  ASSERT_FALSE(watcher_from_str("sCPU label=\"my label\"", &watcher));
+  ASSERT_FALSE(watcher_from_str("sCPU filter=\"pid == 1\"", &watcher));
+}
+
 TEST(CmdLineTst, LiteralEventWithGoodValue) {
   char const *str = "event=hCPU period=555";
   PerfWatcher watcher = {};
@@ -0,0 +1,95 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include <gtest/gtest.h>
+
+#include "flat_address_map.hpp"
+
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+namespace ddprof {
+
+TEST(FlatAddressMap, simple) {
+  FlatAddressMap<int64_t> map;
+  EXPECT_EQ(map.find(0xbadbeef), nullptr);
+  map[0xbadbeef] = 42;
+  EXPECT_EQ(map.size(), 1);
+  ASSERT_NE(map.find(0xbadbeef), nullptr);
+  EXPECT_EQ(*map.find(0xbadbeef), 42);
+  // null is never a valid key
+  EXPECT_EQ(map.find(0), nullptr);
+  EXPECT_TRUE(map.erase(0xbadbeef));
+  EXPECT_FALSE(map.erase(0xbadbeef));
+  EXPECT_TRUE(map.empty());
+}
+
+TEST(FlatAddressMap, reserve) {
+  FlatAddressMap<int64_t> map(1000);
+  const size_t capacity = map.capacity();
+  EXPECT_GE(capacity, 1000);
+  for (uintptr_t addr = 0x1000; addr < 0x1000 + (1000 * 16); addr += 16) {
+    map[addr] = 1;
+  }
+  EXPECT_EQ(map.size(), 1000);
+  // no rehash
+  EXPECT_EQ(map.capacity(), capacity);
+  map.clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.find(0x1000), nullptr);
+}
+
+// Compare with std::unordered_map through random insertions and deletions
+// (deletions shift entries back: check that nothing gets lost)
+TEST(FlatAddressMap, random_operations) {
+  FlatAddressMap<uint64_t> map;
+  std::unordered_map<uintptr_t, uint64_t> ref;
+  std::mt19937_64 gen(42);
+  // a small address range forces collisions and re-insertions
+  std::uniform_int_distribution<uintptr_t> dis(1, 4096);
+  std::vector<uintptr_t> addresses;
+  for (int i = 0; i < 100000; ++i) {
+    const uintptr_t addr = dis(gen) * 16;
+    if (gen() % 3) {
+      map[addr] = i;
+      ref[addr] = i;
+    } else {
+      EXPECT_EQ(map.erase(addr), ref.erase(addr) == 1);
+    }
+  }
+  ASSERT_EQ(map.size(), ref.size());
+  for (const auto &[addr, value] : ref) {
+    const uint64_t *el = map.find(addr);
+    ASSERT_NE(el, nullptr);
+    EXPECT_EQ(*el, value);
+  }
+}
+
+TEST(FlatAddressMap, erase_if) {
+  FlatAddressMap<uint64_t> map;
+  std::mt19937_64 gen(42);
+  std::uniform_int_distribution<uintptr_t> dis(1, 1 << 20);
+  std::unordered_map<uintptr_t, uint64_t> ref;
+  for (int i = 0; i < 10000; ++i) {
+    const uintptr_t addr = dis(gen) * 16;
+    map[addr] = addr / 16;
+    ref[addr] = addr / 16;
+  }
+  const size_t nb_erased = map.erase_if(
+      [](uintptr_t, uint64_t value) { return value % 3 == 0; });
+  const size_t nb_ref_erased =
+      std::erase_if(ref, [](const auto &el) { return el.second % 3 == 0; });
+  EXPECT_EQ(nb_erased, nb_ref_erased);
+  ASSERT_EQ(map.size(), ref.size());
+  for (const auto &[addr, value] : ref) {
+    const uint64_t *el = map.find(addr);
+    ASSERT_NE(el, nullptr);
+    EXPECT_EQ(*el, value);
+  }
+}
+
+} // namespace ddprof
@@ -0,0 +1,90 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include <benchmark/benchmark.h>
+
+#include "datadog/blazesym.h"
+#include "go_pclntab.hpp"
+
+#include <array>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// Compare Go symbolization through the runtime symbol table with the generic
+// blazesym path. The Go binary is given through DDPROF_BENCH_GO_BINARY.
+namespace ddprof {
+
+namespace {
+constexpr size_t k_nb_addresses = 64;
+constexpr uint64_t k_text_range = 0x100000;
+
+const char *go_binary() { return getenv("DDPROF_BENCH_GO_BINARY"); }
+
+std::vector<ElfAddress_t> random_addresses(uint64_t text_start) {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<uint64_t> dis(text_start,
+                                              text_start + k_text_range);
+  std::vector<ElfAddress_t> addrs(k_nb_addresses);
+  for (auto &addr : addrs) {
+    addr = dis(gen);
+  }
+  return addrs;
+}
+} // namespace
+
+static void BM_GoPclntab(benchmark::State &state) {
+  const char *path = go_binary();
+  auto pclntab = path ? GoPclntab::open(path) : nullptr;
+  if (!pclntab) {
+    state.SkipWithError("DDPROF_BENCH_GO_BINARY is not a Go binary");
+    return;
+  }
+  const auto addrs = random_addresses(pclntab->text_start());
+  std::array<GoFrame, GoPclntab::k_max_inline_depth> frames;
+  for (auto _ : state) {
+    for (auto addr : addrs) {
+      benchmark::DoNotOptimize(pclntab->symbolize(addr, frames));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * addrs.size());
+}
+
+BENCHMARK(BM_GoPclntab);
+
+static void BM_GoBlazesym(benchmark::State &state) {
+  const char *path = go_binary();
+  auto pclntab = path ? GoPclntab::open(path) : nullptr;
+  if (!pclntab) {
+    state.SkipWithError("DDPROF_BENCH_GO_BINARY is not a Go binary");
+    return;
+  }
+  auto addrs = random_addresses(pclntab->text_start());
+  const blaze_symbolizer_opts opts{.type_size = sizeof(blaze_symbolizer_opts),
+                                   .auto_reload = false,
+                                   .code_info = true,
+                                   .inlined_fns = true,
+                                   .demangle = false,
+                                   .reserved = {}};
+  blaze_symbolizer *symbolizer = blaze_symbolizer_new_opts(&opts);
+  const blaze_symbolize_src_elf src_elf{
+      .type_size = sizeof(blaze_symbolize_src_elf),
+      .path = path,
+      .debug_syms = true,
+      .reserved = {},
+  };
+  for (auto _ : state) {
+    const blaze_result *res = blaze_symbolize_elf_virt_offsets(
+        symbolizer, &src_elf, addrs.data(), addrs.size());
+    benchmark::DoNotOptimize(res);
+    blaze_result_free(res);
+  }
+  state.SetItemsProcessed(state.iterations() * addrs.size());
+  blaze_symbolizer_free(symbolizer);
+}
+
+BENCHMARK(BM_GoBlazesym);
+
+} // namespace ddprof
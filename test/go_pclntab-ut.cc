@@ -0,0 +1,304 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include <gtest/gtest.h>
+
+#include "go_pclntab.hpp"
+#include "loghandle.hpp"
+
+#include <array>
+#include <cstring>
+#include <elf.h>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace ddprof {
+
+namespace {
+using Bytes = std::vector<std::byte>;
+
+template <typename T> void put(Bytes &buf, T val) {
+  const auto *p = reinterpret_cast<const std::byte *>(&val);
+  buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+template <typename T> void put_at(Bytes &buf, size_t off, T val) {
+  memcpy(buf.data() + off, &val, sizeof(T));
+}
+
+void put_varint(Bytes &buf, uint32_t val) {
+  while (val >= 0x80) {
+    buf.push_back(static_cast<std::byte>((val & 0x7f) | 0x80));
+    val >>= 7;
+  }
+  buf.push_back(static_cast<std::byte>(val));
+}
+
+// Append a pc-value table made of (value, pc range length) pairs
+uint32_t put_pcvalue_table(Bytes &buf,
+                           const std::vector<std::pair<int32_t, uint32_t>> &t) {
+  const auto off = static_cast<uint32_t>(buf.size());
+  int32_t prev = -1;
+  for (auto [val, len] : t) {
+    const int32_t vdelta = val - prev;
+    put_varint(buf, vdelta < 0 ? (static_cast<uint32_t>(~vdelta) << 1) | 1
+                               : static_cast<uint32_t>(vdelta) << 1);
+    put_varint(buf, len);
+    prev = val;
+  }
+  buf.push_back(std::byte{0});
+  return off;
+}
+
+uint32_t put_string(Bytes &buf, std::string_view str) {
+  const auto off = static_cast<uint32_t>(buf.size());
+  const auto *p = reinterpret_cast<const std::byte *>(str.data());
+  buf.insert(buf.end(), p, p + str.size());
+  buf.push_back(std::byte{0});
+  return off;
+}
+
+constexpr uint64_t k_text_start = 0x1000;
+
+// Go 1.20 layout with two functions:
+// - main.main [0x1000, 0x1100): main.inlined is inlined in [0x1040, 0x1060)
+// - main.other [0x1100, 0x1200)
+struct SyntheticGoTable {
+  SyntheticGoTable() {
+    Bytes funcnametab;
+    const uint32_t main_name = put_string(funcnametab, "main.main");
+    const uint32_t inlined_name = put_string(funcnametab, "main.inlined");
+    const uint32_t other_name = put_string(funcnametab, "main.other");
+
+    Bytes filetab;
+    const uint32_t main_file = put_string(filetab, "/src/main.go");
+    const uint32_t util_file = put_string(filetab, "/src/util.go");
+    Bytes cutab;
+    put(cutab, main_file);
+    put(cutab, util_file);
+
+    Bytes pctab{std::byte{0}}; // offset 0 means no table
+    const uint32_t main_pcfile =
+        put_pcvalue_table(pctab, {{0, 0x40}, {1, 0x20}, {0, 0xa0}});
+    const uint32_t main_pcln =
+        put_pcvalue_table(pctab, {{10, 0x40}, {3, 0x20}, {12, 0xa0}});
+    const uint32_t main_inl_idx =
+        put_pcvalue_table(pctab, {{-1, 0x40}, {0, 0x20}, {-1, 0xa0}});
+    const uint32_t other_pcfile = put_pcvalue_table(pctab, {{0, 0x100}});
+    const uint32_t other_pcln = put_pcvalue_table(pctab, {{20, 0x100}});
+
+    // inlinedCall: funcID, pad[3], nameOff, parentPc, startLine
+    put<uint32_t>(gofunc, 0);
+    put<int32_t>(gofunc, inlined_name);
+    put<int32_t>(gofunc, 0x30);
+    put<int32_t>(gofunc, 1);
+
+    Bytes pclntable;
+    constexpr uint32_t nfunc = 2;
+    pclntable.resize((nfunc + 1) * 2 * sizeof(uint32_t));
+    auto put_func = [&](uint32_t idx, uint32_t entry_off, uint32_t name_off,
+                        uint32_t pcfile, uint32_t pcln, uint32_t inl_idx) {
+      put_at<uint32_t>(pclntable, idx * 8, entry_off);
+      put_at<uint32_t>(pclntable, (idx * 8) + 4, pclntable.size());
+      const bool inlined = inl_idx != 0;
+      put<uint32_t>(pclntable, entry_off);
+      put<int32_t>(pclntable, name_off);
+      put<int32_t>(pclntable, 0);       // args
+      put<uint32_t>(pclntable, 0);      // deferreturn
+      put<uint32_t>(pclntable, 0);      // pcsp
+      put<uint32_t>(pclntable, pcfile); // pcfile
+      put<uint32_t>(pclntable, pcln);   // pcln
+      put<uint32_t>(pclntable, inlined ? 3 : 0); // npcdata
+      put<uint32_t>(pclntable, 0);               // cuOffset
+      put<int32_t>(pclntable, 1);                // startLine
+      put<uint8_t>(pclntable, 0);                // funcID
+      put<uint8_t>(pclntable, 0);                // flag
+      put<uint8_t>(pclntable, 0);                // pad
+      put<uint8_t>(pclntable, inlined ? 4 : 0);  // nfuncdata
+      if (inlined) {
+        put<uint32_t>(pclntable, 0);
+        put<uint32_t>(pclntable, 0);
+        put<uint32_t>(pclntable, inl_idx);
+        put<uint32_t>(pclntable, 0xffffffff);
+        put<uint32_t>(pclntable, 0xffffffff);
+        put<uint32_t>(pclntable, 0xffffffff);
+        put<uint32_t>(pclntable, 0); // inline tree at start of gofunc
+      }
+    };
+    put_func(0, 0, main_name, main_pcfile, main_pcln, main_inl_idx);
+    put_func(1, 0x100, other_name, other_pcfile, other_pcln, 0);
+    // end of text
+    put_at<uint32_t>(pclntable, nfunc * 8, 0x200);
+
+    constexpr size_t header_size = 8 + (8 * sizeof(uint64_t));
+    put<uint32_t>(data, 0xfffffff1);
+    put<uint8_t>(data, 0);
+    put<uint8_t>(data, 0);
+    put<uint8_t>(data, 1); // quantum
+    put<uint8_t>(data, 8); // ptr size
+    put<uint64_t>(data, nfunc);
+    put<uint64_t>(data, 2); // nfiles
+    put<uint64_t>(data, k_text_start);
+    uint64_t off = header_size;
+    for (const Bytes *table :
+         {&funcnametab, &cutab, &filetab, &pctab, &pclntable}) {
+      put<uint64_t>(data, off);
+      off += table->size();
+    }
+    for (const Bytes *table :
+         {&funcnametab, &cutab, &filetab, &pctab, &pclntable}) {
+      data.insert(data.end(), table->begin(), table->end());
+    }
+  }
+
+  Bytes data;
+  Bytes gofunc;
+};
+
+// Minimal ELF file holding a pclntab section and a .text section header
+std::string write_elf(const Bytes &pclntab, std::string_view section_name) {
+  using namespace std::string_literals;
+  const std::string strtab =
+      "\0.shstrtab\0.text\0"s + std::string{section_name} + '\0';
+  constexpr uint32_t k_text_name = 11;
+  constexpr uint32_t k_pclntab_name = 17;
+  const size_t strtab_off = sizeof(Elf64_Ehdr);
+  const size_t pclntab_off = strtab_off + strtab.size();
+  const size_t shdr_off = (pclntab_off + pclntab.size() + 7) & ~7UL;
+
+  Elf64_Ehdr ehdr{};
+  memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+  ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+  ehdr.e_shoff = shdr_off;
+  ehdr.e_shentsize = sizeof(Elf64_Shdr);
+  ehdr.e_shnum = 4;
+  ehdr.e_shstrndx = 1;
+  std::array<Elf64_Shdr, 4> shdrs{};
+  shdrs[1] = {.sh_name = 1,
+              .sh_type = SHT_STRTAB,
+              .sh_offset = strtab_off,
+              .sh_size = strtab.size()};
+  shdrs[2] = {.sh_name = k_text_name,
+              .sh_type = SHT_NOBITS,
+              .sh_addr = k_text_start,
+              .sh_size = 0x200};
+  shdrs[3] = {.sh_name = k_pclntab_name,
+              .sh_type = SHT_PROGBITS,
+              .sh_addr = 0x10000,
+              .sh_offset = pclntab_off,
+              .sh_size = pclntab.size()};
+
+  Bytes file;
+  put(file, ehdr);
+  for (char c : strtab) {
+    put(file, c);
+  }
+  file.insert(file.end(), pclntab.begin(), pclntab.end());
+  file.resize(shdr_off);
+  for (const auto &shdr : shdrs) {
+    put(file, shdr);
+  }
+  std::string path = "/tmp/go_pclntab-ut.XXXXXX";
+  const int fd = mkstemp(path.data());
+  std::ofstream{path, std::ios::binary}.write(
+      reinterpret_cast<const char *>(file.data()), file.size());
+  close(fd);
+  return path;
+}
+} // namespace
+
+TEST(GoPclntab, invalid) {
+  LogHandle handle;
+  Bytes empty;
+  EXPECT_FALSE(GoPclntab::parse(empty));
+  SyntheticGoTable table;
+  table.data[0] = std::byte{0};
+  EXPECT_FALSE(GoPclntab::parse(table.data));
+  // not a Go binary
+  EXPECT_FALSE(GoPclntab::open("/proc/self/exe"));
+  // Go binary without section contents (debug file)
+  EXPECT_FALSE(GoPclntab::open(UNIT_TEST_DATA "/go_exe.debug"));
+  EXPECT_FALSE(GoPclntab::open("/does/not/exist"));
+}
+
+TEST(GoPclntab, open_pie) {
+  LogHandle handle;
+  SyntheticGoTable table;
+  // text start is relocated at load time: taken from the .text section
+  put_at<uint64_t>(table.data, 8 + (2 * sizeof(uint64_t)), 0);
+  for (const char *name : {".gopclntab", ".data.rel.ro.gopclntab"}) {
+    const std::string path = write_elf(table.data, name);
+    auto pclntab = GoPclntab::open(path);
+    unlink(path.c_str());
+    ASSERT_TRUE(pclntab) << name;
+    EXPECT_EQ(pclntab->text_start(), k_text_start);
+    std::array<GoFrame, GoPclntab::k_max_inline_depth> frames;
+    ASSERT_EQ(pclntab->symbolize(0x1150, frames), 1);
+    EXPECT_EQ(frames[0].function, "main.other");
+  }
+}
+
+TEST(GoPclntab, symbolize) {
+  LogHandle handle;
+  SyntheticGoTable table;
+  auto pclntab = GoPclntab::parse(table.data, table.gofunc);
+  ASSERT_TRUE(pclntab);
+  EXPECT_EQ(pclntab->version(), GoPclntab::Version::kGo120);
+  EXPECT_EQ(pclntab->nb_functions(), 2);
+  EXPECT_EQ(pclntab->text_start(), k_text_start);
+  EXPECT_TRUE(pclntab->has_inline_info());
+
+  std::array<GoFrame, GoPclntab::k_max_inline_depth> frames;
+  ASSERT_EQ(pclntab->symbolize(0x1010, frames), 1);
+  EXPECT_EQ(frames[0].function, "main.main");
+  EXPECT_EQ(frames[0].file, "/src/main.go");
+  EXPECT_EQ(frames[0].line, 10);
+
+  ASSERT_EQ(pclntab->symbolize(0x1070, frames), 1);
+  EXPECT_EQ(frames[0].function, "main.main");
+  EXPECT_EQ(frames[0].line, 12);
+
+  ASSERT_EQ(pclntab->symbolize(0x1150, frames), 1);
+  EXPECT_EQ(frames[0].function, "main.other");
+  EXPECT_EQ(frames[0].file, "/src/main.go");
+  EXPECT_EQ(frames[0].line, 20);
+
+  // out of text
+  EXPECT_EQ(pclntab->symbolize(0xfff, frames), 0);
+  EXPECT_EQ(pclntab->symbolize(0x1200, frames), 0);
+}
+
+TEST(GoPclntab, inlined) {
+  LogHandle handle;
+  SyntheticGoTable table;
+  auto pclntab = GoPclntab::parse(table.data, table.gofunc);
+  ASSERT_TRUE(pclntab);
+  std::array<GoFrame, GoPclntab::k_max_inline_depth> frames;
+  ASSERT_EQ(pclntab->symbolize(0x1050, frames), 2);
+  EXPECT_EQ(frames[0].function, "main.inlined");
+  EXPECT_EQ(frames[0].file, "/src/util.go");
+  EXPECT_EQ(frames[0].line, 3);
+  // call site
+  EXPECT_EQ(frames[1].function, "main.main");
+  EXPECT_EQ(frames[1].file, "/src/main.go");
+  EXPECT_EQ(frames[1].line, 10);
+
+  // frames are bounded by the output size
+  EXPECT_EQ(pclntab->symbolize(0x1050, std::span{frames}.first(1)), 1);
+  EXPECT_EQ(frames[0].function, "main.main");
+
+  // Without go:func.* we only get the outer function
+  auto no_inline = GoPclntab::parse(table.data);
+  ASSERT_TRUE(no_inline);
+  EXPECT_FALSE(no_inline->has_inline_info());
+  ASSERT_EQ(no_inline->symbolize(0x1050, frames), 1);
+  EXPECT_EQ(frames[0].function, "main.main");
+  EXPECT_EQ(frames[0].line, 3);
+}
+
+} // namespace ddprof
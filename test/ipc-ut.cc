@@ -121,6 +121,32 @@ TEST(IPCTest, timeout) {
   }
 }
 
+TEST(IPCTest, invalid_reply_closes_fds) {
+  int sockets[2] = {-1, -1};
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets), 0);
+  UnixSocket sender(sockets[0]);
+  UnixSocket receiver(sockets[1]);
+
+  // announce two ring buffers but only send one descriptor
+  ReplyMessage msg;
+  msg.nb_ring_buffers = 2;
+  UniqueFd const event_fd{eventfd(0, 0)};
+  int fd = event_fd.get();
+  std::error_code ec;
+  sender.send({reinterpret_cast<const std::byte *>(&msg), sizeof(msg)},
+              {&fd, 1}, ec);
+  ASSERT_FALSE(ec);
+
+  // lowest free descriptor, that the received one would take
+  int const next_fd = dup(0);
+  close(next_fd);
+  ReplyMessage reply;
+  EXPECT_FALSE(IsDDResOK(receive(receiver, reply)));
+  int const probe_fd = dup(0);
+  close(probe_fd);
+  EXPECT_EQ(probe_fd, next_fd);
+}
+
 TEST(IPCTest, worker_server) {
   constexpr auto kSocketName = "@foo";
   auto server_socket = create_server_socket(kSocketName);
@@ -132,10 +158,13 @@ TEST(IPCTest, worker_server) {
   msg.pid = 1234;
   msg.stack_sample_size = 5678;
   msg.allocation_flags = 0xdeadbeef;
-  msg.ring_buffer.ring_buffer_type = 17;
-  msg.ring_buffer.mem_size = 123456789;
-  msg.ring_buffer.event_fd = eventfd(0, 0);
-  msg.ring_buffer.ring_fd = memfd_create("foo", 0);
+  msg.nb_ring_buffers = 2;
+  for (uint32_t i = 0; i < msg.nb_ring_buffers; ++i) {
+    msg.ring_buffers[i].ring_buffer_type = 17;
+    msg.ring_buffers[i].mem_size = 123456789 + i;
+    msg.ring_buffers[i].event_fd = eventfd(0, 0);
+    msg.ring_buffers[i].ring_fd = memfd_create("foo", 0);
+  }
 
   auto server = start_worker_server(server_socket.get(), msg);
   constexpr auto kNbThreads = 10;
@@ -157,9 +186,16 @@ TEST(IPCTest, worker_server) {
                   msg.loaded_libs_check_interval_ms);
         ASSERT_EQ(info.stack_sample_size, msg.stack_sample_size);
         ASSERT_EQ(info.allocation_flags, msg.allocation_flags);
-        ASSERT_EQ(info.ring_buffer.ring_buffer_type,
-                  msg.ring_buffer.ring_buffer_type);
-        ASSERT_EQ(info.ring_buffer.mem_size, msg.ring_buffer.mem_size);
+        ASSERT_EQ(info.nb_ring_buffers, msg.nb_ring_buffers);
+        for (uint32_t k = 0; k < info.nb_ring_buffers; ++k) {
+          ASSERT_EQ(info.ring_buffers[k].ring_buffer_type,
+                    msg.ring_buffers[k].ring_buffer_type);
+          ASSERT_EQ(info.ring_buffers[k].mem_size,
+                    msg.ring_buffers[k].mem_size);
+          ASSERT_NE(info.ring_buffers[k].ring_fd, -1);
+          close(info.ring_buffers[k].ring_fd);
+          close(info.ring_buffers[k].event_fd);
+        }
       }
     }});
   }
@@ -0,0 +1,85 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include <benchmark/benchmark.h>
+
+#include "live_allocation-c.hpp"
+#include "live_allocation.hpp"
+
+#include <fstream>
+#include <random>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+// Address tracking of live allocations: insert then erase kMaxTracked
+// addresses, the way the worker sees allocations and deallocations.
+namespace ddprof {
+
+namespace {
+using ValuePerAddress = LiveAllocation::ValuePerAddress;
+using StdAddressMap = std::unordered_map<uintptr_t, ValuePerAddress>;
+
+std::vector<uintptr_t> allocation_addresses() {
+  std::mt19937_64 gen(42);
+  // heap-like addresses: 16 bytes aligned, within a 1 GiB range
+  // NOLINTNEXTLINE(readability-magic-numbers)
+  std::uniform_int_distribution<uintptr_t> dis(0, (1UL << 30) / 16);
+  std::vector<uintptr_t> addrs(liveallocation::kMaxTracked);
+  for (auto &addr : addrs) {
+    // NOLINTNEXTLINE(readability-magic-numbers)
+    addr = 0x7f0000000000 + (dis(gen) * 16);
+  }
+  return addrs;
+}
+
+long rss_bytes() {
+  std::ifstream statm("/proc/self/statm");
+  long size = 0;
+  long resident = 0;
+  statm >> size >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+void insert(StdAddressMap &map, uintptr_t addr) { map[addr]._value = 1; }
+void insert(LiveAllocation::AddressMap &map, uintptr_t addr) {
+  map[addr]._value = 1;
+}
+void erase(StdAddressMap &map, uintptr_t addr) { map.erase(addr); }
+void erase(LiveAllocation::AddressMap &map, uintptr_t addr) { map.erase(addr); }
+
+template <typename Map> void BM_AddressMap(benchmark::State &state) {
+  const auto addrs = allocation_addresses();
+  long max_rss_delta = 0;
+  for (auto _ : state) {
+    const long rss_before = rss_bytes();
+    Map map;
+    for (auto addr : addrs) {
+      insert(map, addr);
+    }
+    max_rss_delta = std::max(max_rss_delta, rss_bytes() - rss_before);
+    for (auto addr : addrs) {
+      erase(map, addr);
+    }
+    benchmark::DoNotOptimize(map);
+  }
+  state.SetItemsProcessed(state.iterations() * addrs.size() * 2);
+  state.counters["rss_bytes"] = static_cast<double>(max_rss_delta);
+}
+} // namespace
+
+static void BM_StdAddressMap(benchmark::State &state) {
+  BM_AddressMap<StdAddressMap>(state);
+}
+
+BENCHMARK(BM_StdAddressMap);
+
+static void BM_FlatAddressMap(benchmark::State &state) {
+  BM_AddressMap<LiveAllocation::AddressMap>(state);
+}
+
+BENCHMARK(BM_FlatAddressMap);
+
+} // namespace ddprof
@@ -18,7 +18,8 @@ TEST(LiveAllocationTest, simple) {
   uo.locs.push_back({0x1234, 0x5678, 0x9abc});
   uo.locs.push_back({0x4321, 0x8765, 0xcba9});
 
-  LiveAllocation live_alloc;
+  StackTable stack_table;
+  LiveAllocation live_alloc{stack_table};
   int watcher_pos = 0;
   pid_t pid = 12;
   int64_t value = 10;
@@ -39,8 +40,12 @@ TEST(LiveAllocationTest, simple) {
   EXPECT_EQ(pid_stacks._address_map.size(), nb_registered_allocs);
   // though the stack is the same
   ASSERT_EQ(pid_stacks._unique_stacks.size(), 1);
-  const auto &el = pid_stacks._unique_stacks[uo];
+  const auto &[key, el] = *pid_stacks._unique_stacks.begin();
   EXPECT_EQ(el._value, 100);
+  EXPECT_EQ(key.tid, uo.tid);
+  // the stack is interned once
+  EXPECT_EQ(stack_table.size(), 1);
+  EXPECT_EQ(stack_table.locs(key.stack_id).size(), uo.locs.size());
 
   { // allocate 10
     uintptr_t addr = 0x10;
@@ -53,10 +58,12 @@ TEST(LiveAllocationTest, simple) {
   EXPECT_EQ(pid_stacks._address_map.size(), 0);
   // though the stack is the same
   EXPECT_EQ(pid_stacks._unique_stacks.size(), 0);
+  EXPECT_EQ(stack_table.size(), 0);
 }
 
 TEST(LiveAllocationTest, invalid_inputs) {
-  LiveAllocation live_alloc;
+  StackTable stack_table;
+  LiveAllocation live_alloc{stack_table};
   int watcher_pos = 0;
   pid_t pid = 12;
   int64_t value = 10;
@@ -85,7 +92,8 @@ TEST(LiveAllocationTest, invalid_inputs) {
 
 TEST(LiveAllocationTest, overlap_registrations) {
   LogHandle handle;
-  LiveAllocation live_alloc;
+  StackTable stack_table;
+  LiveAllocation live_alloc{stack_table};
   int watcher_pos = 0;
   pid_t pid = 12;
   int64_t value = 10;
@@ -110,7 +118,7 @@ TEST(LiveAllocationTest, overlap_registrations) {
   EXPECT_EQ(pid_stacks._unique_stacks.size(), 1);
 
   // Check that the value and count have the latest value
-  auto &el = pid_stacks._unique_stacks[uo];
+  auto &el = pid_stacks._unique_stacks.begin()->second;
   EXPECT_EQ(el._value, value * 2);
   EXPECT_EQ(el._count, 1);
 
@@ -125,9 +133,28 @@ TEST(LiveAllocationTest, overlap_registrations) {
   EXPECT_EQ(pid_stacks._unique_stacks.size(), 0);
 }
 
+TEST(LiveAllocationTest, clear_pid) {
+  LogHandle handle;
+  StackTable stack_table;
+  LiveAllocation live_alloc{stack_table};
+  UnwindOutput uo;
+  uo.pid = 12;
+  uo.tid = 12;
+  uo.locs.push_back({0x1234, 0x5678, 0x9abc});
+  live_alloc.register_allocation(uo, 0x10, 10, 0, uo.pid);
+  uo.tid = 13;
+  live_alloc.register_allocation(uo, 0x20, 10, 0, uo.pid);
+  // same frames, different threads
+  EXPECT_EQ(live_alloc._watcher_vector[0][uo.pid]._unique_stacks.size(), 2);
+  EXPECT_EQ(stack_table.size(), 1);
+  live_alloc.clear_pid(uo.pid);
+  EXPECT_EQ(stack_table.size(), 0);
+}
+
 TEST(LiveAllocationTest, stats) {
   LogHandle handle;
-  LiveAllocation live_alloc;
+  StackTable stack_table;
+  LiveAllocation live_alloc{stack_table};
   live_alloc.register_deallocation(0xbadbeef, 0, 1);
   live_alloc.register_deallocation(0xbadbeef, 0, 1);
   EXPECT_EQ(live_alloc.get_nb_unmatched_deallocations(), 2);
@@ -135,4 +162,125 @@ TEST(LiveAllocationTest, stats) {
   EXPECT_EQ(live_alloc.get_nb_unmatched_deallocations(), 0);
 }
 
+TEST(LiveAllocationTest, deallocation_before_allocation) {
+  LogHandle handle;
+  StackTable stack_table;
+  LiveAllocation live_alloc{stack_table};
+  UnwindOutput uo;
+  uo.pid = 12;
+  uo.tid = 12;
+  uo.locs.push_back({0x1234, 0x5678, 0x9abc});
+  // deallocation is processed first (events come from different buffers)
+  live_alloc.register_deallocation(0x10, 0, uo.pid, 200);
+  live_alloc.register_allocation(uo, 0x10, 10, 0, uo.pid, 100);
+  auto &pid_stacks = live_alloc._watcher_vector[0][uo.pid];
+  EXPECT_EQ(pid_stacks._address_map.size(), 0);
+  EXPECT_EQ(pid_stacks._unmatched_deallocations.size(), 0);
+  EXPECT_EQ(stack_table.size(), 0);
+
+  // a later allocation at the same address is live
+  live_alloc.register_deallocation(0x10, 0, uo.pid, 200);
+  live_alloc.register_allocation(uo, 0x10, 10, 0, uo.pid, 300);
+  EXPECT_EQ(pid_stacks._address_map.size(), 1);
+  live_alloc.clear_unmatched_deallocations();
+  EXPECT_EQ(pid_stacks._unmatched_deallocations.size(), 0);
+
+  // ordering does not depend on lifetime measurement
+  live_alloc.register_deallocation(0x20, 0, uo.pid, 200);
+  live_alloc.register_allocation(uo, 0x20, 10, 0, uo.pid, 300, false);
+  EXPECT_EQ(pid_stacks._address_map.size(), 2);
+  EXPECT_EQ(pid_stacks._address_map.find(0x20)->_timestamp, 0);
+}
+
+TEST(LiveAllocationTest, lifetime_buckets) {
+  EXPECT_EQ(LiveAllocation::lifetime_bucket(0), 0);
+  EXPECT_EQ(LiveAllocation::lifetime_bucket(999), 0);
+  EXPECT_EQ(LiveAllocation::lifetime_bucket(1'000), 1);
+  EXPECT_EQ(LiveAllocation::lifetime_bucket(2'000'000), 4);
+  EXPECT_EQ(LiveAllocation::lifetime_bucket(3'600'000'000'000),
+            LiveAllocation::k_nb_lifetime_buckets - 1);
+  EXPECT_EQ(LiveAllocation::lifetime_bucket_name(4), "<10ms");
+}
+
+TEST(LiveAllocationTest, lifetime) {
+  LogHandle handle;
+  UnwindOutput uo;
+  uo.pid = 123;
+  uo.tid = 456;
+  uo.locs.push_back({0x1234, 0x5678, 0x9abc});
+
+  StackTable stack_table;
+  LiveAllocation live_alloc{stack_table};
+  const int watcher_pos = 0;
+  const pid_t pid = 12;
+  const uint64_t t0 = 1'000'000'000;
+  // short-lived (500ns) and long-lived (20s) allocations
+  live_alloc.register_allocation(uo, 0x10, 8, watcher_pos, pid, t0, true);
+  live_alloc.register_allocation(uo, 0x20, 16, watcher_pos, pid, t0, true);
+  live_alloc.register_allocation(uo, 0x30, 32, watcher_pos, pid, t0, true);
+  // lifetime is not measured
+  live_alloc.register_allocation(uo, 0x40, 64, watcher_pos, pid, t0);
+  live_alloc.register_deallocation(0x10, watcher_pos, pid, t0 + 500);
+  live_alloc.register_deallocation(0x20, watcher_pos, pid, t0 + 500);
+  live_alloc.register_deallocation(0x30, watcher_pos, pid,
+                                   t0 + 20'000'000'000);
+  live_alloc.register_deallocation(0x40, watcher_pos, pid, t0 + 500);
+
+  auto &pid_stacks = live_alloc._watcher_vector[watcher_pos][pid];
+  // no live allocation, though the histogram keeps the stack
+  EXPECT_EQ(pid_stacks._unique_stacks.size(), 0);
+  ASSERT_EQ(pid_stacks._lifetime_stacks.size(), 1);
+  EXPECT_EQ(stack_table.size(), 1);
+  const auto &[key, histogram] = *pid_stacks._lifetime_stacks.begin();
+  EXPECT_EQ(key.tid, uo.tid);
+  EXPECT_EQ(histogram._value[0], 24);
+  EXPECT_EQ(histogram._count[0], 2);
+  EXPECT_EQ(histogram._value[LiveAllocation::k_nb_lifetime_buckets - 1], 32);
+  EXPECT_EQ(histogram._count[LiveAllocation::k_nb_lifetime_buckets - 1], 1);
+
+  live_alloc.clear_lifetimes();
+  EXPECT_EQ(pid_stacks._lifetime_stacks.size(), 0);
+  EXPECT_EQ(stack_table.size(), 0);
+}
+
+TEST(LiveAllocationTest, evict_addresses) {
+  LogHandle handle;
+  UnwindOutput uo;
+  uo.pid = 123;
+  uo.tid = 456;
+  uo.locs.push_back({0x1234, 0x5678, 0x9abc});
+
+  StackTable stack_table;
+  LiveAllocation live_alloc{stack_table};
+  const int watcher_pos = 0;
+  const pid_t pid = 12;
+  const liveallocation::AddressSlice slice{.mask = 0x3, .value = 0x1};
+  int64_t nb_in_slice = 0;
+  constexpr int64_t k_nb_allocs = 1000;
+  for (uintptr_t addr = 0x1000; addr < 0x1000 + (k_nb_allocs * 16);
+       addr += 16) {
+    live_alloc.register_allocation(uo, addr, 10, watcher_pos, pid);
+    nb_in_slice += slice.contains(addr) ? 1 : 0;
+  }
+  ASSERT_GT(nb_in_slice, 0);
+
+  live_alloc.evict_addresses(watcher_pos, pid, slice);
+  EXPECT_EQ(live_alloc.get_nb_evicted_addresses(), nb_in_slice);
+  auto &pid_stacks = live_alloc._watcher_vector[watcher_pos][pid];
+  // remaining allocations are still accounted for
+  EXPECT_EQ(pid_stacks._address_map.size(), k_nb_allocs - nb_in_slice);
+  ASSERT_EQ(pid_stacks._unique_stacks.size(), 1);
+  const auto &el = pid_stacks._unique_stacks.begin()->second;
+  EXPECT_EQ(el._count, k_nb_allocs - nb_in_slice);
+  EXPECT_EQ(el._value, (k_nb_allocs - nb_in_slice) * 10);
+
+  // evicting everything releases the stack
+  live_alloc.evict_addresses(watcher_pos, pid, {.mask = 0, .value = 0});
+  EXPECT_EQ(pid_stacks._address_map.size(), 0);
+  EXPECT_EQ(pid_stacks._unique_stacks.size(), 0);
+  EXPECT_EQ(stack_table.size(), 0);
+  live_alloc.cycle();
+  EXPECT_EQ(live_alloc.get_nb_evicted_addresses(), 0);
+}
+
 } // namespace ddprof
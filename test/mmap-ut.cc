@@ -109,4 +109,20 @@ TEST(MMapTest, Mirroring) {
   ASSERT_EQ(perfdisown(region, mmap_size), 0);
 }
 
+TEST(MMapTest, CounterGroupConfigs) {
+  const PerfWatcher *watcher = ewatcher_from_str("hIPC");
+  ASSERT_TRUE(watcher);
+  const std::vector<perf_event_attr> configs =
+      all_perf_configs_from_watcher(watcher, true, PerfClockSource::kNoClock);
+  // inherited counters are tried first
+  ASSERT_EQ(configs.size() % 2, 0);
+  for (size_t i = 0; i < configs.size(); ++i) {
+    EXPECT_EQ(configs[i].inherit, i < configs.size() / 2);
+    EXPECT_EQ(configs[i].read_format, k_perf_read_format);
+    EXPECT_EQ(perf_config_group_member(configs[i], PERF_COUNT_HW_INSTRUCTIONS)
+                  .inherit,
+              configs[i].inherit);
+  }
+}
+
 } // namespace ddprof
@@ -0,0 +1,111 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include <gtest/gtest.h>
+
+#include "loghandle.hpp"
+#include "pending_stacks.hpp"
+
+namespace ddprof {
+
+namespace {
+StackKey make_key(StackTable &table, uint64_t ip, int tid) {
+  UnwindOutput uo;
+  uo.clear();
+  uo.pid = 1;
+  uo.tid = tid;
+  uo.locs.push_back(
+      {.ip = ip, .elf_addr = ip, .file_info_id = 1, .map_info_idx = 0});
+  return {table.intern(uo), uo.pid, uo.tid};
+}
+} // namespace
+
+TEST(PendingStacks, start_finish) {
+  LogHandle handle;
+  StackTable table;
+  PendingStacks pending{table};
+  const StackKey key = make_key(table, 0x1000, 2);
+  uint64_t end_time = 0;
+  EXPECT_FALSE(pending.start(2, {key, 100, 0}, end_time));
+
+  PendingStacks::Interval interval;
+  // another thread
+  EXPECT_FALSE(pending.finish(3, 0, 150, interval));
+  EXPECT_TRUE(pending.finish(2, 0, 200, interval));
+  EXPECT_EQ(interval.key, key);
+  EXPECT_EQ(interval.start_time, 100);
+  EXPECT_EQ(interval.watcher_pos, 0);
+  // the interval is only reported once
+  EXPECT_FALSE(pending.finish(2, 0, 300, interval));
+  table.release(interval.key.stack_id);
+  EXPECT_EQ(table.size(), 0);
+}
+
+TEST(PendingStacks, end_before_start) {
+  LogHandle handle;
+  StackTable table;
+  PendingStacks pending{table};
+  // switch in record read from another ring buffer before the switch out
+  PendingStacks::Interval interval;
+  EXPECT_FALSE(pending.finish(2, 0, 200, interval));
+
+  const StackKey key = make_key(table, 0x1000, 2);
+  uint64_t end_time = 0;
+  EXPECT_TRUE(pending.start(2, {key, 100, 0}, end_time));
+  EXPECT_EQ(end_time, 200);
+  table.release(key.stack_id);
+
+  // an older end does not match a newer start
+  const StackKey key2 = make_key(table, 0x2000, 2);
+  EXPECT_FALSE(pending.finish(2, 0, 250, interval));
+  EXPECT_FALSE(pending.start(2, {key2, 300, 0}, end_time));
+  EXPECT_TRUE(pending.finish(2, 0, 400, interval));
+  EXPECT_EQ(interval.start_time, 300);
+  table.release(interval.key.stack_id);
+  EXPECT_EQ(table.size(), 0);
+}
+
+TEST(PendingStacks, watchers) {
+  LogHandle handle;
+  StackTable table;
+  PendingStacks pending{table};
+  // a thread blocked in a syscall is also switched out
+  const StackKey key = make_key(table, 0x1000, 2);
+  table.add_ref(key.stack_id);
+  uint64_t end_time = 0;
+  EXPECT_FALSE(pending.start(2, {key, 100, 0, 1}, end_time));
+  EXPECT_FALSE(pending.start(2, {key, 110, 1, 0}, end_time));
+
+  PendingStacks::Interval interval;
+  EXPECT_TRUE(pending.finish(2, 1, 150, interval));
+  EXPECT_EQ(interval.start_time, 110);
+  table.release(interval.key.stack_id);
+  EXPECT_TRUE(pending.finish(2, 0, 200, interval));
+  EXPECT_EQ(interval.start_time, 100);
+  EXPECT_EQ(interval.value, 1);
+  table.release(interval.key.stack_id);
+  EXPECT_EQ(table.size(), 0);
+}
+
+TEST(PendingStacks, release) {
+  LogHandle handle;
+  StackTable table;
+  PendingStacks pending{table};
+  uint64_t end_time = 0;
+  // the end of the first interval was lost
+  pending.start(2, {make_key(table, 0x1000, 2), 100, 0}, end_time);
+  pending.start(2, {make_key(table, 0x2000, 2), 200, 0}, end_time);
+  EXPECT_EQ(table.size(), 1);
+  pending.start(3, {make_key(table, 0x3000, 3), 200, 0}, end_time);
+  EXPECT_EQ(table.size(), 2);
+  pending.erase(3);
+  EXPECT_EQ(table.size(), 1);
+  EXPECT_EQ(pending.size(), 1);
+  pending.clear();
+  EXPECT_EQ(table.size(), 0);
+  EXPECT_EQ(pending.size(), 0);
+}
+
+} // namespace ddprof
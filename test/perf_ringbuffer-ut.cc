@@ -110,4 +110,82 @@ TEST(PerfRingbufferTest, SampleSymmetryx86) {
   ASSERT_TRUE(sample_eq(&sample, sample_new));
 }
 
+TEST(PerfRingbufferTest, SampleReadGroup) {
+  uint64_t const mask = perf_event_default_sample_type() | PERF_SAMPLE_READ;
+  // leader and two counters: {nr, {value, id}...}
+  uint64_t const read_buf[] = {3, 100, 1, 200, 2, 300, 3};
+  uint64_t default_regs[k_perf_register_count] = {};
+  char default_stack[512] = {0};
+  for (uint64_t i = 0; i < std::size(default_stack); i++)
+    default_stack[i] = i & 255;
+
+  struct perf_event_sample sample = {};
+  sample.header.type = PERF_RECORD_SAMPLE;
+  sample.pid = 3;
+  sample.tid = 4;
+  sample.time = 5;
+  sample.period = 7;
+  sample.v = reinterpret_cast<const struct read_format *>(read_buf);
+  sample.abi = PERF_SAMPLE_REGS_ABI_64;
+  sample.regs = default_regs;
+  sample.size_stack = std::size(default_stack);
+  sample.data_stack = default_stack;
+  sample.dyn_size_stack = std::size(default_stack);
+
+  char hdr_placeholder[4096] = {0};
+  struct perf_event_header *hdr = (struct perf_event_header *)hdr_placeholder;
+  ASSERT_TRUE(samp2hdr(hdr, &sample, sizeof(hdr_placeholder), mask));
+  struct perf_event_sample *sample_new = hdr2samp(hdr, mask);
+  ASSERT_TRUE(sample_new);
+  ASSERT_EQ(sample_new->v->nr, 3);
+  EXPECT_EQ(sample_new->v->values[0].value, 100);
+  EXPECT_EQ(sample_new->v->values[2].value, 300);
+  EXPECT_EQ(sample_new->v->values[2].id, 3);
+  // fields around the counters are still found
+  EXPECT_EQ(sample_new->period, sample.period);
+  EXPECT_EQ(sample_new->abi, sample.abi);
+  ASSERT_EQ(sample_new->size_stack, sample.size_stack);
+  EXPECT_EQ(memcmp(sample_new->data_stack, default_stack, sample.size_stack),
+            0);
+}
+
+TEST(PerfRingbufferTest, SampleCallchain) {
+  uint64_t regs[k_perf_register_count] = {};
+  char stack[64] = {0};
+  struct perf_event_sample sample = {};
+  sample.header.type = PERF_RECORD_SAMPLE;
+  sample.abi = PERF_SAMPLE_REGS_ABI_64;
+  sample.regs = regs;
+  sample.size_stack = std::size(stack);
+  sample.data_stack = stack;
+  sample.dyn_size_stack = std::size(stack);
+  char hdr_placeholder[4096] = {0};
+  auto *hdr = reinterpret_cast<struct perf_event_header *>(hdr_placeholder);
+  uint64_t const stack_mask = perf_event_default_sample_type();
+  ASSERT_TRUE(samp2hdr(hdr, &sample, sizeof(hdr_placeholder), stack_mask));
+  ASSERT_TRUE(hdr2samp(hdr, stack_mask)->regs);
+
+  // user callchain walked by the kernel, without stack copy
+  uint64_t const mask =
+      (stack_mask & ~(PERF_SAMPLE_STACK_USER | PERF_SAMPLE_REGS_USER)) |
+      PERF_SAMPLE_CALLCHAIN;
+  uint64_t const ips[] = {PERF_CONTEXT_USER, 0x1000, 0x2000, 0x3000};
+  sample = {};
+  sample.header.type = PERF_RECORD_SAMPLE;
+  sample.pid = 3;
+  sample.period = 7;
+  sample.nr = std::size(ips);
+  sample.ips = ips;
+  ASSERT_TRUE(samp2hdr(hdr, &sample, sizeof(hdr_placeholder), mask));
+  struct perf_event_sample *sample_new = hdr2samp(hdr, mask);
+  ASSERT_TRUE(sample_new);
+  EXPECT_EQ(sample_new->pid, 3);
+  EXPECT_EQ(sample_new->period, 7);
+  ASSERT_EQ(sample_new->nr, std::size(ips));
+  EXPECT_EQ(memcmp(sample_new->ips, ips, sizeof(ips)), 0);
+  // nothing left from the previous sample
+  EXPECT_FALSE(sample_new->regs);
+  EXPECT_EQ(sample_new->size_stack, 0);
+}
+
 } // namespace ddprof
@@ -33,4 +33,83 @@ TEST(PeventTest, setup_cleanup) {
   ASSERT_TRUE(IsDDResOK(res));
 }
 
+TEST(PeventTest, frame_pointer_ring_buffers) {
+  PEventHdr pevent_hdr;
+  LogHandle log_handle;
+  DDProfContext ctx;
+  pid_t mypid = getpid();
+  // the kernel walks the stack (u=fp): no stack copy in the samples
+  PerfWatcher watcher = *ewatcher_from_str("sCPU");
+  watcher.options.frame_pointers = true;
+  watcher.sample_type &= ~(PERF_SAMPLE_STACK_USER | PERF_SAMPLE_REGS_USER);
+  watcher.sample_type |= PERF_SAMPLE_CALLCHAIN;
+  ctx.watchers.push_back(watcher);
+  pevent_init(&pevent_hdr);
+  DDRes res = pevent_setup(ctx, {&mypid, 1}, get_nprocs(), &pevent_hdr);
+  ASSERT_TRUE(IsDDResOK(res));
+  ASSERT_GT(pevent_hdr.size, 0);
+  // sized from the callchain instead of the (unused) stack sample size
+  EXPECT_EQ(pevent_hdr.pes[0].ring_buffer_size,
+            perf_mmap_size(k_default_buffer_size_shift));
+  res = pevent_cleanup(&pevent_hdr);
+  ASSERT_TRUE(IsDDResOK(res));
+}
+
+TEST(PeventTest, target_cpus) {
+  LogHandle log_handle;
+  DDProfContext ctx;
+  pid_t mypid = getpid();
+  int const num_cpu = get_nprocs_conf();
+  cpu_set_t initial_affinity;
+  ASSERT_EQ(sched_getaffinity(0, sizeof(initial_affinity), &initial_affinity),
+            0);
+
+  cpu_set_t cpus;
+  // global mode
+  ctx.params.pid = -1;
+  pevent_target_cpus(ctx, {&mypid, 1}, num_cpu, cpus);
+  EXPECT_EQ(CPU_COUNT(&cpus), num_cpu);
+
+  // PID mode follows the affinity of the target
+  ctx.params.pid = mypid;
+  cpu_set_t cpu_0;
+  CPU_ZERO(&cpu_0);
+  CPU_SET(0, &cpu_0);
+  ASSERT_EQ(sched_setaffinity(0, sizeof(cpu_0), &cpu_0), 0);
+  pevent_target_cpus(ctx, {&mypid, 1}, num_cpu, cpus);
+  EXPECT_EQ(CPU_COUNT(&cpus), 1);
+  EXPECT_TRUE(CPU_ISSET(0, &cpus));
+  sched_setaffinity(0, sizeof(initial_affinity), &initial_affinity);
+}
+
+TEST(PeventTest, adapt_mmap_orders) {
+  constexpr int k_min = k_default_buffer_size_shift;
+  size_t const min_size = perf_mmap_size(k_min);
+  std::vector<int> const min_orders(4, k_min);
+  std::vector<int> orders{k_min, k_min, k_min + 2, k_min + 1};
+  std::vector<RingBufferUsage> const usages{
+      {.lost = 10, .max_used_size = 0},
+      {.lost = 0, .max_used_size = 0},
+      // mostly empty, shrinks
+      {.lost = 0, .max_used_size = 1},
+      // more than a quarter full, kept
+      {.lost = 0, .max_used_size = min_size}};
+  pevent_adapt_mmap_orders(usages, min_orders, orders, 16 * min_size);
+  EXPECT_EQ(orders, (std::vector<int>{k_min + 1, k_min, k_min + 1, k_min + 1}));
+
+  // growth is bounded by the budget, the buffer losing the most grows first
+  orders = {k_min, k_min, k_min, k_min};
+  std::vector<RingBufferUsage> const lossy{{.lost = 1, .max_used_size = 0},
+                                           {.lost = 5, .max_used_size = 0},
+                                           {.lost = 0, .max_used_size = 0},
+                                           {.lost = 0, .max_used_size = 0}};
+  pevent_adapt_mmap_orders(lossy, min_orders, orders, 5 * min_size);
+  EXPECT_EQ(orders, (std::vector<int>{k_min, k_min + 1, k_min, k_min}));
+
+  // up to the maximum order
+  orders = {k_max_buffer_size_shift, k_min, k_min, k_min};
+  pevent_adapt_mmap_orders(lossy, min_orders, orders, SIZE_MAX);
+  EXPECT_EQ(orders[0], k_max_buffer_size_shift);
+}
+
 } // namespace ddprof
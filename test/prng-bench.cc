@@ -35,4 +35,24 @@ static void BM_mt19937(benchmark::State &state) {
 }
 
 BENCHMARK(BM_mt19937);
+
+// Sampling intervals of the allocation tracker (mean of 512K)
+static void BM_exponential_distribution_minstd(benchmark::State &state) {
+  std::minstd_rand rng{std::random_device{}()};
+  for (auto _ : state) {
+    std::exponential_distribution<> dist(1.0 / 524288);
+    benchmark::DoNotOptimize(dist(rng));
+  }
+}
+
+BENCHMARK(BM_exponential_distribution_minstd);
+
+static void BM_exponential_sample_xoshiro256ss(benchmark::State &state) {
+  xoshiro256ss rng{std::random_device{}()};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(524288 * exponential_sample(rng()));
+  }
+}
+
+BENCHMARK(BM_exponential_sample_xoshiro256ss);
 } // namespace ddprof
@@ -0,0 +1,97 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "ringbuffer_holder.hpp"
+#include "ringbuffer_utils.hpp"
+
+namespace ddprof {
+
+namespace {
+constexpr size_t k_buf_size_order = 8;
+constexpr size_t k_record_size = 64;
+// allocation events hold a copy of the stack
+constexpr size_t k_large_buf_size_order = 12;
+constexpr size_t k_stack_record_size = 4096;
+
+std::unique_ptr<RingBufferHolder> g_ring_buffer;
+std::atomic<bool> g_reader_continue;
+std::thread g_reader_thread;
+
+void drain(RingBuffer *rb) {
+  while (g_reader_continue.load(std::memory_order_relaxed)) {
+    MPSCRingBufferReader reader{rb};
+    for (auto buf = reader.read_sample(); !buf.empty();
+         buf = reader.read_sample()) {
+      benchmark::DoNotOptimize(buf.data());
+    }
+  }
+}
+
+void run_producers(benchmark::State &state, size_t buf_size_order,
+                   size_t record_size, bool huge_pages) {
+  if (state.thread_index() == 0) {
+    g_ring_buffer = std::make_unique<RingBufferHolder>(
+        buf_size_order, RingBufferType::kMPSCRingBuffer, true, huge_pages);
+    g_reader_continue = true;
+    g_reader_thread = std::thread{drain, &g_ring_buffer->get_ring_buffer()};
+  }
+
+  int64_t nb_full = 0;
+  for (auto _ : state) {
+    MPSCRingBufferWriter writer{&g_ring_buffer->get_ring_buffer()};
+    auto buf = writer.reserve(record_size);
+    while (buf.empty()) {
+      ++nb_full;
+      // let the consumer catch up
+      std::this_thread::yield();
+      writer.update_tail();
+      buf = writer.reserve(record_size);
+    }
+    // write the whole record, as a stack copy does
+    std::fill(buf.begin(), buf.end(), std::byte{1});
+    writer.commit(buf);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * record_size);
+  state.counters["full"] =
+      benchmark::Counter(nb_full, benchmark::Counter::kAvgThreads);
+
+  if (state.thread_index() == 0) {
+    g_reader_continue = false;
+    g_reader_thread.join();
+    g_ring_buffer.reset();
+  }
+}
+
+} // namespace
+
+// Producers reserve and commit records concurrently while a consumer drains
+// the ring buffer (run with 1 to 64 producer threads)
+static void BM_MPSCProducers(benchmark::State &state) {
+  run_producers(state, k_buf_size_order, k_record_size, false);
+}
+
+// Same with stack-sized records in a large ring buffer, backed by huge pages
+// or not (falls back to regular pages if the system has no huge pages)
+static void BM_MPSCProducersHugePages(benchmark::State &state) {
+  run_producers(state, k_large_buf_size_order, k_stack_record_size,
+                state.range(0) != 0);
+}
+
+BENCHMARK(BM_MPSCProducers)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_MPSCProducersHugePages)
+    ->ArgName("huge_pages")
+    ->Arg(0)
+    ->Arg(1)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+} // namespace ddprof
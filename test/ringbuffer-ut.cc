@@ -7,6 +7,7 @@
 #include "ringbuffer_holder.hpp"
 #include "ringbuffer_utils.hpp"
 
+#include <algorithm>
 #include <gtest/gtest.h>
 #include <thread>
 
@@ -328,15 +329,93 @@ TEST(ringbuffer, mpsc_ring_buffer_multiple_producer) {
   }
 }
 
-TEST(ringbuffer, mpsc_ring_buffer_stale_lock) {
+TEST(ringbuffer, mpsc_ring_buffer_full) {
   const size_t buf_size_order = 0;
   RingBufferHolder ring_buffer{buf_size_order, RingBufferType::kMPSCRingBuffer};
   MPSCRingBufferWriter writer{&ring_buffer.get_ring_buffer()};
 
-  // simulate stale lock
-  ring_buffer.get_ring_buffer().spinlock->lock();
+  size_t nb_records = 0;
+  while (!writer.reserve(sizeof(MyElement)).empty()) {
+    ++nb_records;
+  }
+  ASSERT_GT(nb_records, 0);
+  // empty records are not supported
+  ASSERT_TRUE(writer.reserve(0).empty());
+}
+
+TEST(ringbuffer, mpsc_ring_buffer_out_of_order_commit) {
+  const size_t buf_size_order = 0;
+  RingBufferHolder ring_buffer{buf_size_order, RingBufferType::kMPSCRingBuffer};
+  MPSCRingBufferWriter writer{&ring_buffer.get_ring_buffer()};
+  auto buf1 = writer.reserve(sizeof(uint64_t));
+  auto buf2 = writer.reserve(sizeof(uint64_t));
+  ASSERT_FALSE(buf1.empty());
+  ASSERT_FALSE(buf2.empty());
+  *reinterpret_cast<uint64_t *>(buf2.data()) = 2;
+  writer.commit(buf2);
+  {
+    // first record is still busy
+    MPSCRingBufferReader reader{&ring_buffer.get_ring_buffer()};
+    ASSERT_GT(reader.available_size(), 0);
+    ASSERT_TRUE(reader.read_sample().empty());
+  }
+  *reinterpret_cast<uint64_t *>(buf1.data()) = 1;
+  writer.commit(buf1);
+  MPSCRingBufferReader reader{&ring_buffer.get_ring_buffer()};
+  for (uint64_t expected : {1, 2}) {
+    auto buf = reader.read_sample();
+    ASSERT_EQ(buf.size(), sizeof(uint64_t));
+    ASSERT_EQ(*reinterpret_cast<const uint64_t *>(buf.data()), expected);
+  }
+  ASSERT_TRUE(reader.read_sample().empty());
+}
+
+TEST(ringbuffer, mpsc_ring_buffer_release_clears) {
+  const size_t buf_size_order = 0;
+  RingBufferHolder ring_buffer{buf_size_order, RingBufferType::kMPSCRingBuffer};
+  RingBuffer &rb = ring_buffer.get_ring_buffer();
+  MPSCRingBufferWriter writer{&rb};
+  // wrap around the buffer a few times
+  for (int i = 0; i < 1000; ++i) {
+    auto buf = writer.reserve(sizeof(MyElement));
+    ASSERT_FALSE(buf.empty());
+    std::fill(buf.begin(), buf.end(), std::byte{0xff});
+    writer.commit(buf);
+    MPSCRingBufferReader reader{&rb};
+    ASSERT_EQ(reader.read_sample().size(), sizeof(MyElement));
+    reader.advance();
+    writer.update_tail();
+    // released space reads as unwritten records
+    ASSERT_TRUE(std::all_of(rb.data, rb.data + rb.data_size,
+                            [](std::byte b) { return b == std::byte{0}; }));
+  }
+}
 
-  bool timeout = false;
-  ASSERT_TRUE(writer.reserve(4, &timeout).empty());
-  ASSERT_TRUE(timeout);
+TEST(ringbuffer, mpsc_ring_buffer_huge_pages) {
+  // regular pages are used when no huge pages are available
+  const size_t buf_size_order = 1;
+  RingBufferHolder ring_buffer{buf_size_order, RingBufferType::kMPSCRingBuffer,
+                               true, true};
+  RingBuffer &rb = ring_buffer.get_ring_buffer();
+  if (rb.meta_size == k_huge_page_size) {
+    // data is rounded up to a huge page
+    ASSERT_EQ(rb.data_size, k_huge_page_size);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(rb.base) % k_huge_page_size, 0);
+  } else {
+    ASSERT_EQ(rb.meta_size, get_page_size());
+  }
+
+  // producers attach from the buffer info (as instrumented processes do)
+  PEvent attached{};
+  ASSERT_TRUE(
+      IsDDResOK(ring_buffer_attach(ring_buffer.get_buffer_info(), &attached)));
+  ASSERT_EQ(attached.rb.meta_size, rb.meta_size);
+  ASSERT_EQ(attached.rb.data_size, rb.data_size);
+  {
+    // wrap around the buffer
+    size_t const nelem = 3 * rb.data_size / sizeof(MyElement);
+    std::jthread producer{mpsc_writer_fun, &attached.rb, nelem, 0, false};
+    std::jthread consumer{mpsc_reader_fun, &rb, nelem, 1, false, true};
+  }
+  ASSERT_TRUE(IsDDResOK(ring_buffer_detach(attached)));
 }
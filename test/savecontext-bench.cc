@@ -6,11 +6,13 @@
 #include <benchmark/benchmark.h>
 
 #include "ddprof_base.hpp"
+#include "ddprof_defs.hpp"
 #include "perf.hpp"
 #include "perf_archmap.hpp"
 #include "savecontext.hpp"
 #include "syscalls.hpp"
 
+#include <array>
 #include <thread>
 
 namespace ddprof {
@@ -49,6 +51,19 @@ static void BM_SaveContext(benchmark::State &state) {
 
 BENCHMARK(BM_SaveContext);
 
+static void BM_SaveCallchain(benchmark::State &state) {
+  std::array<uint64_t, kMaxStackDepth> pcs;
+  std::span<const std::byte> stack_bounds = retrieve_stack_bounds();
+  if (stack_bounds.empty()) {
+    exit(1);
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(save_callchain(stack_bounds, pcs));
+  }
+}
+
+BENCHMARK(BM_SaveCallchain);
+
 static void BM_GetStackStart(benchmark::State &state) {
   for (auto _ : state) {
     get_stack_start();
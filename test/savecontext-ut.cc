@@ -6,6 +6,7 @@
 #include <gtest/gtest.h>
 
 #include "ddprof_base.hpp"
+#include "ddprof_defs.hpp"
 #include "defer.hpp"
 #include "loghandle.hpp"
 #include "perf.hpp"
@@ -14,6 +15,7 @@
 #include "unwind.hpp"
 
 #include <algorithm>
+#include <array>
 #include <condition_variable>
 #include <mutex>
 #include <thread>
@@ -52,6 +54,81 @@ void funcA() {
 
 TEST(getcontext, getcontext) { funcA(); }
 
+DDPROF_NOINLINE void funcE();
+DDPROF_NOINLINE void funcF();
+
+void funcF() {
+  blaze_symbolizer *symbolizer = blaze_symbolizer_new();
+  defer { blaze_symbolizer_free(symbolizer); };
+
+  UnwindState state = create_unwind_state().value();
+  std::array<uint64_t, kMaxStackDepth> pcs;
+  size_t const nb_pcs = save_callchain(retrieve_stack_bounds(), pcs);
+  ASSERT_GT(nb_pcs, 3);
+
+  unwind_init_sample_callchain(&state, getpid(), {pcs.data(), nb_pcs});
+  unwindstate_unwind(&state);
+
+  auto demangled_syms = collect_symbols(state, symbolizer);
+  EXPECT_GT(demangled_syms.size(), 3);
+  EXPECT_TRUE(demangled_syms[0].starts_with("ddprof::save_callchain("));
+  EXPECT_EQ(demangled_syms[1], "ddprof::funcF()");
+  EXPECT_EQ(demangled_syms[2], "ddprof::funcE()");
+}
+
+void funcE() {
+  funcF();
+  DDPROF_BLOCK_TAIL_CALL_OPTIMIZATION();
+}
+
+TEST(getcontext, callchain) { funcE(); }
+
+DDPROF_NOINLINE void funcG();
+DDPROF_NOINLINE void funcH();
+
+// captured by funcH (small frame: only the top of the stack is kept)
+uint64_t hybrid_regs[k_nb_registers_to_unwind];
+size_t hybrid_stack_size;
+std::array<uint64_t, kMaxStackDepth> hybrid_pcs;
+size_t hybrid_nb_pcs;
+
+void funcH() {
+  hybrid_stack_size =
+      save_context(retrieve_stack_bounds(), hybrid_regs, stack);
+  hybrid_nb_pcs = save_callchain(retrieve_stack_bounds(), hybrid_pcs);
+}
+
+void funcG() {
+  funcH();
+  DDPROF_BLOCK_TAIL_CALL_OPTIMIZATION();
+}
+
+TEST(getcontext, hybrid) {
+  blaze_symbolizer *symbolizer = blaze_symbolizer_new();
+  defer { blaze_symbolizer_free(symbolizer); };
+  funcG();
+  ASSERT_GT(hybrid_nb_pcs, 3);
+
+  // The leaf frames come from the stack, the callers of funcH from the
+  // callchain (the leaf of the callchain is in save_callchain)
+  UnwindState state = create_unwind_state().value();
+  unwind_init_sample_hybrid(
+      &state, hybrid_regs, getpid(),
+      std::min(hybrid_stack_size,
+               static_cast<size_t>(k_default_hybrid_stack_sample_size)),
+      reinterpret_cast<char *>(stack), {hybrid_pcs.data(), hybrid_nb_pcs});
+  unwindstate_unwind(&state);
+
+  auto demangled_syms = collect_symbols(state, symbolizer);
+  EXPECT_GT(demangled_syms.size(), 3);
+  EXPECT_TRUE(demangled_syms[0].starts_with("ddprof::save_context("));
+  EXPECT_EQ(demangled_syms[1], "ddprof::funcH()");
+  EXPECT_EQ(demangled_syms[2], "ddprof::funcG()");
+  EXPECT_EQ(std::count(demangled_syms.begin(), demangled_syms.end(),
+                       "ddprof::funcG()"),
+            1);
+}
+
 #if defined(__x86_64__) && !defined(MUSL_LIBC)
 // The matrix of where it works well is slightly more complex
 // There are also differences depending on vdso (as this can be a kernel
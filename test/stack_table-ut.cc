@@ -0,0 +1,107 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include <gtest/gtest.h>
+
+#include "loghandle.hpp"
+#include "stack_table.hpp"
+
+#include <vector>
+
+namespace ddprof {
+
+namespace {
+UnwindOutput make_output(uint64_t first_ip, unsigned nb_locs) {
+  UnwindOutput uo;
+  uo.clear();
+  uo.pid = 1;
+  uo.tid = 1;
+  for (unsigned i = 0; i < nb_locs; ++i) {
+    uo.locs.push_back({.ip = first_ip + i,
+                       .elf_addr = first_ip + i,
+                       .file_info_id = 1,
+                       .symbol_idx = static_cast<SymbolIdx_t>(i),
+                       .map_info_idx = 0});
+  }
+  return uo;
+}
+} // namespace
+
+TEST(StackTable, intern) {
+  LogHandle handle;
+  StackTable table;
+  const UnwindOutput uo1 = make_output(0x1000, 3);
+  const UnwindOutput uo2 = make_output(0x2000, 5);
+
+  const StackId id1 = table.intern(uo1);
+  const StackId id2 = table.intern(uo2);
+  EXPECT_NE(id1, id2);
+  EXPECT_EQ(table.intern(uo1), id1);
+  EXPECT_EQ(table.size(), 2);
+  // frames are only stored once
+  EXPECT_EQ(table.arena_size(), 8);
+
+  const auto locs = table.locs(id2);
+  ASSERT_EQ(locs.size(), 5);
+  EXPECT_TRUE(std::equal(locs.begin(), locs.end(), uo2.locs.begin()));
+  EXPECT_EQ(table.container_id(id1), uo1.container_id);
+
+  // same frames in another container are a different stack
+  UnwindOutput uo3 = uo1;
+  uo3.container_id = "abc";
+  const StackId id3 = table.intern(uo3);
+  EXPECT_NE(id3, id1);
+  EXPECT_EQ(table.container_id(id3), "abc");
+}
+
+TEST(StackTable, release) {
+  LogHandle handle;
+  StackTable table;
+  const UnwindOutput uo1 = make_output(0x1000, 3);
+  const UnwindOutput uo2 = make_output(0x2000, 3);
+
+  const StackId id1 = table.intern(uo1);
+  EXPECT_EQ(table.intern(uo1), id1);
+  table.release(id1);
+  EXPECT_EQ(table.size(), 1);
+  table.release(id1);
+  EXPECT_EQ(table.size(), 0);
+
+  // released ids are reused
+  const StackId id2 = table.intern(uo2);
+  EXPECT_EQ(id2, id1);
+  const auto locs = table.locs(id2);
+  EXPECT_TRUE(std::equal(locs.begin(), locs.end(), uo2.locs.begin(),
+                         uo2.locs.end()));
+}
+
+TEST(StackTable, compaction) {
+  LogHandle handle;
+  StackTable table;
+  constexpr unsigned k_nb_stacks = 1000;
+  constexpr unsigned k_depth = 10;
+  std::vector<StackId> ids;
+  for (unsigned i = 0; i < k_nb_stacks; ++i) {
+    ids.push_back(table.intern(make_output(0x1000 * (i + 1), k_depth)));
+  }
+  EXPECT_EQ(table.arena_size(), k_nb_stacks * k_depth);
+  // release all even stacks
+  for (unsigned i = 0; i < k_nb_stacks; i += 2) {
+    table.release(ids[i]);
+  }
+  EXPECT_EQ(table.size(), k_nb_stacks / 2);
+  EXPECT_LT(table.arena_size(), k_nb_stacks * k_depth);
+
+  // remaining stacks are unchanged
+  for (unsigned i = 1; i < k_nb_stacks; i += 2) {
+    const UnwindOutput uo = make_output(0x1000 * (i + 1), k_depth);
+    const auto locs = table.locs(ids[i]);
+    ASSERT_TRUE(std::equal(locs.begin(), locs.end(), uo.locs.begin(),
+                           uo.locs.end()));
+    EXPECT_EQ(table.intern(uo), ids[i]);
+  }
+}
+
+} // namespace ddprof
@@ -0,0 +1,27 @@
+// Unless explicitly stated otherwise all files in this repository are licensed
+// under the Apache License Version 2.0. This product includes software
+// developed at Datadog (https://www.datadoghq.com/). Copyright 2021-Present
+// Datadog, Inc.
+
+#include <gtest/gtest.h>
+
+#include "syscall_names.hpp"
+
+#include <sys/syscall.h>
+
+namespace ddprof {
+
+TEST(syscall_names, known) {
+  EXPECT_EQ(syscall_name(SYS_read), "read");
+  EXPECT_EQ(syscall_name(SYS_futex), "futex");
+  EXPECT_EQ(syscall_name(SYS_epoll_pwait), "epoll_pwait");
+}
+
+TEST(syscall_names, unknown) {
+  std::string_view const name = syscall_name(100000);
+  EXPECT_EQ(name, "sys_100000");
+  // same storage for the next lookups
+  EXPECT_EQ(syscall_name(100000).data(), name.data());
+}
+
+} // namespace ddprof